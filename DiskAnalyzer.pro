@@ -8,28 +8,73 @@ TEMPLATE = app
 
 DEFINES += QT_DEPRECATED_WARNINGS
 
+# Без инструментирования сканера (вкладка "Статистика" и --stats в консольной версии)
+# DEFINES += DISKANALYZER_NO_SCAN_STATS
+
 
 
 CONFIG += c++17
 
 SOURCES += \
+        aggregator.cpp \
+        dirreader.cpp \
+        dirtreemodel.cpp \
+        duplicatefinder.cpp \
         fileitem.cpp \
+        filesmodel.cpp \
+        filesystembackend.cpp \
+        filetree.cpp \
+        inodeset.cpp \
         main.cpp \
         mainwindow.cpp \
-        scanner.cpp
+        namematcher.cpp \
+        namesearch.cpp \
+        scanfilter.cpp \
+        scanner.cpp \
+        scanstats.cpp \
+        topfiles.cpp \
+        treemaplayout.cpp \
+        trigramindex.cpp \
+        treemapwidget.cpp \
+        treewatcher.cpp
 
 
 
 HEADERS += \
+        aggregator.h \
+        chunkedarray.h \
+        dirreader.h \
+        dirtreemodel.h \
+        duplicatefinder.h \
         fileitem.h \
+        filesmodel.h \
+        filesystembackend.h \
+        filetree.h \
+        inodeset.h \
         mainwindow.h \
-        scanner.h
+        namematcher.h \
+        namesearch.h \
+        scanfilter.h \
+        scanner.h \
+        scanstats.h \
+        topfiles.h \
+        treemaplayout.h \
+        treemapwidget.h \
+        treewatcher.h \
+        trigramindex.h \
+        workscheduler.h
 
 
 
 FORMS += \
         mainwindow.ui
 
+# Пакетный statx через io_uring есть только в Linux
+linux {
+    SOURCES += uringstat.cpp
+    HEADERS += uringstat.h
+}
+
 # Для работы с большими файлами
 win32 {
     DEFINES += _LARGEFILE_SOURCE _FILE_OFFSET_BITS=64
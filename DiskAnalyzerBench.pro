@@ -0,0 +1,52 @@
+# Замеры производительности на синтетических деревьях: qmake DiskAnalyzerBench.pro
+QT       += core concurrent
+QT       -= gui
+
+TARGET = diskanalyzer-bench
+TEMPLATE = app
+
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        aggregator.cpp \
+        benchmain.cpp \
+        dirreader.cpp \
+        fileitem.cpp \
+        filesmodel.cpp \
+        filesystembackend.cpp \
+        filetree.cpp \
+        inodeset.cpp \
+        memorybackend.cpp \
+        namematcher.cpp \
+        scanfilter.cpp \
+        scanner.cpp \
+        scanstats.cpp \
+        topfiles.cpp \
+        treegenerator.cpp
+
+HEADERS += \
+        aggregator.h \
+        chunkedarray.h \
+        dirreader.h \
+        fileitem.h \
+        filesmodel.h \
+        filesystembackend.h \
+        filetree.h \
+        inodeset.h \
+        memorybackend.h \
+        namematcher.h \
+        scanfilter.h \
+        scanner.h \
+        scanstats.h \
+        topfiles.h \
+        treegenerator.h \
+        workscheduler.h
+
+# Пакетный statx через io_uring есть только в Linux
+linux {
+    SOURCES += uringstat.cpp
+    HEADERS += uringstat.h
+}
@@ -0,0 +1,51 @@
+# Консольная версия без графического интерфейса: qmake DiskAnalyzerCli.pro
+QT       += core concurrent
+QT       -= gui
+
+TARGET = diskanalyzer-cli
+TEMPLATE = app
+
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        aggregator.cpp \
+        climain.cpp \
+        dirreader.cpp \
+        filesystembackend.cpp \
+        filetree.cpp \
+        inodeset.cpp \
+        headlessscan.cpp \
+        namematcher.cpp \
+        scanfilter.cpp \
+        scanner.cpp \
+        scanstats.cpp \
+        topfiles.cpp
+
+HEADERS += \
+        aggregator.h \
+        chunkedarray.h \
+        dirreader.h \
+        filesystembackend.h \
+        filetree.h \
+        inodeset.h \
+        headlessscan.h \
+        namematcher.h \
+        scanfilter.h \
+        scanner.h \
+        scanstats.h \
+        topfiles.h \
+        workscheduler.h
+
+# Пакетный statx через io_uring есть только в Linux
+linux {
+    SOURCES += uringstat.cpp
+    HEADERS += uringstat.h
+}
+
+# Для работы с большими файлами
+win32 {
+    DEFINES += _LARGEFILE_SOURCE _FILE_OFFSET_BITS=64
+}
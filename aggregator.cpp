@@ -0,0 +1,74 @@
+#include "aggregator.h"
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <grp.h>
+#include <pwd.h>
+#include <unistd.h>
+#endif
+
+std::unique_ptr<Aggregator> ExtensionAggregator::clone() const
+{
+    return std::unique_ptr<Aggregator>(new ExtensionAggregator());
+}
+
+ExtensionAggregator::Key ExtensionAggregator::keyOf(const DirEntry &entry) const
+{
+    // Точка в начале имени (скрытый файл) расширение не отделяет
+    const QByteArray &name = entry.name;
+    const int dot = name.lastIndexOf('.');
+    const int length = name.size() - dot - 1;
+    if (dot <= 0 || length == 0 || length > MaxExtensionLength)
+        return Key(0, 0);
+
+    char packed[MaxExtensionLength] = {};
+    for (int i = 0; i < length; ++i) {
+        const char ch = name[dot + 1 + i];
+        packed[i] = ch >= 'A' && ch <= 'Z' ? char(ch - 'A' + 'a') : ch;
+    }
+
+    Key key;
+    memcpy(&key.first, packed, sizeof(key.first));
+    memcpy(&key.second, packed + sizeof(key.first), sizeof(key.second));
+    return key;
+}
+
+QString ExtensionAggregator::label(const Key &key) const
+{
+    char packed[MaxExtensionLength];
+    memcpy(packed, &key.first, sizeof(key.first));
+    memcpy(packed + sizeof(key.first), &key.second, sizeof(key.second));
+
+    const int length = static_cast<int>(strnlen(packed, MaxExtensionLength));
+    if (length == 0)
+        return "(без расширения)";
+    return '.' + QString::fromUtf8(packed, length);
+}
+
+std::unique_ptr<Aggregator> OwnerAggregator::clone() const
+{
+    return std::unique_ptr<Aggregator>(new OwnerAggregator(m_kind));
+}
+
+QString OwnerAggregator::label(const quint32 &key) const
+{
+    if (key == DirEntry::UnknownId)
+        return "(неизвестно)";
+
+#ifdef Q_OS_UNIX
+    // Имена запрашиваются один раз на ключ, уже после слияния
+    char buffer[4096];
+    if (m_kind == User) {
+        struct passwd entry;
+        struct passwd *found = nullptr;
+        if (getpwuid_r(key, &entry, buffer, sizeof(buffer), &found) == 0 && found)
+            return QString::fromLocal8Bit(found->pw_name);
+    } else {
+        struct group entry;
+        struct group *found = nullptr;
+        if (getgrgid_r(key, &entry, buffer, sizeof(buffer), &found) == 0 && found)
+            return QString::fromLocal8Bit(found->gr_name);
+    }
+#endif
+    return QString::number(key);
+}
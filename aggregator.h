@@ -0,0 +1,146 @@
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+
+#include <QString>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <algorithm>
+#include <memory>
+#include "dirreader.h"
+
+// Строка сводки: ключ группировки и итоги по его файлам
+struct AggregateRow
+{
+    QString key;
+    qint64 bytes = 0;
+    qint64 allocated = 0;
+    qint64 files = 0;
+};
+
+// Группировка файлов по произвольному признаку во время сканирования.
+//
+// Сканер получает по одному прототипу на признак и делает из него
+// пустую копию для каждого рабочего потока (clone). Поток добавляет в свою
+// копию файлы без блокировок, а по окончании сканирования копии один раз
+// сливаются в итог (merge). Новый признак - это подкласс KeyedAggregator
+// с функцией ключа и подписью.
+class Aggregator
+{
+public:
+    virtual ~Aggregator() = default;
+
+    virtual QString title() const = 0;
+    // Пустая копия того же типа
+    virtual std::unique_ptr<Aggregator> clone() const = 0;
+    virtual void add(const DirEntry &entry) = 0;
+    // other - копия того же типа
+    virtual void merge(const Aggregator &other) = 0;
+    // Итоги по убыванию размера
+    virtual QVector<AggregateRow> rows() const = 0;
+};
+
+template <typename Key>
+class KeyedAggregator : public Aggregator
+{
+public:
+    void add(const DirEntry &entry) override
+    {
+        // Подряд идущие файлы обычно дают один ключ (тот же владелец, та же
+        // серия файлов), поэтому последний итог запоминается. Указатель
+        // меняется вместе со вставкой, так что перехеширование ему не опасно
+        const Key key = keyOf(entry);
+        if (!m_last || key != m_lastKey) {
+            m_last = &m_totals[key];
+            m_lastKey = key;
+        }
+        m_last->bytes += entry.size;
+        m_last->allocated += entry.allocated;
+        ++m_last->files;
+    }
+
+    void merge(const Aggregator &other) override
+    {
+        const auto &totals = static_cast<const KeyedAggregator &>(other).m_totals;
+        for (auto it = totals.constBegin(); it != totals.constEnd(); ++it) {
+            Total &total = m_totals[it.key()];
+            total.bytes += it->bytes;
+            total.allocated += it->allocated;
+            total.files += it->files;
+        }
+        m_last = nullptr;
+    }
+
+    QVector<AggregateRow> rows() const override
+    {
+        QVector<AggregateRow> result;
+        result.reserve(m_totals.size());
+        for (auto it = m_totals.constBegin(); it != m_totals.constEnd(); ++it)
+            result.append({label(it.key()), it->bytes, it->allocated, it->files});
+        std::sort(result.begin(), result.end(), [](const AggregateRow &a, const AggregateRow &b) {
+            return a.bytes > b.bytes;
+        });
+        return result;
+    }
+
+protected:
+    virtual Key keyOf(const DirEntry &entry) const = 0;
+    virtual QString label(const Key &key) const = 0;
+
+private:
+    struct Total
+    {
+        qint64 bytes = 0;
+        qint64 allocated = 0;
+        qint64 files = 0;
+    };
+
+    QHash<Key, Total> m_totals;
+    Total *m_last = nullptr;
+    Key m_lastKey{};
+};
+
+// Расширение в нижнем регистре, упакованное в 16 байт, чтобы ключ не
+// требовал выделения памяти на каждый файл. Более длинные "расширения" вроде
+// дат в именах резервных копий считаются отсутствием расширения
+class ExtensionAggregator : public KeyedAggregator<QPair<quint64, quint64>>
+{
+public:
+    using Key = QPair<quint64, quint64>;
+
+    QString title() const override { return "Расширения"; }
+    std::unique_ptr<Aggregator> clone() const override;
+
+    static constexpr int MaxExtensionLength = 16;
+
+protected:
+    Key keyOf(const DirEntry &entry) const override;
+    QString label(const Key &key) const override;
+};
+
+// Владелец (uid) или группа (gid) файла
+class OwnerAggregator : public KeyedAggregator<quint32>
+{
+public:
+    enum Kind {
+        User,
+        Group
+    };
+
+    explicit OwnerAggregator(Kind kind) : m_kind(kind) {}
+
+    QString title() const override { return m_kind == User ? "Владельцы" : "Группы"; }
+    std::unique_ptr<Aggregator> clone() const override;
+
+protected:
+    quint32 keyOf(const DirEntry &entry) const override
+    {
+        return m_kind == User ? entry.uid : entry.gid;
+    }
+    QString label(const quint32 &key) const override;
+
+private:
+    Kind m_kind;
+};
+
+#endif // AGGREGATOR_H
@@ -0,0 +1,325 @@
+#include "filesmodel.h"
+#include "memorybackend.h"
+#include "scanner.h"
+#include "treegenerator.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+#include <algorithm>
+#include <cstdio>
+
+// Результат одного прогона сканера по одному дереву
+struct BenchResult
+{
+    qint64 entries = 0;
+    qint64 scanMs = 0;
+    qint64 firstResultMs = -1;  // Когда у корня появились первые дети
+    qint64 peakRssKb = -1;
+    qint64 treeMemory = 0;
+    qint64 topMs = 0;           // Слияние куч самых больших файлов
+    qint64 refreshMs = 0;       // Заполнение и сортировка модели таблицы файлов
+    qint64 allFiles = -1;       // Файлов в таблице со всеми файлами дерева
+    qint64 allFilesMs = -1;     // Ее заполнение и сортировка по размеру и по пути
+    qint64 teardownMs = 0;      // Освобождение дерева
+    qint64 cancelMs = -1;       // Остановка посреди обхода (только для дерева в памяти)
+};
+
+// Дерево в памяти: форма и имитация медленного хранилища
+static const char *const MemoryRoot = "/memory";
+static const char *const MemoryShapeName = "memory";
+
+static void quietMessageHandler(QtMsgType type, const QMessageLogContext &context,
+                                const QString &message)
+{
+    if (type == QtDebugMsg || type == QtInfoMsg)
+        return;
+    std::fprintf(stderr, "%s\n", qFormatLogMessage(type, context, message).toLocal8Bit().constData());
+}
+
+// Пиковый RSS сбрасывается перед каждым прогоном (Linux 4.0+), иначе
+// это пик процесса с момента запуска
+static void resetPeakRss()
+{
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly))
+        clearRefs.write("5");
+}
+
+static qint64 peakRssKb()
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+
+    for (QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()) {
+        if (line.startsWith("VmHWM:"))
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+    return -1;
+}
+
+static BenchResult runScan(const QString &root, std::shared_ptr<FileSystemBackend> backend,
+                           int threads, int topCount, bool aggregate, bool allFiles)
+{
+    BenchResult result;
+    resetPeakRss();
+
+    auto *scanner = new Scanner(root);
+    scanner->setBackend(backend);
+    scanner->setThreadCount(threads);
+    scanner->setLargestFilesCount(topCount);
+    // Те же группировки, что ведет GUI: их цена видна сравнением прогонов
+    if (aggregate) {
+        scanner->addAggregator(std::make_shared<ExtensionAggregator>());
+        scanner->addAggregator(std::make_shared<OwnerAggregator>(OwnerAggregator::User));
+        scanner->addAggregator(std::make_shared<OwnerAggregator>(OwnerAggregator::Group));
+    }
+
+    QEventLoop loop;
+    std::shared_ptr<FileTree> tree;
+    QObject::connect(scanner, &Scanner::progress, &loop, [&result](const ScanProgress &progress) {
+        result.entries = progress.entries;
+    });
+    QObject::connect(scanner, &Scanner::finished, &loop,
+                     [&loop, &tree](std::shared_ptr<FileTree> finished) {
+        tree = std::move(finished);
+        loop.quit();
+    });
+
+    // Снимки прогресса приходят раз в Scanner::ProgressInterval, поэтому
+    // появление первых результатов отслеживается отдельным частым опросом
+    QElapsedTimer timer;
+    QTimer firstResultPoll;
+    firstResultPoll.setInterval(1);
+    QObject::connect(&firstResultPoll, &QTimer::timeout, &loop, [&]() {
+        std::shared_ptr<FileTree> current = scanner->tree();
+        if (current && current->firstChild(current->root()) != FileTree::InvalidNode) {
+            result.firstResultMs = timer.elapsed();
+            firstResultPoll.stop();
+        }
+    });
+
+    timer.start();
+    scanner->start();
+    firstResultPoll.start();
+    loop.exec();
+    result.scanMs = timer.elapsed();
+    firstResultPoll.stop();
+
+    result.peakRssKb = peakRssKb();
+    result.treeMemory = tree->memoryUsage();
+
+    timer.restart();
+    QVector<TopFiles::Entry> largest = scanner->largestFiles();
+    result.topMs = timer.elapsed();
+
+    QVector<quint32> nodes;
+    nodes.reserve(largest.size());
+    for (const TopFiles::Entry &entry : largest)
+        nodes.append(entry.node);
+
+    FilesModel model;
+    timer.restart();
+    model.setFiles(tree, nodes);
+    model.sort(FilesModel::SizeColumn, Qt::DescendingOrder);
+    model.sort(FilesModel::PathColumn, Qt::AscendingOrder);
+    result.refreshMs = timer.elapsed();
+    model.clear();
+
+    // Таблица со всеми файлами: приложение показывает ограниченные списки,
+    // а этот замер проверяет саму модель на дереве любого размера
+    if (allFiles) {
+        nodes.clear();
+        const quint32 count = tree->nodeCount();
+        for (quint32 node = 0; node < count; ++node) {
+            if (!tree->isDirectory(node))
+                nodes.append(node);
+        }
+        result.allFiles = nodes.size();
+
+        timer.restart();
+        model.setFiles(tree, std::move(nodes));
+        model.sort(FilesModel::SizeColumn, Qt::DescendingOrder);
+        model.sort(FilesModel::PathColumn, Qt::AscendingOrder);
+        result.allFilesMs = timer.elapsed();
+        model.clear();
+    }
+
+    // Последняя ссылка на дерево остается здесь
+    delete scanner;
+    timer.restart();
+    tree.reset();
+    result.teardownMs = timer.elapsed();
+
+    return result;
+}
+
+// Сколько ждет stop(): все потоки должны дочитать текущие директории
+static qint64 runCancel(const QString &root, std::shared_ptr<FileSystemBackend> backend,
+                        int threads, int delayMs)
+{
+    Scanner scanner(root);
+    scanner.setBackend(backend);
+    scanner.setThreadCount(threads);
+    scanner.start();
+
+    QEventLoop loop;
+    QTimer::singleShot(delayMs, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    QElapsedTimer timer;
+    timer.start();
+    scanner.stop();
+    return timer.elapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("diskanalyzer-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Замеры сканирования на синтетических деревьях.\n"
+        "Деревья генерируются один раз и переиспользуются между запусками;\n"
+        "результаты выводятся JSON-строками, по одной на прогон.");
+    parser.addHelpOption();
+
+    QCommandLineOption dirOption("dir", "Каталог для деревьев (по умолчанию в /dev/shm).", "dir",
+                                 TreeGenerator::defaultBaseDir());
+    QCommandLineOption shapesOption("shapes", "Формы через запятую: wide,deep,tiny,sparse,memory.",
+                                    "list", "wide,deep,tiny,sparse");
+    QCommandLineOption scaleOption("scale", "Множитель числа файлов в директории.", "k", "1");
+    QCommandLineOption repeatOption("repeat", "Прогонов на каждую форму.", "n", "3");
+    QCommandLineOption threadsOption({"j", "threads"},
+        "Число потоков сканера; список через запятую - замер масштабирования.", "list", "0");
+    QCommandLineOption latencyOption("memory-latency",
+        "Задержка чтения директории в памяти и ее разброс, мкс.", "us[,jitter]", "0");
+    QCommandLineOption stragglersOption("memory-stragglers",
+        "Доля медленных директорий в памяти и их задержка, мкс.", "fraction,us", "0,0");
+    QCommandLineOption errorsOption("memory-errors",
+        "Доля директорий в памяти, чтение которых завершается ошибкой.", "fraction", "0");
+    QCommandLineOption topOption("top", "Размер списка самых больших файлов.", "n", "1000");
+    QCommandLineOption aggregateOption("aggregate", "Группировать по расширению, владельцу и группе.");
+    QCommandLineOption allFilesOption("all-files",
+        "Замерить таблицу со всеми файлами дерева, а не только с самыми большими.");
+    QCommandLineOption labelOption("label", "Метка запуска, например хеш коммита.", "text");
+    QCommandLineOption outputOption({"o", "output"}, "Дописывать результаты в файл.", "file");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Отладочный вывод в stderr.");
+    parser.addOptions({dirOption, shapesOption, scaleOption, repeatOption, threadsOption,
+                       latencyOption, stragglersOption, errorsOption, topOption, aggregateOption,
+                       allFilesOption, labelOption, outputOption, verboseOption});
+    parser.process(app);
+
+    if (!parser.isSet(verboseOption)) {
+        qInstallMessageHandler(quietMessageHandler);
+    }
+
+    const double scale = parser.value(scaleOption).toDouble();
+    const int repeat = qMax(1, parser.value(repeatOption).toInt());
+    QVector<int> threadCounts;
+    for (const QString &count : parser.value(threadsOption).split(','))
+        threadCounts.append(qMax(0, count.toInt()));
+    const int topCount = parser.value(topOption).toInt();
+    const QStringList selected = parser.value(shapesOption).split(',');
+
+    QFile output;
+    if (parser.isSet(outputOption)) {
+        output.setFileName(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            std::fprintf(stderr, "%s\n", output.errorString().toLocal8Bit().constData());
+            return 1;
+        }
+    } else {
+        output.open(stdout, QIODevice::WriteOnly);
+    }
+
+    // Дерево в памяти той же величины, что и tiny: около миллиона записей
+    QVector<TreeShape> shapes = TreeGenerator::defaultShapes(scale > 0 ? scale : 1.0);
+    auto tiny = std::find_if(shapes.cbegin(), shapes.cend(),
+                             [](const TreeShape &shape) { return shape.name == "tiny"; });
+    if (tiny != shapes.cend()) {
+        TreeShape memory = *tiny;
+        memory.name = MemoryShapeName;
+        shapes.append(memory);
+    }
+
+    for (const TreeShape &shape : shapes) {
+        if (!selected.contains(shape.name))
+            continue;
+
+        QString root;
+        std::shared_ptr<FileSystemBackend> backend;
+        QString signature = shape.signature();
+        if (shape.name == MemoryShapeName) {
+            MemoryBackend::Shape memoryShape;
+            memoryShape.fanout = shape.fanout;
+            memoryShape.depth = shape.depth;
+            memoryShape.filesPerDir = shape.filesPerDir;
+            memoryShape.maxFileSize = shape.maxSize;
+
+            const QStringList latency = parser.value(latencyOption).split(',');
+            const QStringList stragglers = parser.value(stragglersOption).split(',');
+            auto memory = std::make_shared<MemoryBackend>(MemoryRoot, memoryShape);
+            memory->setLatency(latency.value(0).toInt(), latency.value(1).toInt());
+            memory->setStragglers(stragglers.value(0).toDouble(), stragglers.value(1).toInt());
+            memory->setErrorRate(parser.value(errorsOption).toDouble());
+
+            root = MemoryRoot;
+            backend = memory;
+            signature += QString(" latency=%1 stragglers=%2 errors=%3")
+                             .arg(parser.value(latencyOption), parser.value(stragglersOption),
+                                  parser.value(errorsOption));
+        } else {
+            QString errorString;
+            root = TreeGenerator::generate(parser.value(dirOption), shape, &errorString);
+            if (root.isEmpty()) {
+                std::fprintf(stderr, "%s: %s\n", qPrintable(shape.name), qPrintable(errorString));
+                return 1;
+            }
+            backend = std::make_shared<LocalBackend>();
+        }
+
+        for (int threads : threadCounts) {
+            for (int run = 0; run < repeat; ++run) {
+                BenchResult result = runScan(root, backend, threads, topCount,
+                                             parser.isSet(aggregateOption),
+                                             parser.isSet(allFilesOption));
+                // Остановка на середине обхода той же длины
+                if (shape.name == MemoryShapeName) {
+                    const int delay = static_cast<int>(qMax<qint64>(1, result.scanMs / 2));
+                    result.cancelMs = runCancel(root, backend, threads, delay);
+                }
+
+                QJsonObject record;
+                record.insert("label", parser.value(labelOption));
+                record.insert("shape", signature);
+                record.insert("run", run);
+                record.insert("threads", threads);
+                record.insert("aggregate", parser.isSet(aggregateOption));
+                record.insert("entries", result.entries);
+                record.insert("scanMs", result.scanMs);
+                record.insert("entriesPerSecond",
+                              result.scanMs > 0 ? result.entries * 1000.0 / result.scanMs : 0.0);
+                record.insert("firstResultMs", result.firstResultMs);
+                record.insert("peakRssKb", result.peakRssKb);
+                record.insert("treeMemory", result.treeMemory);
+                record.insert("topMs", result.topMs);
+                record.insert("refreshMs", result.refreshMs);
+                record.insert("allFiles", result.allFiles);
+                record.insert("allFilesMs", result.allFilesMs);
+                record.insert("teardownMs", result.teardownMs);
+                record.insert("cancelMs", result.cancelMs);
+                output.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+                output.flush();
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef CHUNKEDARRAY_H
+#define CHUNKEDARRAY_H
+
+#include <QtGlobal>
+#include <atomic>
+
+// Массив из блоков фиксированного размера с неизменными адресами элементов.
+// Таблица указателей на блоки выделена заранее, поэтому рост массива не
+// перемещает уже записанные данные, и читатели могут обращаться к ним
+// одновременно с добавлением новых блоков. Блоки создаются лениво; гонка
+// двух потоков за один блок решается через compare_exchange.
+//
+// Массив может также ссылаться на чужую память (например, отображенный
+// файл снимка): блоки тогда указывают внутрь нее и не освобождаются.
+template <typename T, int ChunkBits = 16, int MaxChunks = (1 << 14)>
+class ChunkedArray
+{
+public:
+    static constexpr quint64 ChunkSize = quint64(1) << ChunkBits;
+    static constexpr quint64 ChunkMask = ChunkSize - 1;
+    static constexpr quint64 Capacity = ChunkSize * MaxChunks;
+
+    ChunkedArray()
+        : m_external(false)
+    {
+        for (auto &chunk : m_chunks)
+            chunk.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~ChunkedArray()
+    {
+        clear();
+    }
+
+    ChunkedArray(const ChunkedArray &) = delete;
+    ChunkedArray &operator=(const ChunkedArray &) = delete;
+
+    // Гарантирует, что элементы [begin, end) существуют. Возвращает false,
+    // если end превышает емкость
+    bool ensure(quint64 begin, quint64 end)
+    {
+        if (end > Capacity)
+            return false;
+        if (end <= begin)
+            return true;
+
+        const quint64 lastChunk = (end - 1) >> ChunkBits;
+        for (quint64 i = begin >> ChunkBits; i <= lastChunk; ++i) {
+            if (m_chunks[i].load(std::memory_order_acquire))
+                continue;
+
+            T *fresh = new T[ChunkSize]();
+            T *expected = nullptr;
+            if (!m_chunks[i].compare_exchange_strong(expected, fresh,
+                                                     std::memory_order_acq_rel))
+                delete[] fresh; // Блок уже создал другой поток
+        }
+        return true;
+    }
+
+    // Создан ли блок с номером chunk
+    bool hasChunk(quint64 chunk) const
+    {
+        return chunk < MaxChunks && m_chunks[chunk].load(std::memory_order_acquire) != nullptr;
+    }
+
+    T &operator[](quint64 index)
+    {
+        return m_chunks[index >> ChunkBits].load(std::memory_order_acquire)[index & ChunkMask];
+    }
+
+    const T &operator[](quint64 index) const
+    {
+        return m_chunks[index >> ChunkBits].load(std::memory_order_acquire)[index & ChunkMask];
+    }
+
+    // Ссылается на count элементов, лежащих подряд по адресу data. Память
+    // остается за вызывающим, ensure() для такого массива вызывать нельзя
+    bool adopt(T *data, quint64 count)
+    {
+        if (count > Capacity)
+            return false;
+
+        clear();
+        m_external = true;
+        for (quint64 i = 0; i * ChunkSize < count; ++i)
+            m_chunks[i].store(data + i * ChunkSize, std::memory_order_release);
+        return true;
+    }
+
+    void clear()
+    {
+        for (auto &chunk : m_chunks) {
+            T *data = chunk.exchange(nullptr);
+            if (!m_external)
+                delete[] data;
+        }
+        m_external = false;
+    }
+
+private:
+    std::atomic<T *> m_chunks[MaxChunks];
+    bool m_external;
+};
+
+#endif // CHUNKEDARRAY_H
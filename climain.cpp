@@ -0,0 +1,120 @@
+#include "headlessscan.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <cstdio>
+
+// Без --verbose отладочный вывод сканера не смешивается с результатами
+static void quietMessageHandler(QtMsgType type, const QMessageLogContext &context,
+                                const QString &message)
+{
+    if (type == QtDebugMsg || type == QtInfoMsg)
+        return;
+    std::fprintf(stderr, "%s\n", qFormatLogMessage(type, context, message).toLocal8Bit().constData());
+}
+
+static bool parseCount(const QString &text, int minimum, int *value)
+{
+    bool ok = false;
+    *value = text.toInt(&ok);
+    return ok && *value >= minimum;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("diskanalyzer-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Анализ занятого места без графического интерфейса.\n"
+        "Итоги директорий выводятся по мере готовности их поддеревьев.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("path", "Директория для сканирования");
+
+    QCommandLineOption threadsOption({"j", "threads"},
+        "Число потоков (по умолчанию - по числу ядер).", "n", "0");
+    QCommandLineOption depthOption({"d", "max-depth"},
+        "Выводить директории не глубже n; более глубокие учитываются в итогах предка.", "n", "-1");
+    QCommandLineOption topOption({"n", "top"},
+        "Вывести n самых больших файлов в конце.", "n", "0");
+    QCommandLineOption formatOption({"f", "format"},
+        "Формат вывода: jsonl или csv.", "format", "jsonl");
+    QCommandLineOption filesOption("files", "Выводить каждый файл.");
+    QCommandLineOption uringOption("io-uring", "Пакетный statx через io_uring (Linux 5.6+).");
+    QCommandLineOption snapshotOption("snapshot", "Сохранить снимок дерева в файл.", "file");
+    QCommandLineOption statsOption("stats", "Сохранить статистику сканирования в JSON-файл.", "file");
+    QCommandLineOption groupByOption("group-by",
+        "Итоги по расширениям (ext), владельцам (owner) и группам (group), через запятую.", "list");
+    QCommandLineOption excludeOption({"e", "exclude"},
+        "Не спускаться в директории с таким именем или шаблоном (с '/' - по полному пути). "
+        "Можно повторять или перечислять через запятую.", "pattern");
+    QCommandLineOption oneFileSystemOption({"x", "one-file-system"},
+        "Не переходить в другие файловые системы и точки монтирования.");
+    QCommandLineOption skipPseudoOption("skip-pseudo-fs",
+        "Пропускать псевдо-файловые системы ядра (proc, sysfs, devtmpfs, tmpfs и т.п.).");
+    QCommandLineOption skipTypesOption("skip-fs-types",
+        "Пропускать файловые системы этих типов, через запятую (например, nfs,cifs).", "list");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Отладочный вывод в stderr.");
+    parser.addOptions({threadsOption, depthOption, topOption, formatOption, filesOption,
+                       uringOption, snapshotOption, statsOption, groupByOption, excludeOption,
+                       oneFileSystemOption, skipPseudoOption, skipTypesOption, verboseOption});
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+
+    HeadlessScan::Options options;
+    options.rootPath = positional.first();
+    options.listFiles = parser.isSet(filesOption);
+    options.useIoUring = parser.isSet(uringOption);
+    options.snapshotFile = parser.value(snapshotOption);
+    options.statsFile = parser.value(statsOption);
+    options.exclude = parser.values(excludeOption);
+    options.oneFileSystem = parser.isSet(oneFileSystemOption);
+    if (parser.isSet(skipPseudoOption)) {
+        options.skipTypes = ScanFilter::pseudoFileSystemTypes();
+    }
+    options.skipTypes += parser.value(skipTypesOption).split(',');
+    options.skipTypes.removeAll(QString());
+
+    if (!parseCount(parser.value(threadsOption), 0, &options.threads)
+        || !parseCount(parser.value(depthOption), -1, &options.maxDepth)
+        || !parseCount(parser.value(topOption), 0, &options.largestFiles)
+        || options.largestFiles > TopFiles::MaxCapacity) {
+        std::fprintf(stderr, "Неверное числовое значение параметра\n");
+        return 1;
+    }
+
+    if (parser.isSet(groupByOption)) {
+        options.groupBy = parser.value(groupByOption).split(',');
+        options.groupBy.removeAll(QString());
+        for (const QString &grouping : options.groupBy) {
+            if (!HeadlessScan::groupings().contains(grouping)) {
+                std::fprintf(stderr, "Неизвестная группировка: %s\n", grouping.toLocal8Bit().constData());
+                return 1;
+            }
+        }
+    }
+
+    const QString format = parser.value(formatOption);
+    if (format == "csv") {
+        options.format = HeadlessScan::Csv;
+    } else if (format != "jsonl" && format != "json") {
+        std::fprintf(stderr, "Неизвестный формат: %s\n", format.toLocal8Bit().constData());
+        return 1;
+    }
+
+    if (!parser.isSet(verboseOption)) {
+        qInstallMessageHandler(quietMessageHandler);
+    }
+
+    HeadlessScan scan(options);
+    QObject::connect(&scan, &HeadlessScan::done, &app, &QCoreApplication::exit,
+                     Qt::QueuedConnection);
+    QTimer::singleShot(0, &scan, &HeadlessScan::start);
+
+    return app.exec();
+}
@@ -0,0 +1,443 @@
+#include "dirreader.h"
+#include "scanstats.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "uringstat.h"
+
+namespace {
+
+// Формат записи getdents64 (в старых glibc нет обертки для этого вызова)
+struct LinuxDirent64
+{
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+// Большой буфер позволяет прочитать типичную директорию за один вызов
+constexpr int DentsBufferSize = 256 * 1024;
+
+char *dentsBuffer()
+{
+    // Буфер свой у каждого потока пула, выделяется один раз
+    thread_local std::unique_ptr<char[]> buffer(new char[DentsBufferSize]);
+    return buffer.get();
+}
+
+DirEntry::Type typeFromDType(unsigned char type)
+{
+    switch (type) {
+    case DT_REG: return DirEntry::File;
+    case DT_DIR: return DirEntry::Directory;
+    case DT_LNK: return DirEntry::Symlink;
+    case DT_UNKNOWN: return DirEntry::Unknown;
+    default: return DirEntry::Other;
+    }
+}
+
+DirEntry::Type typeFromMode(mode_t mode)
+{
+    if (S_ISREG(mode)) return DirEntry::File;
+    if (S_ISDIR(mode)) return DirEntry::Directory;
+    if (S_ISLNK(mode)) return DirEntry::Symlink;
+    return DirEntry::Other;
+}
+
+void fillFromStat(DirEntry &entry, const struct stat &st)
+{
+    entry.type = typeFromMode(st.st_mode);
+    entry.size = st.st_size;
+    entry.allocated = static_cast<qint64>(st.st_blocks) * 512;
+    entry.mtime = st.st_mtim.tv_sec;
+    entry.atime = st.st_atim.tv_sec;
+    entry.ctime = st.st_ctim.tv_sec;
+    entry.inode = st.st_ino;
+    entry.device = st.st_dev;
+    entry.links = static_cast<quint32>(st.st_nlink);
+    entry.uid = st.st_uid;
+    entry.gid = st.st_gid;
+    entry.hasStat = true;
+}
+
+void fillFromStatx(DirEntry &entry, const struct statx &stx)
+{
+    // Поля заполняются так же, как из struct stat, чтобы результаты
+    // обоих путей совпадали
+    entry.type = typeFromMode(stx.stx_mode);
+    entry.size = static_cast<qint64>(stx.stx_size);
+    entry.allocated = static_cast<qint64>(stx.stx_blocks) * 512;
+    entry.mtime = stx.stx_mtime.tv_sec;
+    entry.atime = stx.stx_atime.tv_sec;
+    entry.ctime = stx.stx_ctime.tv_sec;
+    entry.inode = stx.stx_ino;
+    entry.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    entry.links = stx.stx_nlink;
+    entry.uid = stx.stx_uid;
+    entry.gid = stx.stx_gid;
+    entry.hasStat = true;
+}
+
+UringStat *threadRing()
+{
+    // Кольцо свое у каждого потока пула, создается при первом использовании
+    thread_local std::unique_ptr<UringStat> ring;
+    if (!ring)
+        ring.reset(new UringStat());
+    return ring->isValid() ? ring.get() : nullptr;
+}
+
+enum StatStatus : char { StatPending, StatDone, StatGone };
+
+} // namespace
+#endif
+
+std::atomic<int> DirHandle::s_openCount(0);
+
+DirHandle::~DirHandle()
+{
+#ifdef Q_OS_LINUX
+    ::close(m_fd);
+#endif
+    s_openCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::shared_ptr<DirHandle> DirHandle::adopt(int fd)
+{
+    if (s_openCount.fetch_add(1, std::memory_order_relaxed) >= MaxOpen) {
+        s_openCount.fetch_sub(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return std::shared_ptr<DirHandle>(new DirHandle(fd));
+}
+
+DirReader::DirReader()
+{
+}
+
+DirReader::~DirReader()
+{
+}
+
+bool DirReader::read(const DirLocation &location, QVector<DirEntry> &entries,
+                     Options options, DirEntry *self, std::shared_ptr<DirHandle> *handle)
+{
+    m_errorString.clear();
+    if (handle)
+        handle->reset();
+
+#ifdef Q_OS_LINUX
+    return readNative(location, entries, options, self, handle);
+#else
+    return readQt(location.path, entries, options, self);
+#endif
+}
+
+bool DirReader::restat(const DirLocation &location, QVector<DirEntry> &entries,
+                       Options options, DirEntry *self, std::shared_ptr<DirHandle> *handle)
+{
+    m_errorString.clear();
+    if (handle)
+        handle->reset();
+
+#ifdef Q_OS_LINUX
+    return restatNative(location, entries, options, self, handle);
+#else
+    return restatQt(location.path, entries, options, self);
+#endif
+}
+
+QString DirReader::decodeName(const QByteArray &name)
+{
+    return QFile::decodeName(name);
+}
+
+#ifdef Q_OS_LINUX
+int DirReader::openDirectory(const DirLocation &location, DirEntry *self)
+{
+    // Внутри открытого родителя директория ищется по одному имени. Если ее
+    // за время обхода подменили символической ссылкой, O_NOFOLLOW не даст
+    // уйти по ней. Корень открывается по пути как есть, ссылкой он быть может
+    int fd;
+    if (location.parent) {
+        fd = ::openat(location.parent->fd(), location.name.constData(),
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    } else {
+        fd = ::openat(AT_FDCWD, QFile::encodeName(location.path).constData(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        m_errorString = QString::fromLocal8Bit(strerror(errno));
+        return fd;
+    }
+
+    if (self) {
+        struct stat st;
+        if (::fstat(fd, &st) == 0)
+            fillFromStat(*self, st);
+    }
+    return fd;
+}
+
+void DirReader::releaseDirectory(int fd, std::shared_ptr<DirHandle> *handle)
+{
+    if (handle) {
+        *handle = DirHandle::adopt(fd);
+        if (*handle)
+            return;
+    }
+    ::close(fd);
+}
+
+bool DirReader::readNative(const DirLocation &location, QVector<DirEntry> &entries,
+                           Options options, DirEntry *self, std::shared_ptr<DirHandle> *handle)
+{
+    const int fd = openDirectory(location, self);
+    if (fd < 0)
+        return false;
+
+    char *buffer = dentsBuffer();
+    bool ok = true;
+    QVector<int> pending; // Записи, которым нужен stat
+
+    for (;;) {
+        const long bytes = ::syscall(SYS_getdents64, fd, buffer, DentsBufferSize);
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOSYS) {
+                // Системный вызов недоступен (например, в песочнице) - читаем через Qt
+                ::close(fd);
+                entries.clear();
+                return readQt(location.path, entries, options, self);
+            }
+            m_errorString = QString::fromLocal8Bit(strerror(errno));
+            ok = false;
+            break;
+        }
+        if (bytes == 0)
+            break;
+
+        for (long offset = 0; offset < bytes;) {
+            const auto *dirent = reinterpret_cast<const LinuxDirent64 *>(buffer + offset);
+            const char *name = dirent->d_name;
+            offset += dirent->d_reclen;
+
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            DirEntry entry;
+            entry.name = QByteArray(name);
+            entry.type = typeFromDType(dirent->d_type);
+            entry.inode = dirent->d_ino;
+
+            // d_type позволяет не вызывать stat там, где атрибуты не нужны.
+            // Если файловая система тип не сообщает, stat нужен всегда
+            const bool needStat = entry.type == DirEntry::Unknown
+                || (entry.type == DirEntry::File && (options & StatFiles))
+                || (entry.type == DirEntry::Directory && (options & StatDirectories));
+
+            if (needStat)
+                pending.append(entries.size());
+            entries.append(std::move(entry));
+        }
+    }
+
+    if (ok && !pending.isEmpty())
+        statPending(fd, entries, pending, options);
+
+    if (ok) {
+        releaseDirectory(fd, handle);
+    } else {
+        ::close(fd);
+    }
+
+    if (ok && (options & Sorted)) {
+        std::sort(entries.begin(), entries.end(),
+                  [](const DirEntry &a, const DirEntry &b) { return a.name < b.name; });
+    }
+
+    return ok;
+}
+
+void DirReader::statPending(int fd, QVector<DirEntry> &entries, const QVector<int> &pending,
+                            Options options)
+{
+    ScanStopwatch stopwatch(options.testFlag(MeasureStat));
+    std::vector<char> status(pending.size(), StatPending);
+
+    UringStat *ring = (options & BatchedStat) && UringStat::isSupported() ? threadRing() : nullptr;
+    if (ring) {
+        ring->statBatch(fd, pending.size(),
+            [&](int i) { return entries[pending[i]].name.constData(); },
+            [&](int i, const struct statx *result, int error) {
+                if (result) {
+                    fillFromStatx(entries[pending[i]], *result);
+                    status[i] = StatDone;
+                } else {
+                    status[i] = error == ENOENT ? StatGone : StatDone;
+                }
+            });
+    }
+
+    // Все, что не выполнило кольцо (или если оно выключено), досчитываем fstatat
+    for (int i = 0; i < pending.size(); ++i) {
+        if (status[i] != StatPending)
+            continue;
+        DirEntry &entry = entries[pending[i]];
+        struct stat st;
+        if (::fstatat(fd, entry.name.constData(), &st, AT_SYMLINK_NOFOLLOW) == 0) {
+            fillFromStat(entry, st);
+            status[i] = StatDone;
+        } else {
+            status[i] = errno == ENOENT ? StatGone : StatDone;
+        }
+    }
+
+    // Удаленные между getdents64 и stat записи убираем (это редкость)
+    for (int i = pending.size() - 1; i >= 0; --i) {
+        if (status[i] == StatGone)
+            entries.remove(pending[i]);
+    }
+
+    if (stopwatch.isEnabled())
+        threadStatTime() += stopwatch.lap();
+}
+
+bool DirReader::restatNative(const DirLocation &location, QVector<DirEntry> &entries,
+                             Options options, DirEntry *self, std::shared_ptr<DirHandle> *handle)
+{
+    const int fd = openDirectory(location, self);
+    if (fd < 0)
+        return false;
+
+    // Тот же путь stat, что и при чтении, только без getdents64
+    QVector<int> pending;
+    for (int i = 0; i < entries.size(); ++i) {
+        const DirEntry::Type type = entries[i].type;
+        if (type == DirEntry::Unknown
+            || (type == DirEntry::File && (options & StatFiles))
+            || (type == DirEntry::Directory && (options & StatDirectories))) {
+            pending.append(i);
+        }
+    }
+
+    if (!pending.isEmpty())
+        statPending(fd, entries, pending, options);
+
+    releaseDirectory(fd, handle);
+    return true;
+}
+#endif
+
+bool DirReader::readQt(const QString &path, QVector<DirEntry> &entries,
+                       Options options, DirEntry *self)
+{
+    QDir dir(path);
+    if (!dir.exists()) {
+        m_errorString = "Директория не существует";
+        return false;
+    }
+
+    if (self) {
+        QFileInfo info(path);
+        self->type = DirEntry::Directory;
+        self->mtime = info.lastModified().toSecsSinceEpoch();
+        self->ctime = info.metadataChangeTime().toSecsSinceEpoch();
+        self->hasStat = true;
+    }
+
+    const QFileInfoList infos = dir.entryInfoList(
+        QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+        (options & Sorted) ? QDir::SortFlags(QDir::Name) : QDir::SortFlags(QDir::NoSort)
+    );
+
+    entries.reserve(entries.size() + infos.size());
+    for (const QFileInfo &info : infos) {
+        DirEntry entry;
+        entry.name = QFile::encodeName(info.fileName());
+
+        if (info.isSymLink())
+            entry.type = DirEntry::Symlink;
+        else if (info.isDir())
+            entry.type = DirEntry::Directory;
+        else if (info.isFile())
+            entry.type = DirEntry::File;
+        else
+            entry.type = DirEntry::Other;
+
+        if ((entry.type == DirEntry::File && (options & StatFiles))
+            || (entry.type == DirEntry::Directory && (options & StatDirectories))) {
+            entry.size = info.size();
+            entry.allocated = entry.size;
+            entry.mtime = info.lastModified().toSecsSinceEpoch();
+            entry.atime = info.lastRead().toSecsSinceEpoch();
+            entry.ctime = info.metadataChangeTime().toSecsSinceEpoch();
+            entry.uid = info.ownerId();
+            entry.gid = info.groupId();
+            entry.hasStat = true;
+        }
+
+        entries.append(std::move(entry));
+    }
+
+    return true;
+}
+
+bool DirReader::restatQt(const QString &path, QVector<DirEntry> &entries,
+                         Options options, DirEntry *self)
+{
+    QDir dir(path);
+    if (!dir.exists()) {
+        m_errorString = "Директория не существует";
+        return false;
+    }
+
+    if (self) {
+        QFileInfo info(path);
+        self->type = DirEntry::Directory;
+        self->mtime = info.lastModified().toSecsSinceEpoch();
+        self->ctime = info.metadataChangeTime().toSecsSinceEpoch();
+        self->hasStat = true;
+    }
+
+    for (int i = entries.size() - 1; i >= 0; --i) {
+        DirEntry &entry = entries[i];
+        if (!((entry.type == DirEntry::File && (options & StatFiles))
+              || (entry.type == DirEntry::Directory && (options & StatDirectories))))
+            continue;
+
+        QFileInfo info(dir.filePath(decodeName(entry.name)));
+        if (!info.exists() && !info.isSymLink()) {
+            entries.remove(i);
+            continue;
+        }
+
+        entry.size = info.isFile() ? info.size() : 0;
+        entry.allocated = entry.size;
+        entry.mtime = info.lastModified().toSecsSinceEpoch();
+        entry.atime = info.lastRead().toSecsSinceEpoch();
+        entry.ctime = info.metadataChangeTime().toSecsSinceEpoch();
+        entry.uid = info.ownerId();
+        entry.gid = info.groupId();
+        entry.hasStat = true;
+    }
+
+    return true;
+}
@@ -0,0 +1,136 @@
+#ifndef DIRREADER_H
+#define DIRREADER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+// Запись каталога в том виде, в каком ее отдает обход
+struct DirEntry
+{
+    enum Type : quint8 { Unknown, File, Directory, Symlink, Other };
+
+    QByteArray name;       // Имя в кодировке файловой системы
+    Type type = Unknown;
+    qint64 size = 0;       // Заполняется только если запись была stat-нута
+    qint64 allocated = 0;  // Занято на диске (st_blocks * 512); без данных - как size
+    qint64 mtime = 0;      // Секунды с начала эпохи
+    qint64 atime = 0;      // Время последнего чтения, секунды
+    qint64 ctime = 0;      // Время изменения метаданных, секунды
+    quint64 inode = 0;     // 0, если платформа номер не сообщает
+    quint64 device = 0;
+    quint32 links = 1;     // Число жестких ссылок
+    quint32 uid = UnknownId;
+    quint32 gid = UnknownId;
+    bool hasStat = false;
+
+    static constexpr quint32 UnknownId = 0xFFFFFFFFu;  // Владелец не известен
+};
+
+// Открытая директория. Поддиректории открываются через openat относительно
+// нее: путь не разбирается заново от корня, а переименование предка во время
+// обхода не уводит чтение в другое место. Дескриптор закрывается вместе с
+// последней ссылкой
+class DirHandle
+{
+public:
+    ~DirHandle();
+
+    DirHandle(const DirHandle &) = delete;
+    DirHandle &operator=(const DirHandle &) = delete;
+
+    int fd() const { return m_fd; }
+
+    // Забирает fd, если открыто меньше MaxOpen дескрипторов, иначе nullptr
+    // и fd остается у вызывающего
+    static std::shared_ptr<DirHandle> adopt(int fd);
+
+    // Сколько директорий держится открытыми ради их детей (стандартный
+    // предел RLIMIT_NOFILE - 1024); сверх этого дети открываются по пути
+    static constexpr int MaxOpen = 512;
+
+private:
+    explicit DirHandle(int fd) : m_fd(fd) {}
+
+    int m_fd;
+    static std::atomic<int> s_openCount;
+};
+
+// Где искать директорию: полный путь нужен всегда (сообщения, запасной
+// путь через Qt), parent и name - если родитель еще открыт
+struct DirLocation
+{
+    QString path;
+    std::shared_ptr<DirHandle> parent;
+    QByteArray name;       // Имя внутри parent
+};
+
+// Чтение содержимого одной директории.
+// На Linux используется openat/getdents64/fstatat относительно дескриптора
+// директории, на остальных платформах (и если системный вызов недоступен) -
+// QDir::entryInfoList.
+class DirReader
+{
+public:
+    enum Option {
+        NoOptions       = 0x0,
+        StatFiles       = 0x1,  // Нужны размер и время изменения файлов
+        StatDirectories = 0x2,  // Нужны атрибуты поддиректорий
+        Sorted          = 0x4,  // Упорядочить записи по имени
+        BatchedStat     = 0x8,  // statx пачкой через io_uring, если ядро умеет
+        MeasureStat     = 0x10  // Копить время stat в threadStatTime()
+    };
+    Q_DECLARE_FLAGS(Options, Option)
+
+    DirReader();
+    ~DirReader();
+
+    // Читает директорию path. В self (если задан) возвращаются атрибуты самой
+    // директории - они берутся с уже открытого дескриптора, без лишнего stat.
+    // Если задан handle, в нем остается открытая директория для чтения ее
+    // детей (nullptr - дескрипторов открыто слишком много)
+    bool read(const DirLocation &location, QVector<DirEntry> &entries,
+              Options options, DirEntry *self = nullptr,
+              std::shared_ptr<DirHandle> *handle = nullptr);
+    bool read(const QString &path, QVector<DirEntry> &entries,
+              Options options, DirEntry *self = nullptr)
+    {
+        return read(DirLocation{path, nullptr, QByteArray()}, entries, options, self);
+    }
+
+    // Обновляет атрибуты уже известных записей директории path без ее чтения:
+    // в entries заранее заданы имена и типы. Какие записи stat-нуть, задают
+    // StatFiles и StatDirectories; исчезнувшие записи удаляются
+    bool restat(const DirLocation &location, QVector<DirEntry> &entries,
+                Options options, DirEntry *self = nullptr,
+                std::shared_ptr<DirHandle> *handle = nullptr);
+
+    QString errorString() const { return m_errorString; }
+
+    static QString decodeName(const QByteArray &name);
+
+private:
+#ifdef Q_OS_LINUX
+    bool readNative(const DirLocation &location, QVector<DirEntry> &entries,
+                    Options options, DirEntry *self, std::shared_ptr<DirHandle> *handle);
+    bool restatNative(const DirLocation &location, QVector<DirEntry> &entries,
+                      Options options, DirEntry *self, std::shared_ptr<DirHandle> *handle);
+    void statPending(int fd, QVector<DirEntry> &entries, const QVector<int> &pending,
+                     Options options);
+    int openDirectory(const DirLocation &location, DirEntry *self);
+    // Оставляет fd в handle, если его просили и лимит позволяет, иначе закрывает
+    static void releaseDirectory(int fd, std::shared_ptr<DirHandle> *handle);
+#endif
+    bool restatQt(const QString &path, QVector<DirEntry> &entries,
+                  Options options, DirEntry *self);
+    bool readQt(const QString &path, QVector<DirEntry> &entries,
+                Options options, DirEntry *self);
+
+    QString m_errorString;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(DirReader::Options)
+
+#endif // DIRREADER_H
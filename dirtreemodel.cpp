@@ -0,0 +1,360 @@
+#include "dirtreemodel.h"
+#include "filesmodel.h"
+#include <QColor>
+#include <QSet>
+#include <algorithm>
+
+DirTreeModel::DirTreeModel(QObject *parent)
+    : QAbstractItemModel(parent)
+{
+}
+
+void DirTreeModel::setTree(std::shared_ptr<FileTree> tree)
+{
+    beginResetModel();
+    m_tree = std::move(tree);
+    m_listings.clear();
+    m_directoryRows.clear();
+    endResetModel();
+}
+
+void DirTreeModel::clear()
+{
+    setTree(nullptr);
+}
+
+void DirTreeModel::refresh(const QVector<quint32> &directories)
+{
+    if (!m_tree)
+        return;
+
+    // Директории со строками, итоги которых изменились: сами измененные и
+    // все их предки
+    QSet<quint32> touched;
+    for (quint32 directory : directories) {
+        if (m_tree->isRemoved(directory))
+            continue;
+        if (m_listings.contains(directory))
+            updateListing(directory);
+        for (quint32 node = directory; node != FileTree::InvalidNode && !touched.contains(node);
+             node = m_tree->parent(node)) {
+            touched.insert(node);
+        }
+    }
+
+    // Строки удаленных поддеревьев ушли вместе с их корнем
+    for (auto it = m_listings.begin(); it != m_listings.end();) {
+        if (m_tree->isRemoved(it.key()))
+            it = m_listings.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = m_directoryRows.begin(); it != m_directoryRows.end();) {
+        if (m_tree->isRemoved(it.key()))
+            it = m_directoryRows.erase(it);
+        else
+            ++it;
+    }
+
+    if (touched.isEmpty())
+        return;
+    emit dataChanged(index(0, 0), index(0, ColumnCount - 1));
+    for (quint32 node : touched) {
+        auto listing = m_listings.constFind(node);
+        if (listing == m_listings.constEnd() || listing->fetched == 0)
+            continue;
+        const QModelIndex parent = indexOf(node);
+        emit dataChanged(index(0, 0, parent), index(listing->fetched - 1, ColumnCount - 1, parent));
+    }
+}
+
+void DirTreeModel::updateListing(quint32 node)
+{
+    Listing &listing = m_listings[node];
+    const QModelIndex parent = indexOf(node);
+
+    QSet<quint32> added;
+    for (quint32 child = m_tree->firstChild(node); child != FileTree::InvalidNode;
+         child = m_tree->nextSibling(child)) {
+        added.insert(child);
+    }
+
+    // Исчезнувшие показанные дети удаляются непрерывными участками, с конца,
+    // чтобы номера еще не обработанных строк не сдвигались
+    int row = listing.fetched - 1;
+    while (row >= 0) {
+        if (added.contains(listing.children[row].node)) {
+            --row;
+            continue;
+        }
+        const int last = row;
+        while (row > 0 && !added.contains(listing.children[row - 1].node))
+            --row;
+        beginRemoveRows(parent, row, last);
+        listing.children.erase(listing.children.begin() + row, listing.children.begin() + last + 1);
+        listing.fetched -= last - row + 1;
+        endRemoveRows();
+        --row;
+    }
+
+    // Непоказанные исчезнувшие выпадают одним проходом; у оставшихся детей
+    // обновляются ключи сортировки, и в added остаются только новые
+    int kept = 0;
+    for (int i = 0; i < listing.children.size(); ++i) {
+        Child child = listing.children[i];
+        if (!added.remove(child.node))
+            continue;
+        child.size = m_tree->totalSize(child.node);
+        listing.children[kept++] = child;
+    }
+    listing.children.resize(kept);
+    updateRows(listing, 0);
+
+    // Новый ребенок меньше всех показанных ждет своей порции, если показаны
+    // не все; остальные новые дописываются к показанным одним участком
+    const bool partial = listing.fetched < listing.children.size();
+    const Child smallest = listing.fetched > 0 ? listing.children[listing.fetched - 1] : Child{0, 0};
+    QVector<Child> shown;
+    for (quint32 child : added) {
+        const Child entry{m_tree->totalSize(child), child};
+        if (partial && (listing.fetched == 0 || precedes(smallest, entry)))
+            listing.children.append(entry);
+        else
+            shown.append(entry);
+    }
+    if (!shown.isEmpty()) {
+        beginInsertRows(parent, listing.fetched, listing.fetched + shown.size() - 1);
+        listing.children.insert(listing.fetched, shown.size(), Child{0, 0});
+        std::copy(shown.cbegin(), shown.cend(), listing.children.begin() + listing.fetched);
+        listing.fetched += shown.size();
+        updateRows(listing, 0);
+        endInsertRows();
+    }
+
+    // Размеры показанных строк могли измениться: порядок восстанавливается
+    // одной перестановкой, а не перестройкой строк
+    sortFetched(node, listing);
+}
+
+bool DirTreeModel::precedes(const Child &a, const Child &b)
+{
+    return a.size != b.size ? a.size > b.size : a.node < b.node;
+}
+
+void DirTreeModel::sortFetched(quint32 node, Listing &listing)
+{
+    const auto begin = listing.children.begin();
+    const auto end = begin + listing.fetched;
+    if (std::is_sorted(begin, end, precedes))
+        return;
+
+    const QModelIndex parent = indexOf(node);
+    emit layoutAboutToBeChanged({QPersistentModelIndex(parent)}, QAbstractItemModel::VerticalSortHint);
+
+    std::sort(begin, end, precedes);
+    updateRows(listing, 0);
+
+    // Выделение и текущая строка привязаны к узлам, а не к номерам строк
+    QHash<quint32, int> rows;
+    rows.reserve(listing.fetched);
+    for (int row = 0; row < listing.fetched; ++row)
+        rows.insert(listing.children[row].node, row);
+
+    QModelIndexList from;
+    QModelIndexList to;
+    for (const QModelIndex &index : persistentIndexList()) {
+        const quint32 child = nodeOf(index);
+        if (child == m_tree->root() || m_tree->parent(child) != node)
+            continue;
+        from.append(index);
+        to.append(createIndex(rows.value(child, index.row()), index.column(), quintptr(child)));
+    }
+    changePersistentIndexList(from, to);
+
+    emit layoutChanged({QPersistentModelIndex(parent)}, QAbstractItemModel::VerticalSortHint);
+}
+
+void DirTreeModel::updateRows(const Listing &listing, int from)
+{
+    for (int row = from; row < listing.fetched; ++row) {
+        if (m_tree->isDirectory(listing.children[row].node))
+            m_directoryRows.insert(listing.children[row].node, row);
+    }
+}
+
+QModelIndex DirTreeModel::indexOf(quint32 node) const
+{
+    if (node == m_tree->root())
+        return createIndex(0, 0, quintptr(node));
+    return createIndex(m_directoryRows.value(node, 0), 0, quintptr(node));
+}
+
+FileItem DirTreeModel::item(const QModelIndex &index) const
+{
+    if (!index.isValid() || !m_tree)
+        return FileItem();
+    return FileItem(m_tree.get(), nodeOf(index));
+}
+
+quint32 DirTreeModel::nodeOf(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<quint32>(index.internalId()) : FileTree::InvalidNode;
+}
+
+QModelIndex DirTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!m_tree || row < 0 || column < 0 || column >= ColumnCount)
+        return QModelIndex();
+
+    if (!parent.isValid())
+        return row == 0 ? createIndex(0, column, quintptr(m_tree->root())) : QModelIndex();
+
+    auto listing = m_listings.constFind(nodeOf(parent));
+    if (listing == m_listings.constEnd() || row >= listing->fetched)
+        return QModelIndex();
+    return createIndex(row, column, quintptr(listing->children[row].node));
+}
+
+QModelIndex DirTreeModel::parent(const QModelIndex &index) const
+{
+    const quint32 node = nodeOf(index);
+    if (!m_tree || node == FileTree::InvalidNode || node == m_tree->root())
+        return QModelIndex();
+
+    // Родитель показан, раз показан его ребенок, и его строка уже известна
+    const quint32 parentNode = m_tree->parent(node);
+    const int row = parentNode == m_tree->root() ? 0 : m_directoryRows.value(parentNode, 0);
+    return createIndex(row, 0, quintptr(parentNode));
+}
+
+int DirTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (!m_tree || parent.column() > 0)
+        return 0;
+    if (!parent.isValid())
+        return 1;
+
+    auto listing = m_listings.constFind(nodeOf(parent));
+    return listing == m_listings.constEnd() ? 0 : listing->fetched;
+}
+
+int DirTreeModel::columnCount(const QModelIndex &) const
+{
+    return ColumnCount;
+}
+
+bool DirTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!m_tree || parent.column() > 0)
+        return false;
+    if (!parent.isValid())
+        return true;
+
+    const quint32 node = nodeOf(parent);
+    return m_tree->isDirectory(node) && m_tree->firstChild(node) != FileTree::InvalidNode;
+}
+
+bool DirTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!hasChildren(parent) || !parent.isValid())
+        return false;
+
+    auto listing = m_listings.constFind(nodeOf(parent));
+    return listing == m_listings.constEnd() || listing->fetched < listing->children.size();
+}
+
+void DirTreeModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return;
+
+    const quint32 node = nodeOf(parent);
+    Listing &listing = m_listings[node];
+
+    // Размеры запоминаются при первом раскрытии: частичная сортировка
+    // следующих порций должна видеть те же ключи
+    if (listing.children.isEmpty()) {
+        for (quint32 child = m_tree->firstChild(node); child != FileTree::InvalidNode;
+             child = m_tree->nextSibling(child)) {
+            listing.children.append({m_tree->totalSize(child), child});
+        }
+    }
+
+    const int first = listing.fetched;
+    const int count = qMin(FetchBatch, listing.children.size() - first);
+    if (count <= 0)
+        return;
+
+    // Упорядочивается только новая порция: O(n log FetchBatch) вместо
+    // полной сортировки всех детей
+    std::partial_sort(listing.children.begin() + first, listing.children.begin() + first + count,
+                      listing.children.end(), precedes);
+
+    beginInsertRows(parent, first, first + count - 1);
+    listing.fetched = first + count;
+    updateRows(listing, first);
+    endInsertRows();
+}
+
+QVariant DirTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || !m_tree)
+        return QVariant();
+
+    const quint32 node = nodeOf(index);
+
+    // Исключенная директория не обходилась: вместо нулей - пометка
+    if (m_tree->isExcluded(node)) {
+        if (role == Qt::DisplayRole && index.column() == NameColumn)
+            return m_tree->name(node);
+        if (role == Qt::DisplayRole && index.column() == SizeColumn)
+            return QString("исключено");
+        if (role == Qt::ForegroundRole)
+            return QColor(Qt::gray);
+        if (role == Qt::ToolTipRole)
+            return QString("Не сканировалась по правилам исключения");
+        if (role == Qt::TextAlignmentRole && index.column() != NameColumn)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        return QVariant();
+    }
+
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+        case NameColumn:
+            return node == m_tree->root() ? m_tree->path(node) : m_tree->name(node);
+        case SizeColumn:
+            return FilesModel::formatSize(m_tree->totalSize(node));
+        case AllocatedColumn:
+            return FilesModel::formatSize(m_tree->totalAllocated(node));
+        case FilesColumn:
+            return m_tree->isDirectory(node) ? QString::number(m_tree->fileCount(node)) : QString();
+        case ShareColumn: {
+            if (node == m_tree->root())
+                return QString("100%");
+            const qint64 parentSize = m_tree->totalSize(m_tree->parent(node));
+            return parentSize > 0
+                ? QString("%1%").arg(100.0 * m_tree->totalSize(node) / parentSize, 0, 'f', 1)
+                : QString("-");
+        }
+        }
+    } else if (role == Qt::TextAlignmentRole && index.column() != NameColumn) {
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    return QVariant();
+}
+
+QVariant DirTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal)
+        return QVariant();
+
+    switch (section) {
+    case NameColumn:      return QString("Имя");
+    case SizeColumn:      return QString("Размер");
+    case AllocatedColumn: return QString("На диске");
+    case FilesColumn:     return QString("Файлов");
+    case ShareColumn:     return QString("Доля");
+    }
+    return QVariant();
+}
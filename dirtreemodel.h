@@ -0,0 +1,89 @@
+#ifndef DIRTREEMODEL_H
+#define DIRTREEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QVector>
+#include <memory>
+#include "fileitem.h"
+
+// Модель иерархии результатов для QTreeView.
+// Индекс хранит номер узла дерева в internalId, поэтому на узел не
+// создается ни одного объекта. Дети директории читаются при раскрытии
+// (canFetchMore/fetchMore) порциями по FetchBatch строк: каждая порция
+// досортировывается частичной сортировкой по итоговому размеру, так что
+// раскрытие директории с миллионом записей не сортирует их все сразу.
+class DirTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        NameColumn,
+        SizeColumn,
+        AllocatedColumn,
+        FilesColumn,
+        ShareColumn,
+        ColumnCount
+    };
+
+    explicit DirTreeModel(QObject *parent = nullptr);
+
+    // Единственная строка верхнего уровня - корень дерева. Раскрытые
+    // директории сбрасываются: порядок детей зависит от итогов
+    void setTree(std::shared_ptr<FileTree> tree);
+    void clear();
+    // Изменения от слежения: в раскрытых директориях из списка исчезнувшие
+    // дети удаляются, новые добавляются, и строки упорядочиваются по
+    // обновленным размерам; у строк предков обновляются итоги. Раскрытие и
+    // выделение сохраняются
+    void refresh(const QVector<quint32> &directories);
+
+    FileItem item(const QModelIndex &index) const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &index) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+
+    static constexpr int FetchBatch = 1000;
+
+private:
+    struct Child
+    {
+        qint64 size;
+        quint32 node;
+    };
+
+    // Дети раскрытой директории; первые fetched упорядочены и показаны
+    struct Listing
+    {
+        QVector<Child> children;
+        int fetched = 0;
+    };
+
+    quint32 nodeOf(const QModelIndex &index) const;
+    // Индекс показанной директории
+    QModelIndex indexOf(quint32 node) const;
+    // Сверяет раскрытую директорию с деревом: исчезнувшие строки удаляются
+    // участками, новые добавляются одним участком, затем показанные строки
+    // переупорядочиваются по свежим размерам. Работа - O(n log n) на листинг
+    void updateListing(quint32 node);
+    void sortFetched(quint32 node, Listing &listing);
+    // Порядок строк: по убыванию размера, при равенстве - по номеру узла
+    static bool precedes(const Child &a, const Child &b);
+    // Запоминает строки директорий listing, начиная с from
+    void updateRows(const Listing &listing, int from);
+
+    std::shared_ptr<FileTree> m_tree;
+    QHash<quint32, Listing> m_listings;
+    QHash<quint32, int> m_directoryRows;  // Строка показанной директории у ее родителя
+};
+
+#endif // DIRTREEMODEL_H
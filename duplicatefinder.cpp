@@ -0,0 +1,508 @@
+#include "duplicatefinder.h"
+#include <QFile>
+#include <QtConcurrent>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Частичный хеш берется от блока в начале и блока в конце файла
+const qint64 PartialBlock = 4096;
+// Полное чтение идет крупными последовательными кусками
+const int FullReadSize = 1 << 20;
+
+// Путь записан при сканировании, и на его месте может оказаться FIFO или
+// символическая ссылка: open без O_NONBLOCK ждал бы писателя FIFO вечно, а
+// ссылка увела бы чтение за пределы дерева. Открывается только обычный
+// файл ожидаемого размера; его device и inode возвращаются для сверки
+bool openRegularFile(QFile &file, const QString &path, qint64 size,
+                     quint64 *device, quint64 *inode)
+{
+#ifdef Q_OS_UNIX
+    const int fd = ::open(QFile::encodeName(path).constData(),
+                          O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size != size
+        || !file.open(fd, QIODevice::ReadOnly | QIODevice::Unbuffered, QFileDevice::AutoCloseHandle)) {
+        ::close(fd);
+        return false;
+    }
+    *device = st.st_dev;
+    *inode = st.st_ino;
+    return true;
+#else
+    Q_UNUSED(device);
+    Q_UNUSED(inode);
+    file.setFileName(path);
+    return file.open(QIODevice::ReadOnly | QIODevice::Unbuffered) && file.size() == size;
+#endif
+}
+
+// Некриптографический 128-битный хеш содержимого. Данные обрабатываются
+// полосами по 32 байта в четыре независимые дорожки (раунд как в xxHash64),
+// поэтому умножения дорожек выполняются параллельно и хеш не отстает от
+// чтения с диска. Для поиска дубликатов стойкость к подбору не нужна
+class ContentHash
+{
+public:
+    ContentHash()
+        : m_lanes{Prime1 + Prime2, Prime2, 0, 0 - Prime1}
+        , m_tailSize(0)
+        , m_length(0)
+    {
+    }
+
+    void update(const char *data, qint64 size)
+    {
+        m_length += size;
+        const uchar *bytes = reinterpret_cast<const uchar *>(data);
+
+        if (m_tailSize > 0) {
+            const int taken = static_cast<int>(qMin<qint64>(StripeSize - m_tailSize, size));
+            memcpy(m_tail + m_tailSize, bytes, taken);
+            m_tailSize += taken;
+            bytes += taken;
+            size -= taken;
+            if (m_tailSize < StripeSize)
+                return;
+            stripe(m_tail);
+            m_tailSize = 0;
+        }
+
+        for (; size >= StripeSize; bytes += StripeSize, size -= StripeSize)
+            stripe(bytes);
+
+        memcpy(m_tail, bytes, size);
+        m_tailSize = static_cast<int>(size);
+    }
+
+    void finish(quint64 result[2])
+    {
+        if (m_tailSize > 0) {
+            memset(m_tail + m_tailSize, 0, StripeSize - m_tailSize);
+            stripe(m_tail);
+        }
+
+        // Две половины результата сводят дорожки разными способами
+        const quint64 first = rotl(m_lanes[0], 1) + rotl(m_lanes[1], 7)
+                              + rotl(m_lanes[2], 12) + rotl(m_lanes[3], 18);
+        const quint64 second = (m_lanes[0] * Prime3) ^ rotl(m_lanes[1], 23)
+                               ^ (m_lanes[2] * Prime4) ^ rotl(m_lanes[3], 41);
+        result[0] = avalanche(first ^ (m_length * Prime5));
+        result[1] = avalanche(second + m_length);
+    }
+
+private:
+    static constexpr int StripeSize = 32;
+    static constexpr quint64 Prime1 = 0x9E3779B185EBCA87ULL;
+    static constexpr quint64 Prime2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr quint64 Prime3 = 0x165667B19E3779F9ULL;
+    static constexpr quint64 Prime4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr quint64 Prime5 = 0x27D4EB2F165667C5ULL;
+
+    static quint64 rotl(quint64 value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+    static quint64 avalanche(quint64 value)
+    {
+        value ^= value >> 33;
+        value *= Prime2;
+        value ^= value >> 29;
+        value *= Prime3;
+        return value ^ (value >> 32);
+    }
+
+    void stripe(const uchar *data)
+    {
+        for (int i = 0; i < 4; ++i) {
+            quint64 word;
+            memcpy(&word, data + i * 8, sizeof(word));
+            m_lanes[i] = rotl(m_lanes[i] + word * Prime2, 31) * Prime1;
+        }
+    }
+
+    quint64 m_lanes[4];
+    uchar m_tail[StripeSize];
+    int m_tailSize;
+    quint64 m_length;
+};
+
+bool readFully(QFile &file, char *data, qint64 size)
+{
+    qint64 done = 0;
+    while (done < size) {
+        const qint64 count = file.read(data + done, size - done);
+        if (count <= 0)
+            return false;
+        done += count;
+    }
+    return true;
+}
+
+qint64 partialBytes(qint64 size)
+{
+    return qMin(size, 2 * PartialBlock);
+}
+
+} // namespace
+
+DuplicateFinder::DuplicateFinder(std::shared_ptr<FileTree> tree, QObject *parent)
+    : QObject(parent)
+    , m_tree(std::move(tree))
+    , m_nodeCount(0)
+    , m_minimumSize(DefaultMinimumSize)
+    , m_running(false)
+    , m_cancelRequested(false)
+    , m_stage(DuplicateProgress::Grouping)
+    , m_files(0)
+    , m_filesDone(0)
+    , m_bytes(0)
+    , m_bytesDone(0)
+{
+    setIoConcurrency(DefaultIoConcurrency);
+
+    m_progressTimer.setInterval(ProgressInterval);
+    connect(&m_progressTimer, &QTimer::timeout, this, &DuplicateFinder::publishProgress);
+}
+
+DuplicateFinder::~DuplicateFinder()
+{
+    stop();
+}
+
+void DuplicateFinder::setIoConcurrency(int count)
+{
+    if (m_running)
+        return;
+    m_threadPool.setMaxThreadCount(qMax(1, count));
+}
+
+void DuplicateFinder::start()
+{
+    if (m_running) {
+        qDebug() << "Поиск дубликатов уже запущен";
+        return;
+    }
+
+    m_running = true;
+    m_cancelRequested = false;
+    m_groups.clear();
+
+    // Слежение меняет дерево в этом же потоке, поэтому все узлы ниже этой
+    // границы уже заполнены
+    m_nodeCount = m_tree->nodeCount();
+    m_stage = DuplicateProgress::Grouping;
+    m_files = 0;
+    m_filesDone = 0;
+    m_bytes = 0;
+    m_bytesDone = 0;
+
+    publishProgress();
+    m_progressTimer.start();
+    m_future = QtConcurrent::run([this]() { run(); });
+}
+
+void DuplicateFinder::stop()
+{
+    if (!m_running)
+        return;
+
+    qDebug() << "Запрос остановки поиска дубликатов";
+    m_cancelRequested = true;
+    m_future.waitForFinished();
+    m_progressTimer.stop();
+    m_running = false;
+}
+
+void DuplicateFinder::collectCandidates()
+{
+    struct Sized
+    {
+        qint64 size;
+        quint32 node;
+    };
+    QVector<Sized> files;
+
+    // Проход по столбцам вместо обхода списков детей: слежение может
+    // перестраивать их одновременно, а удаленный позже файл просто не
+    // прочитается
+    for (quint32 node = 0; node < m_nodeCount && !m_cancelRequested; ++node) {
+        if (m_tree->isDirectory(node) || m_tree->isRemoved(node))
+            continue;
+        const qint64 size = m_tree->size(node);
+        if (size >= m_minimumSize)
+            files.append({size, node});
+    }
+
+    // Файл с уникальным размером дубликатов не имеет
+    std::sort(files.begin(), files.end(), [](const Sized &a, const Sized &b) {
+        return a.size > b.size;
+    });
+
+    m_candidates.clear();
+    for (int begin = 0; begin < files.size();) {
+        int end = begin + 1;
+        while (end < files.size() && files[end].size == files[begin].size)
+            ++end;
+        if (end - begin > 1) {
+            for (int i = begin; i < end; ++i) {
+                Candidate candidate;
+                candidate.node = files[i].node;
+                candidate.size = files[i].size;
+                m_candidates.append(std::move(candidate));
+            }
+        }
+        begin = end;
+    }
+}
+
+void DuplicateFinder::beginStage(DuplicateProgress::Stage stage, const QVector<Candidate> &candidates)
+{
+    qint64 bytes = 0;
+    for (const Candidate &candidate : candidates)
+        bytes += stage == DuplicateProgress::PartialHash ? partialBytes(candidate.size) : candidate.size;
+
+    m_files = candidates.size();
+    m_filesDone = 0;
+    m_bytes = bytes;
+    m_bytesDone = 0;
+    m_stage = stage;
+}
+
+template <typename Work>
+void DuplicateFinder::parallelFor(int count, Work work)
+{
+    // Потоки разбирают индексы по одному: крупные файлы идут первыми,
+    // поэтому к концу этапа остаются мелкие и потоки заканчивают вместе
+    std::atomic<int> next(0);
+    QVector<QFuture<void>> futures;
+    const int threads = qMin(count, ioConcurrency());
+    for (int t = 0; t < threads; ++t) {
+        futures.append(QtConcurrent::run(&m_threadPool, [this, &next, count, &work]() {
+            QByteArray buffer(FullReadSize, Qt::Uninitialized);
+            for (int i = next.fetch_add(1); i < count && !m_cancelRequested; i = next.fetch_add(1))
+                work(i, buffer);
+        }));
+    }
+    for (QFuture<void> &future : futures)
+        future.waitForFinished();
+}
+
+void DuplicateFinder::run()
+{
+    // Этап 1: группировка по размеру
+    collectCandidates();
+    if (m_cancelRequested)
+        return;
+    qDebug() << "Поиск дубликатов: кандидатов по размеру" << m_candidates.size()
+             << "потоков чтения" << ioConcurrency();
+
+    // Этап 2: первый и последний блоки
+    beginStage(DuplicateProgress::PartialHash, m_candidates);
+    parallelFor(m_candidates.size(), [this](int i, QByteArray &buffer) {
+        hashPartial(m_candidates[i], buffer);
+    });
+    if (m_cancelRequested)
+        return;
+
+    // Пути нужны дальше только тем, кто совпал по краям
+    const QVector<int> bounds = regroup(m_candidates);
+    for (Candidate &candidate : m_candidates)
+        candidate.path = m_tree->path(candidate.node);
+
+    QVector<Candidate> remaining;
+    addGroups(m_candidates, bounds, &remaining);
+    m_candidates.clear();
+
+    // Этап 3: целиком, только то, что совпало по краям
+    beginStage(DuplicateProgress::FullHash, remaining);
+    parallelFor(remaining.size(), [this, &remaining](int i, QByteArray &buffer) {
+        hashFull(remaining[i], buffer);
+    });
+    if (m_cancelRequested)
+        return;
+
+    addGroups(remaining, regroup(remaining), nullptr);
+
+    std::sort(m_groups.begin(), m_groups.end(), [](const DuplicateGroup &a, const DuplicateGroup &b) {
+        return a.reclaimable() > b.reclaimable();
+    });
+    m_stage = DuplicateProgress::Done;
+
+    QMetaObject::invokeMethod(this, &DuplicateFinder::onRunFinished, Qt::QueuedConnection);
+}
+
+void DuplicateFinder::hashPartial(Candidate &candidate, QByteArray &buffer)
+{
+    // Файл мог измениться после сканирования; inode нужен, чтобы отличить
+    // жесткие ссылки от копий. Если сканер запомнил inode ссылки, на месте
+    // пути должен быть тот же файл
+    QFile file;
+    candidate.readable = openRegularFile(file, m_tree->path(candidate.node), candidate.size,
+                                         &candidate.device, &candidate.inode);
+    FileTree::HardLink link;
+    if (candidate.readable && m_tree->hardLink(candidate.node, &link))
+        candidate.readable = link.inode == candidate.inode;
+
+    const qint64 bytes = partialBytes(candidate.size);
+    if (candidate.readable) {
+        ContentHash hash;
+        if (candidate.size <= 2 * PartialBlock) {
+            candidate.readable = readFully(file, buffer.data(), bytes);
+            hash.update(buffer.constData(), bytes);
+            candidate.hashedWhole = true;
+        } else {
+            candidate.readable = readFully(file, buffer.data(), PartialBlock)
+                                 && file.seek(candidate.size - PartialBlock)
+                                 && readFully(file, buffer.data() + PartialBlock, PartialBlock);
+            hash.update(buffer.constData(), bytes);
+        }
+        hash.finish(candidate.hash);
+    }
+
+    m_filesDone.fetch_add(1, std::memory_order_relaxed);
+    m_bytesDone.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void DuplicateFinder::hashFull(Candidate &candidate, QByteArray &buffer)
+{
+    // На месте пути должен остаться файл, прочитанный на частичном этапе
+    QFile file;
+    quint64 device = 0;
+    quint64 inode = 0;
+    candidate.readable = openRegularFile(file, candidate.path, candidate.size, &device, &inode)
+                         && device == candidate.device && inode == candidate.inode;
+
+#ifdef Q_OS_LINUX
+    if (candidate.readable)
+        posix_fadvise(file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    ContentHash hash;
+    qint64 done = 0;
+    while (candidate.readable && done < candidate.size && !m_cancelRequested) {
+        const qint64 count = file.read(buffer.data(), FullReadSize);
+        if (count <= 0)
+            break;
+        hash.update(buffer.constData(), count);
+        done += count;
+        m_bytesDone.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Укоротившийся или выросший файл из сравнения выпадает
+    candidate.readable = candidate.readable && done == candidate.size && file.atEnd();
+    hash.finish(candidate.hash);
+    m_filesDone.fetch_add(1, std::memory_order_relaxed);
+}
+
+QVector<int> DuplicateFinder::regroup(QVector<Candidate> &candidates) const
+{
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        if (a.size != b.size)
+            return a.size > b.size;
+        if (a.hash[0] != b.hash[0])
+            return a.hash[0] < b.hash[0];
+        if (a.hash[1] != b.hash[1])
+            return a.hash[1] < b.hash[1];
+        if (a.device != b.device)
+            return a.device < b.device;
+        return a.inode < b.inode;
+    });
+
+    QVector<Candidate> kept;
+    QVector<int> bounds;
+    for (int begin = 0; begin < candidates.size();) {
+        const Candidate &head = candidates[begin];
+        int end = begin + 1;
+        while (end < candidates.size() && candidates[end].size == head.size
+               && candidates[end].hash[0] == head.hash[0] && candidates[end].hash[1] == head.hash[1]) {
+            ++end;
+        }
+
+        // Ссылки на один inode стоят рядом; из них остается первая
+        const int groupBegin = kept.size();
+        for (int i = begin; i < end; ++i) {
+            Candidate &candidate = candidates[i];
+            if (!candidate.readable)
+                continue;
+            if (kept.size() > groupBegin && candidate.inode != 0
+                && kept.last().inode == candidate.inode && kept.last().device == candidate.device) {
+                continue;
+            }
+            kept.append(std::move(candidate));
+        }
+
+        if (kept.size() - groupBegin > 1)
+            bounds.append(groupBegin);
+        else
+            kept.erase(kept.begin() + groupBegin, kept.end());
+        begin = end;
+    }
+    bounds.append(kept.size());
+
+    candidates = std::move(kept);
+    return bounds;
+}
+
+void DuplicateFinder::addGroups(const QVector<Candidate> &candidates, const QVector<int> &bounds,
+                                QVector<Candidate> *unresolved)
+{
+    for (int g = 0; g + 1 < bounds.size(); ++g) {
+        const int begin = bounds[g];
+        const int end = bounds[g + 1];
+
+        // Группа, которую частичный хеш покрыл не целиком, идет на следующий этап
+        if (unresolved && !candidates[begin].hashedWhole) {
+            for (int i = begin; i < end; ++i)
+                unresolved->append(candidates[i]);
+            continue;
+        }
+
+        DuplicateGroup group;
+        group.size = candidates[begin].size;
+        for (int i = begin; i < end; ++i) {
+            group.nodes.append(candidates[i].node);
+            group.paths.append(candidates[i].path);
+        }
+        m_groups.append(std::move(group));
+    }
+}
+
+void DuplicateFinder::publishProgress()
+{
+    DuplicateProgress snapshot;
+    snapshot.stage = static_cast<DuplicateProgress::Stage>(m_stage.load());
+    snapshot.files = m_files;
+    snapshot.filesDone = m_filesDone;
+    snapshot.bytes = m_bytes;
+    snapshot.bytesDone = m_bytesDone;
+    emit progress(snapshot);
+}
+
+void DuplicateFinder::onRunFinished()
+{
+    m_future.waitForFinished();
+    m_progressTimer.stop();
+    m_running = false;
+    if (m_cancelRequested)
+        return;
+
+    publishProgress();
+
+    qint64 reclaimable = 0;
+    for (const DuplicateGroup &group : m_groups)
+        reclaimable += group.reclaimable();
+    qDebug() << "Поиск дубликатов завершен. Групп:" << m_groups.size()
+             << "можно освободить" << reclaimable << "байт";
+
+    emit finished(m_groups);
+}
@@ -0,0 +1,135 @@
+#ifndef DUPLICATEFINDER_H
+#define DUPLICATEFINDER_H
+
+#include <QObject>
+#include <QFuture>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "filetree.h"
+
+// Группа файлов с одинаковым содержимым
+struct DuplicateGroup
+{
+    qint64 size = 0;           // Размер одной копии
+    QVector<quint32> nodes;
+    QStringList paths;
+
+    // Сколько освободится, если оставить одну копию
+    qint64 reclaimable() const { return size * (nodes.size() - 1); }
+};
+
+struct DuplicateProgress
+{
+    enum Stage {
+        Grouping,      // Группировка по размеру
+        PartialHash,   // Хеш первого и последнего блоков
+        FullHash,      // Хеш всего содержимого
+        Done
+    };
+
+    Stage stage = Grouping;
+    qint64 files = 0;          // Кандидатов на текущем этапе
+    qint64 filesDone = 0;
+    qint64 bytes = 0;          // Сколько байт предстоит прочитать на этапе
+    qint64 bytesDone = 0;
+};
+
+// Поиск дубликатов по готовому дереву в три этапа: файлы группируются по
+// размеру, у совпавших по размеру хешируются первый и последний блоки, и
+// только оставшиеся кандидаты читаются целиком. Каждый следующий этап
+// читает лишь то, что не отсеял предыдущий, поэтому полностью читаются
+// только файлы, которые почти наверняка окажутся дубликатами.
+//
+// Все этапы, включая группировку, идут в фоне. Группировка просматривает
+// столбцы узлов, выделенных к моменту start(); слежение меняет их
+// атомарными записями, так что группировка видит либо старый, либо новый
+// размер файла. Пути строятся при чтении файла и сохраняются только у
+// прошедших частичный хеш.
+//
+// Чтение идет в пуле из ioConcurrency потоков: на SSD параллельные запросы
+// ускоряют чтение, на HDD лучше 1-2 потока. Жесткие ссылки на один inode
+// дубликатами не считаются - освободить за их счет нечего.
+class DuplicateFinder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DuplicateFinder(std::shared_ptr<FileTree> tree, QObject *parent = nullptr);
+    ~DuplicateFinder();
+
+    // Настройки действуют до start()
+    void setIoConcurrency(int count);
+    int ioConcurrency() const { return m_threadPool.maxThreadCount(); }
+    void setMinimumSize(qint64 bytes) { m_minimumSize = qMax<qint64>(1, bytes); }
+
+    void start();
+    void stop();
+    bool isRunning() const { return m_running; }
+
+    static constexpr int DefaultIoConcurrency = 4;
+    // Мелкие копии почти не занимают места, а их много: без порога они
+    // составили бы большую часть кандидатов
+    static constexpr qint64 DefaultMinimumSize = 64 * 1024;
+    static constexpr int ProgressInterval = 200;  // мс
+
+signals:
+    void progress(const DuplicateProgress &progress);
+    // Группы по убыванию освобождаемого места; при отмене не отправляется
+    void finished(const QVector<DuplicateGroup> &groups);
+
+private slots:
+    void onRunFinished();
+    void publishProgress();
+
+private:
+    struct Candidate
+    {
+        quint32 node;
+        qint64 size;
+        QString path;          // Только после частичного хеша
+        quint64 device = 0;
+        quint64 inode = 0;     // 0 - номер неизвестен
+        quint64 hash[2] = {0, 0};
+        bool readable = true;
+        bool hashedWhole = false;  // Файл короче двух блоков, частичный хеш покрыл его целиком
+    };
+
+    void collectCandidates();
+    void run();
+    // Выполняет work(i, buffer) для каждого индекса в потоках пула;
+    // у каждого потока свой буфер чтения
+    template <typename Work>
+    void parallelFor(int count, Work work);
+    void hashPartial(Candidate &candidate, QByteArray &buffer);
+    void hashFull(Candidate &candidate, QByteArray &buffer);
+    // Оставляет кандидатов с совпадающими размером и хешем, убирая повторные
+    // ссылки на один inode; возвращает границы групп
+    QVector<int> regroup(QVector<Candidate> &candidates) const;
+    void addGroups(const QVector<Candidate> &candidates, const QVector<int> &bounds,
+                   QVector<Candidate> *unresolved);
+    void beginStage(DuplicateProgress::Stage stage, const QVector<Candidate> &candidates);
+
+    std::shared_ptr<FileTree> m_tree;
+    quint32 m_nodeCount;   // Узлы, заполненные к моменту start()
+    qint64 m_minimumSize;
+    QVector<Candidate> m_candidates;
+    QVector<DuplicateGroup> m_groups;
+
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_cancelRequested;
+    std::atomic<int> m_stage;
+    std::atomic<qint64> m_files;
+    std::atomic<qint64> m_filesDone;
+    std::atomic<qint64> m_bytes;
+    std::atomic<qint64> m_bytesDone;
+
+    QThreadPool m_threadPool;
+    QFuture<void> m_future;
+    QTimer m_progressTimer;
+};
+
+#endif // DUPLICATEFINDER_H
@@ -1,40 +1,17 @@
 #include "fileitem.h"
 
-FileItem::FileItem(const QString &name, const QString &path, qint64 size,
-                   const QDateTime &modified, bool isDir)
-    : m_name(name)
-    , m_path(path)
-    , m_size(size)
-    , m_modified(modified)
-    , m_isDirectory(isDir)
-    , m_cachedTotalSize(0)
-    , m_totalSizeCached(false)
+QDateTime FileItem::modified() const
 {
+    const qint64 mtime = m_tree->mtime(m_node);
+    return mtime > 0 ? QDateTime::fromSecsSinceEpoch(mtime) : QDateTime();
 }
 
-FileItem::~FileItem()
+QVector<FileItem> FileItem::children() const
 {
-    m_children.clear();
-}
-
-void FileItem::addChild(std::shared_ptr<FileItem> child)
-{
-    m_children.append(child);
-    m_totalSizeCached = false;
-}
-
-qint64 FileItem::totalSize() const
-{
-    if (m_totalSizeCached)
-        return m_cachedTotalSize;
-
-    qint64 total = m_size;
-    for (const auto &child : m_children) {
-        total += child->totalSize();
+    QVector<FileItem> result;
+    for (quint32 child = m_tree->firstChild(m_node); child != FileTree::InvalidNode;
+         child = m_tree->nextSibling(child)) {
+        result.append(FileItem(m_tree, child));
     }
-
-    const_cast<FileItem*>(this)->m_cachedTotalSize = total;
-    const_cast<FileItem*>(this)->m_totalSizeCached = true;
-
-    return total;
+    return result;
 }
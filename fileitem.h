@@ -3,35 +3,57 @@
 
 #include <QString>
 #include <QDateTime>
-#include <QList>
-#include <memory>
+#include <QVector>
+#include "filetree.h"
 
+// Легковесная ссылка на узел FileTree: указатель на дерево и индекс узла.
+// Копируется по значению; дерево должно жить дольше ссылок на него.
 class FileItem
 {
 public:
-    FileItem(const QString &name, const QString &path, qint64 size,
-             const QDateTime &modified, bool isDir);
-    ~FileItem();
+    FileItem()
+        : m_tree(nullptr)
+        , m_node(FileTree::InvalidNode)
+    {
+    }
 
-    void addChild(std::shared_ptr<FileItem> child);
-    qint64 totalSize() const;
+    FileItem(const FileTree *tree, quint32 node)
+        : m_tree(tree)
+        , m_node(node)
+    {
+    }
 
-    QString name() const { return m_name; }
-    QString path() const { return m_path; }
-    qint64 size() const { return m_size; }
-    QDateTime modified() const { return m_modified; }
-    bool isDirectory() const { return m_isDirectory; }
-    const QList<std::shared_ptr<FileItem>>& children() const { return m_children; }
+    bool isValid() const { return m_tree && m_node != FileTree::InvalidNode; }
+    const FileTree *tree() const { return m_tree; }
+    quint32 node() const { return m_node; }
+
+    QString name() const { return m_tree->name(m_node); }
+    QString path() const { return m_tree->path(m_node); }
+    qint64 size() const { return m_tree->size(m_node); }
+    qint64 allocatedSize() const { return m_tree->allocatedSize(m_node); }
+    QDateTime modified() const;
+    bool isDirectory() const { return m_tree->isDirectory(m_node); }
+    bool isExcluded() const { return m_tree->isExcluded(m_node); }
+    qint64 totalSize() const { return m_tree->totalSize(m_node); }
+    qint64 totalAllocated() const { return m_tree->totalAllocated(m_node); }
+    qint64 coldBytes(int threshold) const { return m_tree->coldBytes(m_node, threshold); }
+    quint64 fileCount() const { return m_tree->fileCount(m_node); }
+    quint64 directoryCount() const { return m_tree->directoryCount(m_node); }
+    bool isComplete() const { return m_tree->isComplete(m_node); }
+
+    FileItem parent() const { return FileItem(m_tree, m_tree->parent(m_node)); }
+    QVector<FileItem> children() const;
+
+    bool operator==(const FileItem &other) const
+    {
+        return m_tree == other.m_tree && m_node == other.m_node;
+    }
 
 private:
-    QString m_name;
-    QString m_path;
-    qint64 m_size;
-    QDateTime m_modified;
-    bool m_isDirectory;
-    QList<std::shared_ptr<FileItem>> m_children;
-    mutable qint64 m_cachedTotalSize;
-    mutable bool m_totalSizeCached;
+    const FileTree *m_tree;
+    quint32 m_node;
 };
 
+Q_DECLARE_TYPEINFO(FileItem, Q_MOVABLE_TYPE);
+
 #endif // FILEITEM_H
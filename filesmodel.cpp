@@ -0,0 +1,356 @@
+#include "filesmodel.h"
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <algorithm>
+
+FilesModel::FilesModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , m_sortColumn(SizeColumn)
+    , m_sortOrder(Qt::DescendingOrder)
+{
+}
+
+void FilesModel::setFiles(std::shared_ptr<FileTree> tree, QVector<quint32> nodes)
+{
+    beginResetModel();
+    m_tree = std::move(tree);
+    m_nodes = std::move(nodes);
+    m_shown.clear();
+    sortNodes(m_nodes);
+    endResetModel();
+}
+
+void FilesModel::updateFiles(std::shared_ptr<FileTree> tree, QVector<quint32> nodes)
+{
+    if (tree != m_tree || m_nodes.isEmpty()) {
+        setFiles(std::move(tree), std::move(nodes));
+        for (quint32 node : m_nodes)
+            updateShown(node);
+        return;
+    }
+
+    sortNodes(nodes);
+
+    if (nodes != m_nodes) {
+        QSet<quint32> current;
+        current.reserve(m_nodes.size());
+        for (quint32 node : m_nodes)
+            current.insert(node);
+
+        QSet<quint32> wanted;
+        wanted.reserve(nodes.size());
+        QVector<quint32> added;
+        for (quint32 node : nodes) {
+            wanted.insert(node);
+            if (!current.contains(node))
+                added.append(node);
+        }
+        QVector<quint32> dropped;
+        for (quint32 node : m_nodes) {
+            if (!wanted.contains(node))
+                dropped.append(node);
+        }
+
+        // Новые узлы дописываются в конец, затем строки переставляются в
+        // итоговый порядок с выбывшими в хвосте, и хвост удаляется
+        if (!added.isEmpty()) {
+            for (quint32 node : added)
+                updateShown(node);
+            beginInsertRows(QModelIndex(), m_nodes.size(), m_nodes.size() + added.size() - 1);
+            m_nodes += added;
+            endInsertRows();
+        }
+        reorder(nodes + dropped);
+        if (!dropped.isEmpty()) {
+            for (quint32 node : dropped)
+                m_shown.remove(node);
+            beginRemoveRows(QModelIndex(), nodes.size(), m_nodes.size() - 1);
+            m_nodes.resize(nodes.size());
+            endRemoveRows();
+        }
+    }
+
+    // Размеры и даты могли измениться и у оставшихся строк; сигнал идет
+    // по непрерывным участкам изменившихся строк
+    int first = -1;
+    for (int row = 0; row <= m_nodes.size(); ++row) {
+        const bool changed = row < m_nodes.size() && updateShown(m_nodes[row]);
+        if (changed && first < 0) {
+            first = row;
+        } else if (!changed && first >= 0) {
+            emit dataChanged(index(first, 0), index(row - 1, ColumnCount - 1));
+            first = -1;
+        }
+    }
+}
+
+bool FilesModel::updateShown(quint32 node)
+{
+    const Shown current{m_tree->totalSize(node), m_tree->mtime(node)};
+    auto it = m_shown.find(node);
+    if (it == m_shown.end()) {
+        m_shown.insert(node, current);
+        return true;
+    }
+    if (it->size == current.size && it->mtime == current.mtime)
+        return false;
+    *it = current;
+    return true;
+}
+
+void FilesModel::appendFiles(const QVector<quint32> &nodes)
+{
+    if (nodes.isEmpty())
+        return;
+    beginInsertRows(QModelIndex(), m_nodes.size(), m_nodes.size() + nodes.size() - 1);
+    m_nodes += nodes;
+    endInsertRows();
+}
+
+void FilesModel::clear()
+{
+    beginResetModel();
+    m_tree.reset();
+    m_nodes.clear();
+    m_shown.clear();
+    endResetModel();
+}
+
+FileItem FilesModel::file(int row) const
+{
+    if (row < 0 || row >= m_nodes.size())
+        return FileItem();
+    return FileItem(m_tree.get(), m_nodes[row]);
+}
+
+int FilesModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_nodes.size();
+}
+
+int FilesModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant FilesModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_nodes.size())
+        return QVariant();
+
+    const quint32 node = m_nodes[index.row()];
+
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+        case NameColumn: {
+            const QString name = m_tree->name(node);
+            return !name.isEmpty() ? name : QString("Неизвестно");
+        }
+        case SizeColumn:
+            return formatSize(m_tree->totalSize(node));
+        case PathColumn:
+            return m_tree->path(node);
+        case ModifiedColumn: {
+            const QDateTime modified = FileItem(m_tree.get(), node).modified();
+            return modified.isValid() ? modified.toString("dd.MM.yyyy HH:mm") : QString("-");
+        }
+        }
+    } else if (role == Qt::TextAlignmentRole && index.column() == SizeColumn) {
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    return QVariant();
+}
+
+QVariant FilesModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole)
+        return QVariant();
+    if (orientation == Qt::Vertical)
+        return section + 1;
+
+    switch (section) {
+    case NameColumn:     return QString("Имя файла");
+    case SizeColumn:     return QString("Размер");
+    case PathColumn:     return QString("Путь");
+    case ModifiedColumn: return QString("Дата изменения");
+    }
+    return QVariant();
+}
+
+void FilesModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0 || column >= ColumnCount)
+        return;
+
+    m_sortColumn = column;
+    m_sortOrder = order;
+
+    QVector<quint32> nodes = m_nodes;
+    sortNodes(nodes);
+    reorder(nodes);
+}
+
+void FilesModel::reorder(const QVector<quint32> &nodes)
+{
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    // Выделение и текущая строка привязаны к узлам, а не к номерам строк
+    const QModelIndexList before = persistentIndexList();
+    QVector<quint32> beforeNodes;
+    beforeNodes.reserve(before.size());
+    for (const QModelIndex &index : before) {
+        beforeNodes.append(m_nodes[index.row()]);
+    }
+
+    m_nodes = nodes;
+
+    if (!before.isEmpty()) {
+        QHash<quint32, int> rows;
+        rows.reserve(m_nodes.size());
+        for (int row = 0; row < m_nodes.size(); ++row) {
+            rows.insert(m_nodes[row], row);
+        }
+
+        QModelIndexList after;
+        after.reserve(before.size());
+        for (int i = 0; i < before.size(); ++i) {
+            after.append(index(rows.value(beforeNodes[i]), before[i].column()));
+        }
+        changePersistentIndexList(before, after);
+    }
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void FilesModel::sortNodes(QVector<quint32> &nodes) const
+{
+    if (!m_tree || nodes.size() < 2)
+        return;
+
+    const FileTree &tree = *m_tree;
+
+    // Числовые ключи копируются рядом с узлом, чтобы сортировка шла по
+    // непрерывному массиву, а не по столбцам дерева
+    switch (m_sortColumn) {
+    case SizeColumn:
+    case ModifiedColumn: {
+        const bool bySize = m_sortColumn == SizeColumn;
+        QVector<QPair<qint64, quint32>> keys;
+        keys.reserve(nodes.size());
+        for (quint32 node : nodes) {
+            keys.append(qMakePair(bySize ? tree.totalSize(node) : tree.mtime(node), node));
+        }
+
+        std::sort(keys.begin(), keys.end());
+        for (int i = 0; i < keys.size(); ++i) {
+            nodes[i] = keys[i].second;
+        }
+        break;
+    }
+    case NameColumn:
+        std::sort(nodes.begin(), nodes.end(), [&tree](quint32 a, quint32 b) {
+            const int result = tree.compareNames(a, b);
+            return result != 0 ? result < 0 : a < b;
+        });
+        break;
+    case PathColumn:
+        sortByPath(nodes);
+        break;
+    }
+
+    if (m_sortOrder == Qt::DescendingOrder) {
+        std::reverse(nodes.begin(), nodes.end());
+    }
+}
+
+void FilesModel::sortByPath(QVector<quint32> &nodes) const
+{
+    const FileTree &tree = *m_tree;
+
+    // Порядок путей - порядок обхода дерева в глубину, в котором дети каждой
+    // директории идут по побайтовому сравнению имен. Так пути сравниваются
+    // покомпонентно одним сравнением, и строки путей не собираются. В обход
+    // попадают только узлы списка и их предки
+    struct Entry
+    {
+        quint32 parent;
+        quint32 node;
+        bool listed;
+    };
+    QVector<Entry> entries;
+    entries.reserve(nodes.size());
+    QSet<quint32> known;
+    known.reserve(nodes.size());
+    for (quint32 node : nodes) {
+        entries.append({tree.parent(node), node, true});
+        known.insert(node);
+    }
+    for (quint32 node : nodes) {
+        for (quint32 parent = tree.parent(node);
+             parent != FileTree::InvalidNode && !known.contains(parent); parent = tree.parent(parent)) {
+            entries.append({tree.parent(parent), parent, false});
+            known.insert(parent);
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [&tree](const Entry &a, const Entry &b) {
+        if (a.parent != b.parent)
+            return a.parent < b.parent;
+        const int result = tree.compareNames(a.node, b.node);
+        return result != 0 ? result < 0 : a.node < b.node;
+    });
+
+    // Начало участка детей каждой директории
+    QHash<quint32, int> children;
+    for (int i = 0; i < entries.size(); ++i) {
+        if (i == 0 || entries[i].parent != entries[i - 1].parent)
+            children.insert(entries[i].parent, i);
+    }
+
+    // Стек: позиция в участке детей и директория, которой он принадлежит.
+    // Верхний уровень - узлы без родителя
+    QVector<QPair<int, quint32>> stack;
+    const auto top = children.constFind(FileTree::InvalidNode);
+    if (top != children.constEnd())
+        stack.append(qMakePair(*top, FileTree::InvalidNode));
+
+    int count = 0;
+    while (!stack.isEmpty()) {
+        const int position = stack.last().first;
+        if (position >= entries.size() || entries[position].parent != stack.last().second) {
+            stack.removeLast();
+            continue;
+        }
+        ++stack.last().first;
+
+        const Entry &entry = entries[position];
+        if (entry.listed)
+            nodes[count++] = entry.node;
+        const auto first = children.constFind(entry.node);
+        if (first != children.constEnd())
+            stack.append(qMakePair(*first, entry.node));
+    }
+}
+
+QString FilesModel::formatSize(qint64 bytes)
+{
+    constexpr qint64 KB = 1024;
+    constexpr qint64 MB = KB * 1024;
+    constexpr qint64 GB = MB * 1024;
+    constexpr qint64 TB = GB * 1024;
+
+    if (bytes == 0) return "0 Б";
+
+    if (bytes >= TB)
+        return QString("%1 TB").arg(bytes / static_cast<double>(TB), 0, 'f', 2);
+    else if (bytes >= GB)
+        return QString("%1 GB").arg(bytes / static_cast<double>(GB), 0, 'f', 2);
+    else if (bytes >= MB)
+        return QString("%1 MB").arg(bytes / static_cast<double>(MB), 0, 'f', 2);
+    else if (bytes >= KB)
+        return QString("%1 KB").arg(bytes / static_cast<double>(KB), 0, 'f', 2);
+    else
+        return QString("%1 Б").arg(bytes);
+}
@@ -0,0 +1,74 @@
+#ifndef FILESMODEL_H
+#define FILESMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QVector>
+#include <memory>
+#include "fileitem.h"
+
+// Модель таблицы файлов поверх дерева результатов. У директорий размер -
+// итог поддерева.
+// Хранит только индексы узлов в порядке отображения; текст ячеек
+// формируется в data(), то есть только для видимых строк. Сортировка
+// переставляет индексы по ключам, прочитанным из столбцов дерева.
+class FilesModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        NameColumn,
+        SizeColumn,
+        PathColumn,
+        ModifiedColumn,
+        ColumnCount
+    };
+
+    explicit FilesModel(QObject *parent = nullptr);
+
+    // Заменяет список файлов; текущая сортировка применяется заново
+    void setFiles(std::shared_ptr<FileTree> tree, QVector<quint32> nodes);
+    // То же для периодического обновления: список того же дерева меняется
+    // вставкой и удалением строк, выделение и прокрутка сохраняются, а
+    // dataChanged получают только строки с новым размером или датой
+    void updateFiles(std::shared_ptr<FileTree> tree, QVector<quint32> nodes);
+    // Добавляет узлы в конец без пересортировки: так приходят порции
+    // результатов поиска
+    void appendFiles(const QVector<quint32> &nodes);
+    void clear();
+
+    FileItem file(int row) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    static QString formatSize(qint64 bytes);
+
+private:
+    void sortNodes(QVector<quint32> &nodes) const;
+    // Переставляет строки в порядок nodes; постоянные индексы следуют за узлами
+    void reorder(const QVector<quint32> &nodes);
+    void sortByPath(QVector<quint32> &nodes) const;
+    // Запоминает размер и дату узла; true, если они отличаются от прежних
+    bool updateShown(quint32 node);
+
+    // Значения строки на момент последнего updateFiles
+    struct Shown
+    {
+        qint64 size;
+        qint64 mtime;
+    };
+
+    std::shared_ptr<FileTree> m_tree;
+    QVector<quint32> m_nodes;  // Узлы в порядке отображения
+    QHash<quint32, Shown> m_shown;
+    int m_sortColumn;
+    Qt::SortOrder m_sortOrder;
+};
+
+#endif // FILESMODEL_H
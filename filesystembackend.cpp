@@ -0,0 +1,54 @@
+#include "filesystembackend.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+
+#ifdef Q_OS_UNIX
+#include <sys/statvfs.h>
+#endif
+
+bool LocalBackend::read(const DirLocation &location, QVector<DirEntry> &entries,
+                        DirReader::Options options, DirEntry *self, QString *errorString,
+                        std::shared_ptr<DirHandle> *handle)
+{
+    DirReader reader;
+    const bool ok = reader.read(location, entries, options, self, handle);
+    if (!ok && errorString) *errorString = reader.errorString();
+    return ok;
+}
+
+bool LocalBackend::restat(const DirLocation &location, QVector<DirEntry> &entries,
+                          DirReader::Options options, DirEntry *self, QString *errorString,
+                          std::shared_ptr<DirHandle> *handle)
+{
+    DirReader reader;
+    const bool ok = reader.restat(location, entries, options, self, handle);
+    if (!ok && errorString) *errorString = reader.errorString();
+    return ok;
+}
+
+bool LocalBackend::exists(const QString &path)
+{
+    return QFileInfo::exists(path);
+}
+
+void LocalBackend::estimateUsage(const QString &path, qint64 *bytes, qint64 *entries)
+{
+    // Занятое место и число занятых inode относятся ко всей файловой системе.
+    // Если корень сканирования - не точка монтирования, это лишь верхняя граница,
+    // которая затем уточняется по мере обхода
+    *bytes = 0;
+    *entries = 0;
+
+    QStorageInfo storage(path);
+    if (storage.isValid() && storage.isReady()) {
+        *bytes = qMax<qint64>(0, storage.bytesTotal() - storage.bytesFree());
+    }
+
+#ifdef Q_OS_UNIX
+    struct statvfs fs;
+    if (::statvfs(QFile::encodeName(path).constData(), &fs) == 0 && fs.f_files > 0) {
+        *entries = static_cast<qint64>(fs.f_files - fs.f_ffree);
+    }
+#endif
+}
@@ -0,0 +1,46 @@
+#ifndef FILESYSTEMBACKEND_H
+#define FILESYSTEMBACKEND_H
+
+#include <QString>
+#include <QVector>
+#include "dirreader.h"
+
+// Источник содержимого директорий для сканера. Методы вызываются
+// одновременно из всех рабочих потоков, поэтому реализация должна быть
+// потокобезопасной; настраивается она до начала сканирования
+class FileSystemBackend
+{
+public:
+    virtual ~FileSystemBackend() = default;
+
+    // Семантика как у DirReader::read и DirReader::restat; текст ошибки
+    // возвращается в errorString. Бэкенд без дескрипторов оставляет handle
+    // пустым, и дети ищутся по location.path
+    virtual bool read(const DirLocation &location, QVector<DirEntry> &entries,
+                      DirReader::Options options, DirEntry *self, QString *errorString,
+                      std::shared_ptr<DirHandle> *handle) = 0;
+    virtual bool restat(const DirLocation &location, QVector<DirEntry> &entries,
+                        DirReader::Options options, DirEntry *self, QString *errorString,
+                        std::shared_ptr<DirHandle> *handle) = 0;
+
+    virtual bool exists(const QString &path) = 0;
+
+    // Оценка объема под path: занятые байты и число записей; 0 - неизвестно
+    virtual void estimateUsage(const QString &path, qint64 *bytes, qint64 *entries) = 0;
+};
+
+// Настоящая файловая система через DirReader
+class LocalBackend : public FileSystemBackend
+{
+public:
+    bool read(const DirLocation &location, QVector<DirEntry> &entries,
+              DirReader::Options options, DirEntry *self, QString *errorString,
+              std::shared_ptr<DirHandle> *handle) override;
+    bool restat(const DirLocation &location, QVector<DirEntry> &entries,
+                DirReader::Options options, DirEntry *self, QString *errorString,
+                std::shared_ptr<DirHandle> *handle) override;
+    bool exists(const QString &path) override;
+    void estimateUsage(const QString &path, qint64 *bytes, qint64 *entries) override;
+};
+
+#endif // FILESYSTEMBACKEND_H
@@ -0,0 +1,788 @@
+#include "filetree.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// Заголовок снимка. Все значения в порядке байтов записавшей машины;
+// чужой порядок распознается по полю byteOrder и отвергается
+struct SnapshotHeader
+{
+    enum Section {
+        ParentSection,
+        FirstChildSection,
+        NextSiblingSection,
+        SizeSection,
+        MtimeSection,
+        AtimeSection,
+        AllocatedSection,
+        NameSection,
+        DirStatsSection,
+        NamePoolSection,
+        LargeAllocatedSection,
+        HardLinkSection,
+        SectionCount
+    };
+
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 nodeCount;
+    quint32 dirCount;
+    quint64 nameBlocks;
+    qint64 scanTime;
+    quint32 rootPathSize;  // Путь корня в UTF-8 идет сразу за заголовком
+    quint32 sectionCount;
+    quint64 offset[SectionCount];
+    quint64 size[SectionCount];
+};
+
+// Записи редких атрибутов, по одной на узел, в порядке номеров узлов
+struct LargeAllocatedRecord
+{
+    quint32 node;
+    quint32 reserved;
+    qint64 bytes;
+};
+
+struct HardLinkRecord
+{
+    quint32 node;
+    quint32 links;
+    quint64 device;
+    quint64 inode;
+    qint64 allocated;
+};
+
+const char SnapshotMagic[8] = {'D', 'A', 'S', 'N', 'A', 'P', '\0', '\0'};
+const quint32 SnapshotByteOrder = 0x01020304;
+
+// Столбцы выравниваются по странице: их блоки адресуются прямо в отображении
+const quint64 SnapshotAlignment = 4096;
+
+quint64 alignOffset(quint64 offset)
+{
+    return (offset + SnapshotAlignment - 1) & ~(SnapshotAlignment - 1);
+}
+
+bool writePadding(QIODevice &out, quint64 offset)
+{
+    static const char zeros[SnapshotAlignment] = {};
+    const quint64 padding = alignOffset(offset) - offset;
+    return out.write(zeros, padding) == qint64(padding);
+}
+
+// Столбец пишется поблочно, без промежуточной копии
+template <typename T, int ChunkBits, int MaxChunks>
+bool writeColumn(QIODevice &out, const ChunkedArray<T, ChunkBits, MaxChunks> &column, quint64 count)
+{
+    using Column = ChunkedArray<T, ChunkBits, MaxChunks>;
+    for (quint64 begin = 0; begin < count; begin += Column::ChunkSize) {
+        const qint64 bytes = qMin(Column::ChunkSize, count - begin) * sizeof(T);
+        if (out.write(reinterpret_cast<const char *>(&column[begin]), bytes) != bytes)
+            return false;
+    }
+    return true;
+}
+
+template <typename T, int ChunkBits, int MaxChunks>
+bool adoptColumn(ChunkedArray<T, ChunkBits, MaxChunks> &column, uchar *base,
+                 const SnapshotHeader &header, int section, quint64 count)
+{
+    if (header.size[section] != count * sizeof(T) || header.offset[section] % alignof(T) != 0)
+        return false;
+    return column.adopt(reinterpret_cast<T *>(base + header.offset[section]), count);
+}
+
+void setError(QString *errorString, const QString &message)
+{
+    if (errorString)
+        *errorString = message;
+}
+
+} // namespace
+
+FileTree::FileTree()
+    : m_scanTime(0)
+    , m_nodeCount(0)
+    , m_readyBlocks(0)
+    , m_nameBlocks(0)
+    , m_dirCount(0)
+{
+}
+
+FileTree::FileTree(const QString &rootPath)
+    : m_rootPath(rootPath)
+    , m_scanTime(QDateTime::currentSecsSinceEpoch())
+    , m_nodeCount(0)
+    , m_readyBlocks(0)
+    , m_nameBlocks(0)
+    , m_dirCount(0)
+{
+    // Корень называется как последняя компонента пути (или весь путь для "/")
+    QFileInfo rootInfo(rootPath);
+    const QByteArray rootName = QFile::encodeName(
+        rootInfo.fileName().isEmpty() ? rootInfo.absoluteFilePath() : rootInfo.fileName());
+
+    NameCursor cursor;
+    const quint32 node = allocateNodes(1);
+    initNode(node, InvalidNode, InvalidNode, rootName.constData(), rootName.size(),
+             0, 0, rootInfo.lastModified().toSecsSinceEpoch(),
+             rootInfo.lastRead().toSecsSinceEpoch(), true, cursor);
+}
+
+FileTree::~FileTree()
+{
+}
+
+quint32 FileTree::packTime(qint64 seconds)
+{
+    if (seconds <= 0)
+        return 0;
+    if (seconds >= std::numeric_limits<quint32>::max())
+        return std::numeric_limits<quint32>::max();
+    return static_cast<quint32>(seconds);
+}
+
+void FileTree::setAllocated(quint32 node, qint64 bytes)
+{
+    const qint64 blocks = bytes > 0 ? (bytes + 511) / 512 : 0;
+    if (blocks < AllocatedOverflow) {
+        m_allocated[node] = static_cast<quint32>(blocks);
+        return;
+    }
+
+    QMutexLocker locker(&m_rareMutex);
+    m_largeAllocated.insert(node, bytes);
+    m_allocated[node] = AllocatedOverflow;
+}
+
+qint64 FileTree::largeAllocated(quint32 node) const
+{
+    QMutexLocker locker(&m_rareMutex);
+    return m_largeAllocated.value(node, qint64(AllocatedOverflow) * 512);
+}
+
+void FileTree::setHardLink(quint32 node, const HardLink &link)
+{
+    QMutexLocker locker(&m_rareMutex);
+    m_hardLinks.insert(node, link);
+}
+
+bool FileTree::hardLink(quint32 node, HardLink *link) const
+{
+    QMutexLocker locker(&m_rareMutex);
+    const auto it = m_hardLinks.constFind(node);
+    if (it == m_hardLinks.constEnd())
+        return false;
+    *link = it.value();
+    return true;
+}
+
+bool FileTree::storeName(const char *name, int length, NameCursor &cursor, quint64 *offset)
+{
+    // Когда текущий блок потока заполнен, он берет следующий целиком
+    if (cursor.next + length > cursor.end) {
+        const quint64 block = m_nameBlocks.fetch_add(1, std::memory_order_relaxed);
+        const quint64 begin = block << NameBlockBits;
+        if (!m_names.ensure(begin, begin + NamePool::ChunkSize))
+            return false;
+        cursor.next = begin;
+        cursor.end = begin + NamePool::ChunkSize;
+    }
+
+    if (length > 0)
+        memcpy(&m_names[cursor.next], name, length);
+    *offset = cursor.next;
+    cursor.next += length;
+    return true;
+}
+
+quint32 FileTree::allocateNodes(quint32 count)
+{
+    const quint32 first = m_nodeCount.fetch_add(count, std::memory_order_relaxed);
+    const quint64 end = quint64(first) + count;
+    if (end >= InvalidNode)
+        return InvalidNode;
+
+    // Обычно диапазон лежит в уже готовых блоках, и резервирование на этом
+    // заканчивается
+    const quint64 lastBlock = (end - 1) >> NodeBlockBits;
+    if (count == 0 || lastBlock < m_readyBlocks.load(std::memory_order_acquire))
+        return first;
+
+    // Новые блоки создаются под мьютексом, а готовыми считаются только
+    // блоки, созданные во всех столбцах подряд с начала: читатель,
+    // перебирающий узлы до nodeCount(), не попадет в несуществующий блок
+    QMutexLocker locker(&m_blockMutex);
+    if (!m_parent.ensure(first, end))
+        return InvalidNode;
+    m_firstChild.ensure(first, end);
+    m_nextSibling.ensure(first, end);
+    m_size.ensure(first, end);
+    m_mtime.ensure(first, end);
+    m_atime.ensure(first, end);
+    m_allocated.ensure(first, end);
+    m_name.ensure(first, end);
+
+    quint32 ready = m_readyBlocks.load(std::memory_order_relaxed);
+    while (m_name.hasChunk(ready))
+        ++ready;
+    m_readyBlocks.store(ready, std::memory_order_release);
+    return first;
+}
+
+bool FileTree::initNode(quint32 node, quint32 parent, quint32 nextSibling,
+                        const char *name, int nameLength, qint64 size, qint64 allocated,
+                        qint64 mtime, qint64 atime, bool isDirectory, NameCursor &cursor)
+{
+    // Даже если пул имен переполнен, узел заполняется целиком (с пустым
+    // именем), чтобы цепочка соседей оставалась корректной
+    nameLength = qMin(nameLength, 0xFFFF);
+    quint64 offset = 0;
+    const bool stored = storeName(name, nameLength, cursor, &offset);
+    if (!stored)
+        nameLength = 0;
+
+    // Директория получает строку в таблице итогов вместо собственного размера
+    if (isDirectory) {
+        // Таблица рассчитана на любое допустимое число узлов
+        const quint32 row = m_dirCount.fetch_add(1, std::memory_order_relaxed);
+        m_dirStats.ensure(row, quint64(row) + 1);
+
+        DirStats &stats = m_dirStats[row];
+        stats.bytes.store(0, std::memory_order_relaxed);
+        stats.allocated.store(0, std::memory_order_relaxed);
+        for (std::atomic<qint64> &cold : stats.cold)
+            cold.store(0, std::memory_order_relaxed);
+        stats.files.store(0, std::memory_order_relaxed);
+        stats.directories.store(0, std::memory_order_relaxed);
+        stats.pending.store(1, std::memory_order_relaxed);
+        stats.inode = 0;
+        stats.ctime = 0;
+        size = row;
+        allocated = 0;
+    }
+
+    m_parent[node] = parent;
+    m_firstChild[node].store(InvalidNode, std::memory_order_relaxed);
+    m_nextSibling[node].store(nextSibling, std::memory_order_relaxed);
+    m_size[node] = size;
+    m_mtime[node] = packTime(mtime);
+    m_atime[node] = packAccessDays(atime);
+    setAllocated(node, allocated);
+    m_name[node] = packName(offset, nameLength, isDirectory ? DirectoryFlag : 0);
+    return stored;
+}
+
+const char *FileTree::nameData(quint32 node, int *length) const
+{
+    const quint64 ref = m_name[node];
+    *length = nameLength(ref);
+    // Имя снимка за пределами пула читается как пустое
+    if (*length > 0 && isReadOnly()
+        && nameOffset(ref) + *length > (m_nameBlocks.load(std::memory_order_relaxed) << NameBlockBits)) {
+        *length = 0;
+    }
+    return *length > 0 ? &m_names[nameOffset(ref)] : nullptr;
+}
+
+QByteArray FileTree::rawName(quint32 node) const
+{
+    int length = 0;
+    const char *data = nameData(node, &length);
+    if (length == 0)
+        return QByteArray();
+    return QByteArray::fromRawData(data, length);
+}
+
+QString FileTree::name(quint32 node) const
+{
+    return QFile::decodeName(rawName(node));
+}
+
+int FileTree::compareNames(quint32 a, quint32 b) const
+{
+    int lengthA = 0;
+    int lengthB = 0;
+    const char *nameA = nameData(a, &lengthA);
+    const char *nameB = nameData(b, &lengthB);
+
+    const int common = qMin(lengthA, lengthB);
+    if (common > 0) {
+        const int result = memcmp(nameA, nameB, common);
+        if (result != 0)
+            return result;
+    }
+    return lengthA - lengthB;
+}
+
+QString FileTree::path(quint32 node) const
+{
+    if (node == root())
+        return m_rootPath;
+
+    QVector<quint32> chain;
+    for (quint32 current = node; current != root() && current != InvalidNode;
+         current = parent(current)) {
+        chain.append(current);
+    }
+
+    QString result = m_rootPath;
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        if (!result.endsWith('/'))
+            result += '/';
+        result += name(chain[i]);
+    }
+    return result;
+}
+
+void FileTree::setDirectoryStamp(quint32 node, quint64 inode, qint64 ctime)
+{
+    DirStats &stats = dirStats(node);
+    stats.inode = inode;
+    stats.ctime = ctime;
+}
+
+quint16 FileTree::packAccessDays(qint64 atime) const
+{
+    if (atime <= 0)
+        return NoAccessTime;
+    if (atime >= m_scanTime)
+        return 0;
+    return static_cast<quint16>(qMin<qint64>((m_scanTime - atime) / 86400, NoAccessTime - 1));
+}
+
+qint64 FileTree::unpackAccessDays(quint16 days) const
+{
+    return days == NoAccessTime ? 0 : m_scanTime - qint64(days) * 86400;
+}
+
+int FileTree::coldLevel(qint64 mtime, qint64 atime) const
+{
+    // Файл "трогали" при последнем изменении или чтении, смотря что позже
+    const qint64 age = m_scanTime - qMax(mtime, atime);
+    int level = 0;
+    while (level < ColdThresholdCount && age >= qint64(ColdThresholdDays[level]) * 86400)
+        ++level;
+    return level;
+}
+
+void FileTree::addContents(quint32 node, const Contents &contents)
+{
+    DirStats &stats = dirStats(node);
+    stats.bytes.fetch_add(contents.bytes, std::memory_order_relaxed);
+    stats.allocated.fetch_add(contents.allocated, std::memory_order_relaxed);
+    for (int i = 0; i < ColdThresholdCount; ++i)
+        stats.cold[i].fetch_add(contents.cold[i], std::memory_order_relaxed);
+    stats.files.fetch_add(contents.files, std::memory_order_relaxed);
+    stats.directories.fetch_add(contents.directories, std::memory_order_relaxed);
+    if (contents.directories > 0)
+        stats.pending.fetch_add(static_cast<quint32>(contents.directories), std::memory_order_relaxed);
+}
+
+void FileTree::finishListing(quint32 node, quint32 stopAt, QVector<quint32> *completed)
+{
+    // Последний поток, закрывший часть директории, переносит ее итоги в
+    // родителя и закрывает там одну часть; так подъем идет, пока есть готовые
+    while (node != InvalidNode) {
+        DirStats &stats = dirStats(node);
+        if (stats.pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        if (completed)
+            completed->append(node);
+
+        const quint32 parent = m_parent[node];
+        if (parent == InvalidNode || parent == stopAt)
+            return;
+
+        DirStats &parentStats = dirStats(parent);
+        parentStats.bytes.fetch_add(stats.bytes.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+        parentStats.allocated.fetch_add(stats.allocated.load(std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+        for (int i = 0; i < ColdThresholdCount; ++i) {
+            parentStats.cold[i].fetch_add(stats.cold[i].load(std::memory_order_relaxed),
+                                          std::memory_order_relaxed);
+        }
+        parentStats.files.fetch_add(stats.files.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+        parentStats.directories.fetch_add(stats.directories.load(std::memory_order_relaxed),
+                                          std::memory_order_relaxed);
+        node = parent;
+    }
+}
+
+void FileTree::setFileAttributes(quint32 node, qint64 size, qint64 allocated,
+                                 qint64 mtime, qint64 atime)
+{
+    m_size[node] = size;
+    setAllocated(node, allocated);
+    m_mtime[node] = packTime(mtime);
+    m_atime[node] = packAccessDays(atime);
+}
+
+void FileTree::relinkChildren(quint32 parent, QVector<quint32> children)
+{
+    // Список детей идет по возрастанию индексов, как после сканирования:
+    // на этом держатся проверка ссылок снимка и обходы в фоновых потоках,
+    // которые застали перестройку списка
+    std::sort(children.begin(), children.end());
+    for (int i = 0; i < children.size(); ++i) {
+        m_parent[children[i]] = parent;
+        m_nextSibling[children[i]].store(i + 1 < children.size() ? children[i + 1] : InvalidNode,
+                                         std::memory_order_release);
+    }
+    publishChildren(parent, children.isEmpty() ? InvalidNode : children.first());
+}
+
+void FileTree::markRemoved(quint32 node)
+{
+    QVector<quint32> stack;
+    stack.append(node);
+
+    while (!stack.isEmpty()) {
+        const quint32 current = stack.takeLast();
+        m_name[current].fetchOr(quint64(RemovedFlag) << 56);
+        for (quint32 child = firstChild(current); child != InvalidNode;
+             child = nextSibling(child)) {
+            stack.append(child);
+        }
+    }
+}
+
+void FileTree::updateTotals(quint32 node)
+{
+    Contents totals;
+    for (quint32 child = firstChild(node); child != InvalidNode; child = nextSibling(child)) {
+        if (isDirectory(child)) {
+            const DirStats &stats = dirStats(child);
+            totals.bytes += stats.bytes.load(std::memory_order_relaxed);
+            totals.allocated += stats.allocated.load(std::memory_order_relaxed);
+            for (int i = 0; i < ColdThresholdCount; ++i)
+                totals.cold[i] += stats.cold[i].load(std::memory_order_relaxed);
+            totals.files += stats.files.load(std::memory_order_relaxed);
+            totals.directories += stats.directories.load(std::memory_order_relaxed) + 1;
+        } else {
+            totals.addFile(m_size[child], fileAllocated(child),
+                           coldLevel(m_mtime[child], atime(child)));
+        }
+    }
+
+    // Разница применяется к самой директории и всем предкам; порядок
+    // обновления нескольких директорий поэтому не важен
+    DirStats &own = dirStats(node);
+    Contents delta;
+    delta.bytes = totals.bytes - own.bytes.load(std::memory_order_relaxed);
+    delta.allocated = totals.allocated - own.allocated.load(std::memory_order_relaxed);
+    for (int i = 0; i < ColdThresholdCount; ++i)
+        delta.cold[i] = totals.cold[i] - own.cold[i].load(std::memory_order_relaxed);
+    delta.files = totals.files - own.files.load(std::memory_order_relaxed);
+    delta.directories = totals.directories - own.directories.load(std::memory_order_relaxed);
+
+    for (quint32 current = node; current != InvalidNode; current = m_parent[current]) {
+        DirStats &stats = dirStats(current);
+        stats.bytes.fetch_add(delta.bytes, std::memory_order_relaxed);
+        stats.allocated.fetch_add(delta.allocated, std::memory_order_relaxed);
+        for (int i = 0; i < ColdThresholdCount; ++i)
+            stats.cold[i].fetch_add(delta.cold[i], std::memory_order_relaxed);
+        stats.files.fetch_add(delta.files, std::memory_order_relaxed);
+        stats.directories.fetch_add(delta.directories, std::memory_order_relaxed);
+    }
+}
+
+quint32 FileTree::findChild(quint32 parent, const QByteArray &name) const
+{
+    for (quint32 child = firstChild(parent); child != InvalidNode; child = nextSibling(child)) {
+        if (rawName(child) == name)
+            return child;
+    }
+    return InvalidNode;
+}
+
+const FileTree::DirStats &FileTree::dirStats(quint32 node) const
+{
+    // Строка итогов снимка за пределами таблицы читается как пустые итоги
+    static const DirStats empty = {};
+    const qint64 row = m_size[node];
+    if (isReadOnly() && (row < 0 || row >= m_dirCount.load(std::memory_order_relaxed)))
+        return empty;
+    return m_dirStats[row];
+}
+
+qint64 FileTree::totalSize(quint32 node) const
+{
+    if (!isDirectory(node))
+        return m_size[node];
+    return dirStats(node).bytes.load(std::memory_order_relaxed);
+}
+
+qint64 FileTree::totalAllocated(quint32 node) const
+{
+    if (!isDirectory(node))
+        return fileAllocated(node);
+    return dirStats(node).allocated.load(std::memory_order_relaxed);
+}
+
+qint64 FileTree::coldBytes(quint32 node, int threshold) const
+{
+    if (!isDirectory(node))
+        return coldLevel(m_mtime[node], atime(node)) > threshold ? qint64(m_size[node]) : 0;
+    return dirStats(node).cold[threshold].load(std::memory_order_relaxed);
+}
+
+quint64 FileTree::fileCount(quint32 node) const
+{
+    if (!isDirectory(node))
+        return 1;
+    return dirStats(node).files.load(std::memory_order_relaxed);
+}
+
+quint64 FileTree::directoryCount(quint32 node) const
+{
+    if (!isDirectory(node))
+        return 0;
+    return dirStats(node).directories.load(std::memory_order_relaxed);
+}
+
+bool FileTree::isComplete(quint32 node) const
+{
+    if (!isDirectory(node))
+        return true;
+    return dirStats(node).pending.load(std::memory_order_acquire) == 0;
+}
+
+quint64 FileTree::memoryUsage() const
+{
+    const quint64 perNode = sizeof(quint32) * 5 + sizeof(quint16) + sizeof(qint64) + sizeof(quint64);
+    return quint64(nodeCount()) * perNode + quint64(m_dirCount.load()) * sizeof(DirStats)
+           + (m_nameBlocks.load() << NameBlockBits);
+}
+
+bool FileTree::save(const QString &fileName, QString *errorString) const
+{
+    static_assert(sizeof(std::atomic<quint32>) == sizeof(quint32)
+                  && sizeof(Relaxed<quint16>) == sizeof(quint16)
+                  && sizeof(Relaxed<quint64>) == sizeof(quint64),
+                  "атомарные столбцы пишутся как обычные числа");
+
+    const QByteArray rootPath = m_rootPath.toUtf8();
+    const quint64 nodes = nodeCount();
+    const quint64 dirs = m_dirCount.load();
+    const quint64 nameBlocks = qMin<quint64>(m_nameBlocks.load(), NamePool::Capacity >> NameBlockBits);
+
+    // Размеры известны заранее, поэтому смещения вычисляются до записи
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SnapshotMagic, sizeof(header.magic));
+    header.version = SnapshotVersion;
+    header.byteOrder = SnapshotByteOrder;
+    header.nodeCount = static_cast<quint32>(nodes);
+    header.dirCount = static_cast<quint32>(dirs);
+    header.nameBlocks = nameBlocks;
+    header.scanTime = m_scanTime;
+    header.rootPathSize = rootPath.size();
+    header.sectionCount = SnapshotHeader::SectionCount;
+
+    header.size[SnapshotHeader::ParentSection] = nodes * sizeof(quint32);
+    header.size[SnapshotHeader::FirstChildSection] = nodes * sizeof(quint32);
+    header.size[SnapshotHeader::NextSiblingSection] = nodes * sizeof(quint32);
+    header.size[SnapshotHeader::SizeSection] = nodes * sizeof(qint64);
+    header.size[SnapshotHeader::MtimeSection] = nodes * sizeof(quint32);
+    header.size[SnapshotHeader::AtimeSection] = nodes * sizeof(quint16);
+    header.size[SnapshotHeader::AllocatedSection] = nodes * sizeof(quint32);
+    header.size[SnapshotHeader::NameSection] = nodes * sizeof(quint64);
+    header.size[SnapshotHeader::DirStatsSection] = dirs * sizeof(DirStats);
+    header.size[SnapshotHeader::NamePoolSection] = nameBlocks << NameBlockBits;
+
+    // Редкие атрибуты невелики и копируются в записи целиком
+    QByteArray largeAllocated;
+    QByteArray hardLinks;
+    {
+        QMutexLocker locker(&m_rareMutex);
+        QList<quint32> keys = m_largeAllocated.keys();
+        std::sort(keys.begin(), keys.end());
+        for (quint32 node : keys) {
+            if (node >= nodes)
+                continue;
+            const LargeAllocatedRecord record{node, 0, m_largeAllocated.value(node)};
+            largeAllocated.append(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+
+        keys = m_hardLinks.keys();
+        std::sort(keys.begin(), keys.end());
+        for (quint32 node : keys) {
+            if (node >= nodes)
+                continue;
+            const HardLink &link = m_hardLinks[node];
+            const HardLinkRecord record{node, link.links, link.device, link.inode, link.allocated};
+            hardLinks.append(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+    }
+    header.size[SnapshotHeader::LargeAllocatedSection] = largeAllocated.size();
+    header.size[SnapshotHeader::HardLinkSection] = hardLinks.size();
+
+    quint64 offset = sizeof(header) + rootPath.size();
+    for (int i = 0; i < SnapshotHeader::SectionCount; ++i) {
+        header.offset[i] = alignOffset(offset);
+        offset = header.offset[i] + header.size[i];
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        setError(errorString, file.errorString());
+        return false;
+    }
+
+    bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header)
+              && file.write(rootPath) == rootPath.size();
+    offset = sizeof(header) + rootPath.size();
+
+    for (int i = 0; ok && i < SnapshotHeader::SectionCount; ++i) {
+        ok = writePadding(file, offset);
+        if (!ok)
+            break;
+
+        switch (i) {
+        case SnapshotHeader::ParentSection:      ok = writeColumn(file, m_parent, nodes); break;
+        case SnapshotHeader::FirstChildSection:  ok = writeColumn(file, m_firstChild, nodes); break;
+        case SnapshotHeader::NextSiblingSection: ok = writeColumn(file, m_nextSibling, nodes); break;
+        case SnapshotHeader::SizeSection:        ok = writeColumn(file, m_size, nodes); break;
+        case SnapshotHeader::MtimeSection:       ok = writeColumn(file, m_mtime, nodes); break;
+        case SnapshotHeader::AtimeSection:       ok = writeColumn(file, m_atime, nodes); break;
+        case SnapshotHeader::AllocatedSection:   ok = writeColumn(file, m_allocated, nodes); break;
+        case SnapshotHeader::NameSection:        ok = writeColumn(file, m_name, nodes); break;
+        case SnapshotHeader::DirStatsSection:    ok = writeColumn(file, m_dirStats, dirs); break;
+        case SnapshotHeader::NamePoolSection:
+            ok = writeColumn(file, m_names, header.size[SnapshotHeader::NamePoolSection]);
+            break;
+        case SnapshotHeader::LargeAllocatedSection:
+            ok = file.write(largeAllocated) == largeAllocated.size();
+            break;
+        case SnapshotHeader::HardLinkSection:
+            ok = file.write(hardLinks) == hardLinks.size();
+            break;
+        }
+        offset = header.offset[i] + header.size[i];
+    }
+
+    if (!ok) {
+        setError(errorString, file.errorString());
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit()) {
+        setError(errorString, file.errorString());
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<FileTree> FileTree::load(const QString &fileName, QString *errorString)
+{
+    std::unique_ptr<QFile> file(new QFile(fileName));
+    if (!file->open(QIODevice::ReadOnly)) {
+        setError(errorString, file->errorString());
+        return nullptr;
+    }
+
+    // Частное отображение: страницы читаются по мере обращения, а случайная
+    // запись не дойдет до файла
+    const qint64 fileSize = file->size();
+    uchar *base = fileSize >= qint64(sizeof(SnapshotHeader))
+                  ? file->map(0, fileSize, QFileDevice::MapPrivateOption) : nullptr;
+    if (!base) {
+        setError(errorString, "Файл не является снимком сканирования");
+        return nullptr;
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, SnapshotMagic, sizeof(header.magic)) != 0
+        || header.byteOrder != SnapshotByteOrder) {
+        setError(errorString, "Файл не является снимком сканирования");
+        return nullptr;
+    }
+    if (header.version != SnapshotVersion || header.sectionCount != SnapshotHeader::SectionCount) {
+        setError(errorString, QString("Неподдерживаемая версия снимка: %1").arg(header.version));
+        return nullptr;
+    }
+
+    // Проверяются только границы участков; содержимое столбцов не разбирается
+    bool valid = header.nodeCount > 0 && header.nodeCount < InvalidNode
+                 && sizeof(header) + header.rootPathSize <= quint64(fileSize);
+    for (int i = 0; valid && i < SnapshotHeader::SectionCount; ++i) {
+        valid = header.offset[i] <= quint64(fileSize)
+                && header.size[i] <= quint64(fileSize) - header.offset[i];
+    }
+
+    std::shared_ptr<FileTree> tree(new FileTree());
+    const quint64 nodes = header.nodeCount;
+    valid = valid
+            && adoptColumn(tree->m_parent, base, header, SnapshotHeader::ParentSection, nodes)
+            && adoptColumn(tree->m_firstChild, base, header, SnapshotHeader::FirstChildSection, nodes)
+            && adoptColumn(tree->m_nextSibling, base, header, SnapshotHeader::NextSiblingSection, nodes)
+            && adoptColumn(tree->m_size, base, header, SnapshotHeader::SizeSection, nodes)
+            && adoptColumn(tree->m_mtime, base, header, SnapshotHeader::MtimeSection, nodes)
+            && adoptColumn(tree->m_atime, base, header, SnapshotHeader::AtimeSection, nodes)
+            && adoptColumn(tree->m_allocated, base, header, SnapshotHeader::AllocatedSection, nodes)
+            && adoptColumn(tree->m_name, base, header, SnapshotHeader::NameSection, nodes)
+            && adoptColumn(tree->m_dirStats, base, header, SnapshotHeader::DirStatsSection, header.dirCount)
+            && adoptColumn(tree->m_names, base, header, SnapshotHeader::NamePoolSection,
+                           header.nameBlocks << NameBlockBits);
+    if (!valid) {
+        setError(errorString, "Снимок поврежден");
+        return nullptr;
+    }
+
+    tree->m_rootPath = QString::fromUtf8(reinterpret_cast<const char *>(base + sizeof(header)),
+                                         header.rootPathSize);
+    tree->m_scanTime = header.scanTime;
+    tree->m_nodeCount.store(header.nodeCount);
+    tree->m_readyBlocks.store(static_cast<quint32>(
+        (quint64(header.nodeCount) + (quint64(1) << NodeBlockBits) - 1) >> NodeBlockBits));
+    tree->m_dirCount.store(header.dirCount);
+    tree->m_nameBlocks.store(header.nameBlocks);
+    tree->m_snapshot = std::move(file);
+
+    if (!tree->loadRareAttributes(base, header.offset[SnapshotHeader::LargeAllocatedSection],
+                                  header.size[SnapshotHeader::LargeAllocatedSection],
+                                  header.offset[SnapshotHeader::HardLinkSection],
+                                  header.size[SnapshotHeader::HardLinkSection])
+        || !tree->isDirectory(tree->root())) {
+        setError(errorString, "Снимок поврежден");
+        return nullptr;
+    }
+    return tree;
+}
+
+bool FileTree::loadRareAttributes(const uchar *base, quint64 largeOffset, quint64 largeSize,
+                                  quint64 linksOffset, quint64 linksSize)
+{
+    if (largeSize % sizeof(LargeAllocatedRecord) != 0 || linksSize % sizeof(HardLinkRecord) != 0)
+        return false;
+
+    const quint32 count = nodeCount();
+    for (quint64 offset = 0; offset < largeSize; offset += sizeof(LargeAllocatedRecord)) {
+        LargeAllocatedRecord record;
+        memcpy(&record, base + largeOffset + offset, sizeof(record));
+        if (record.node >= count)
+            return false;
+        m_largeAllocated.insert(record.node, record.bytes);
+    }
+    for (quint64 offset = 0; offset < linksSize; offset += sizeof(HardLinkRecord)) {
+        HardLinkRecord record;
+        memcpy(&record, base + linksOffset + offset, sizeof(record));
+        if (record.node >= count)
+            return false;
+        m_hardLinks.insert(record.node, {record.device, record.inode, record.allocated, record.links});
+    }
+    return true;
+}
@@ -0,0 +1,349 @@
+#ifndef FILETREE_H
+#define FILETREE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "chunkedarray.h"
+
+class QFile;
+class QIODevice;
+
+// Компактное дерево результатов сканирования.
+//
+// Узлы хранятся по столбцам (structure of arrays) в блочных массивах:
+// индексы родителя, первого ребенка и следующего соседа, размер, упакованные
+// времена изменения и доступа, место на диске и ссылка на имя. Имена лежат
+// подряд в общем пуле байтов. Полный путь не хранится и собирается по
+// ссылкам на родителя. Узел занимает 38 байт плюс длина имени.
+//
+// Дерево строится без блокировок: поток, прочитавший директорию, выделяет
+// непрерывный диапазон узлов под всех ее детей, заполняет их у себя и
+// публикует одним атомарным присваиванием первого ребенка родителю.
+// Читатели, дошедшие до узла по ссылкам, видят его полностью заполненным.
+//
+// После сканирования дерево меняет слежение, пока его читают фоновые задачи
+// (поиск, дубликаты, раскладка). Поэтому изменяемые столбцы атомарны:
+// значения читаются и пишутся без упорядочивания, а ссылка на соседа -
+// с release/acquire, чтобы новый узел был виден заполненным. Списки детей
+// идут по возрастанию индексов и после перестройки, так что обход,
+// застигнутый ею посередине, может пропустить узел, но не зациклится.
+//
+// Размер файла - видимый (st_size), место на диске - выделенные блоки
+// (st_blocks). У жестких ссылок на один inode место на диске учитывается
+// только у первой найденной, как в du; видимый размер - у каждой.
+// Редкие атрибуты не занимают места в каждом узле: место больше 2 ТБ и
+// inode файлов с несколькими ссылками лежат в хеш-таблицах под мьютексом.
+//
+// Итоги по поддереву (байты, место, файлы, директории, "холодные" байты по
+// порогам возраста) хранятся в отдельной таблице директорий; у директории
+// столбец размера хранит индекс ее строки. Итоги переносятся в родителя,
+// когда директория дочитана вместе со всеми поддиректориями, поэтому чтение
+// итогов стоит O(1) и во время сканирования.
+//
+// Готовое дерево сохраняется в двоичный снимок: заголовок, затем каждый
+// столбец одним непрерывным участком. Снимок открывается через отображение
+// файла в память, столбцы ссылаются прямо на него без разбора узлов.
+// Дерево, загруженное из снимка, только для чтения.
+class FileTree
+{
+public:
+    static constexpr quint32 InvalidNode = 0xFFFFFFFFu;
+
+    // Текущий блок пула имен, принадлежащий одному потоку
+    struct NameCursor
+    {
+        quint64 next = 0;
+        quint64 end = 0;
+    };
+
+    explicit FileTree(const QString &rootPath);
+    ~FileTree();
+
+    FileTree(const FileTree &) = delete;
+    FileTree &operator=(const FileTree &) = delete;
+
+    // Снимок пишется потоково, по блокам столбцов, через QSaveFile.
+    // Вызывать после завершения сканирования
+    bool save(const QString &fileName, QString *errorString = nullptr) const;
+    static std::shared_ptr<FileTree> load(const QString &fileName,
+                                          QString *errorString = nullptr);
+    static constexpr quint32 SnapshotVersion = 7;
+
+    quint32 root() const { return 0; }
+    // Число выделенных узлов, блоки столбцов под которыми уже созданы; часть
+    // последних может быть еще не заполнена (нули) и не опубликована
+    quint32 nodeCount() const
+    {
+        const quint64 ready = quint64(m_readyBlocks.load(std::memory_order_acquire)) << NodeBlockBits;
+        return static_cast<quint32>(qMin<quint64>(m_nodeCount.load(std::memory_order_acquire), ready));
+    }
+    QString rootPath() const { return m_rootPath; }
+    // Время создания дерева (начала сканирования), секунды от начала эпохи
+    qint64 scanTime() const { return m_scanTime; }
+    bool isReadOnly() const { return m_snapshot != nullptr; }
+
+    // Выделяет count подряд идущих узлов, возвращает индекс первого
+    quint32 allocateNodes(quint32 count);
+
+    // Заполняет выделенный, но еще не опубликованный узел. allocated - место
+    // файла на диске в байтах, у директорий не используется
+    bool initNode(quint32 node, quint32 parent, quint32 nextSibling,
+                  const char *name, int nameLength, qint64 size, qint64 allocated,
+                  qint64 mtime, qint64 atime, bool isDirectory, NameCursor &cursor);
+
+    // Пороги "холодных" данных: дни без изменения и без чтения к моменту
+    // сканирования. Итоги хранят байты старше каждого порога
+    static constexpr int ColdThresholdCount = 3;
+    static constexpr int ColdThresholdDays[ColdThresholdCount] = {30, 90, 365};
+
+    // Собственное содержимое директории, которое она передает в итоги
+    struct Contents
+    {
+        qint64 bytes = 0;
+        qint64 allocated = 0;
+        quint64 files = 0;
+        quint64 directories = 0;
+        qint64 cold[ColdThresholdCount] = {};
+
+        void addFile(qint64 size, qint64 allocatedSize, int coldLevel)
+        {
+            bytes += size;
+            allocated += allocatedSize;
+            ++files;
+            for (int i = 0; i < coldLevel; ++i)
+                cold[i] += size;
+        }
+    };
+
+    // Сколько порогов возраста файл прошел к моменту сканирования
+    int coldLevel(qint64 mtime, qint64 atime) const;
+
+    // Добавляет к итогам директории ее собственное содержимое. Вызывается до
+    // того, как поддиректории станут видны другим потокам
+    void addContents(quint32 node, const Contents &contents);
+    // Отмечает, что сама директория дочитана; если готовы и все поддиректории,
+    // итоги поднимаются к предкам (но не в stopAt и выше). Директории, чьи
+    // поддеревья при этом закрылись, дописываются в completed
+    void finishListing(quint32 node, quint32 stopAt = InvalidNode,
+                       QVector<quint32> *completed = nullptr);
+
+    // Делает цепочку детей, начинающуюся с firstChild, видимой читателям
+    void publishChildren(quint32 parent, quint32 firstChild)
+    {
+        m_firstChild[parent].store(firstChild, std::memory_order_release);
+    }
+
+    // Снимок при загрузке не разбирается, поэтому его ссылки проверяются при
+    // чтении: родитель всегда создан раньше узла, а дети и соседи - позже
+    // (списки детей идут по возрастанию индексов). Ссылка, нарушающая это,
+    // читается как InvalidNode, и любой обход поврежденного снимка конечен
+    quint32 parent(quint32 node) const
+    {
+        const quint32 value = m_parent[node];
+        return !isReadOnly() || value < node ? value : InvalidNode;
+    }
+    quint32 firstChild(quint32 node) const
+    {
+        return checkedLink(node, m_firstChild[node].load(std::memory_order_acquire));
+    }
+    quint32 nextSibling(quint32 node) const
+    {
+        return checkedLink(node, m_nextSibling[node].load(std::memory_order_acquire));
+    }
+    qint64 size(quint32 node) const { return isDirectory(node) ? 0 : qint64(m_size[node]); }
+    qint64 allocatedSize(quint32 node) const { return isDirectory(node) ? 0 : fileAllocated(node); }
+    qint64 mtime(quint32 node) const { return m_mtime[node]; }
+    // Время доступа с точностью до суток (см. packAccessDays)
+    qint64 atime(quint32 node) const { return unpackAccessDays(m_atime[node]); }
+    bool isDirectory(quint32 node) const { return nameFlags(m_name[node]) & DirectoryFlag; }
+
+    void setMtime(quint32 node, qint64 mtime) { m_mtime[node] = packTime(mtime); }
+
+    // Файл с несколькими жесткими ссылками: inode и собственное место на
+    // диске до учета ссылок. По ним повторное сканирование, взявшее состав
+    // директории из baseline, заново решает, какая ссылка учитывает место.
+    // Можно вызывать из рабочих потоков
+    struct HardLink
+    {
+        quint64 device = 0;
+        quint64 inode = 0;
+        qint64 allocated = 0;
+        quint32 links = 0;
+    };
+    void setHardLink(quint32 node, const HardLink &link);
+    bool hardLink(quint32 node, HardLink *link) const;
+
+    // Изменение готового дерева (слежение за файловой системой). Вызывать из
+    // одного потока; фоновые задачи могут в это время читать дерево. Новые узлы по-прежнему
+    // выделяются через allocateNodes/initNode. Удаленные узлы остаются в
+    // арене с пометкой, но исключаются из списков детей
+    void setFileAttributes(quint32 node, qint64 size, qint64 allocated,
+                           qint64 mtime, qint64 atime);
+    void relinkChildren(quint32 parent, QVector<quint32> children);
+    void markRemoved(quint32 node);
+    bool isRemoved(quint32 node) const { return nameFlags(m_name[node]) & RemovedFlag; }
+
+    // Директория, в которую сканер не спускался по правилам исключения:
+    // узел есть, но детей и итогов у нее нет. Помечается до публикации
+    void markExcluded(quint32 node) { m_name[node].fetchOr(quint64(ExcludedFlag) << 56); }
+    bool isExcluded(quint32 node) const { return nameFlags(m_name[node]) & ExcludedFlag; }
+    // Пересчитывает итоги директории по ее детям и переносит разницу предкам
+    void updateTotals(quint32 node);
+    quint32 findChild(quint32 parent, const QByteArray &name) const;
+
+    // Отпечаток директории для повторного сканирования: по совпадению inode,
+    // mtime и ctime можно не перечитывать ее содержимое
+    void setDirectoryStamp(quint32 node, quint64 inode, qint64 ctime);
+    quint64 directoryInode(quint32 node) const { return dirStats(node).inode; }
+    qint64 directoryCtime(quint32 node) const { return dirStats(node).ctime; }
+
+    // Имя без копирования: данные остаются в пуле
+    QByteArray rawName(quint32 node) const;
+    // То же без создания QByteArray, для обхода миллионов имен; length = 0
+    // у пустого имени
+    const char *nameData(quint32 node, int *length) const;
+    QString name(quint32 node) const;
+    // Побайтовое сравнение имен прямо в пуле, без копирования
+    int compareNames(quint32 a, quint32 b) const;
+    QString path(quint32 node) const;
+
+    // Итоги поддерева. Пока директория не готова, в них учтено ее собственное
+    // содержимое и завершенные поддиректории
+    qint64 totalSize(quint32 node) const;
+    qint64 totalAllocated(quint32 node) const;
+    // Байты поддерева старше порога ColdThresholdDays[threshold]
+    qint64 coldBytes(quint32 node, int threshold) const;
+    quint64 fileCount(quint32 node) const;
+    quint64 directoryCount(quint32 node) const;
+    bool isComplete(quint32 node) const;
+
+    // Приблизительный объем памяти под узлы и имена
+    quint64 memoryUsage() const;
+
+    // Время хранится как беззнаковые секунды от начала эпохи (до 2106 года)
+    static quint32 packTime(qint64 seconds);
+    // Время доступа нужно только для порогов в целых днях, поэтому хранится
+    // как число полных суток до начала сканирования: 16 бит вместо 32.
+    // Пороги по нему срабатывают так же, как по точному времени; доступ
+    // после начала сканирования - это 0 суток
+    static constexpr quint16 NoAccessTime = 0xFFFF;
+    quint16 packAccessDays(qint64 atime) const;
+    qint64 unpackAccessDays(quint16 days) const;
+
+private:
+    // Ячейка столбца, который меняет слежение: атомарное значение с
+    // чтением и записью без упорядочивания (на x86 - обычные mov)
+    template <typename T>
+    class Relaxed
+    {
+    public:
+        Relaxed() : m_value(T()) {}
+        operator T() const { return m_value.load(std::memory_order_relaxed); }
+        Relaxed &operator=(T value)
+        {
+            m_value.store(value, std::memory_order_relaxed);
+            return *this;
+        }
+        void fetchOr(T bits) { m_value.fetch_or(bits, std::memory_order_relaxed); }
+
+    private:
+        std::atomic<T> m_value;
+    };
+
+    enum NodeFlag : quint8 {
+        DirectoryFlag = 0x1,
+        RemovedFlag = 0x2,
+        ExcludedFlag = 0x4
+    };
+
+    // Ссылка на имя упакована в 64 бита: флаги (8), длина (16), смещение в пуле (40)
+    static quint64 packName(quint64 offset, int length, quint8 flags)
+    {
+        return (quint64(flags) << 56) | (quint64(length) << 40) | offset;
+    }
+    static quint64 nameOffset(quint64 ref) { return ref & ((quint64(1) << 40) - 1); }
+    static int nameLength(quint64 ref) { return static_cast<int>((ref >> 40) & 0xFFFF); }
+    static quint8 nameFlags(quint64 ref) { return static_cast<quint8>(ref >> 56); }
+
+    // Место на диске хранится в 512-байтных блоках, как st_blocks. Файлы от
+    // 2 ТБ получают в столбце метку, а байты - в m_largeAllocated
+    static constexpr quint32 AllocatedOverflow = 0xFFFFFFFFu;
+    void setAllocated(quint32 node, qint64 bytes);
+    qint64 fileAllocated(quint32 node) const
+    {
+        const quint32 blocks = m_allocated[node];
+        return blocks != AllocatedOverflow ? qint64(blocks) * 512 : largeAllocated(node);
+    }
+    qint64 largeAllocated(quint32 node) const;
+
+    // Итоги поддерева директории. pending - число еще не готовых частей:
+    // собственный листинг плюс каждая поддиректория. inode и ctime пишет
+    // поток, читающий директорию, или слежение
+    struct DirStats
+    {
+        std::atomic<qint64> bytes;
+        std::atomic<qint64> allocated;
+        std::atomic<qint64> cold[ColdThresholdCount];
+        std::atomic<quint64> files;
+        std::atomic<quint64> directories;
+        std::atomic<quint32> pending;
+        Relaxed<quint64> inode;
+        Relaxed<qint64> ctime;
+    };
+
+    DirStats &dirStats(quint32 node) { return m_dirStats[m_size[node]]; }
+    const DirStats &dirStats(quint32 node) const;
+
+    quint32 checkedLink(quint32 node, quint32 value) const
+    {
+        if (isReadOnly() && (value <= node || value >= m_nodeCount.load(std::memory_order_relaxed)))
+            return InvalidNode;
+        return value;
+    }
+
+    FileTree();
+
+    bool storeName(const char *name, int length, NameCursor &cursor, quint64 *offset);
+    // Таблицы редких атрибутов из снимка копируются в хеш-таблицы
+    bool loadRareAttributes(const uchar *base, quint64 largeOffset, quint64 largeSize,
+                            quint64 linksOffset, quint64 linksSize);
+
+    // Столбцы узлов: блоки по 64 К узлов
+    static constexpr int NodeBlockBits = 16;
+
+    // Пул имен: блоки по 256 КБ, каждый поток заполняет свой блок,
+    // имя никогда не пересекает границу блока
+    static constexpr int NameBlockBits = 18;
+    using NamePool = ChunkedArray<char, NameBlockBits, (1 << 17)>;
+
+    QString m_rootPath;
+    qint64 m_scanTime;
+    std::unique_ptr<QFile> m_snapshot;  // Отображенный файл снимка
+    std::atomic<quint32> m_nodeCount;     // Зарезервировано узлов
+    std::atomic<quint32> m_readyBlocks;   // Блоков узлов, созданных во всех столбцах подряд с начала
+    std::atomic<quint64> m_nameBlocks;
+    std::atomic<quint32> m_dirCount;
+
+    ChunkedArray<Relaxed<quint32>, NodeBlockBits> m_parent;
+    ChunkedArray<std::atomic<quint32>, NodeBlockBits> m_firstChild;
+    ChunkedArray<std::atomic<quint32>, NodeBlockBits> m_nextSibling;
+    ChunkedArray<Relaxed<qint64>, NodeBlockBits> m_size;
+    ChunkedArray<Relaxed<quint32>, NodeBlockBits> m_mtime;
+    ChunkedArray<Relaxed<quint16>, NodeBlockBits> m_atime;
+    ChunkedArray<Relaxed<quint32>, NodeBlockBits> m_allocated;
+    ChunkedArray<Relaxed<quint64>, NodeBlockBits> m_name;
+    NamePool m_names;
+    ChunkedArray<DirStats, 14, (1 << 18)> m_dirStats;
+
+    QMutex m_blockMutex;  // Только для создания новых блоков узлов
+    mutable QMutex m_rareMutex;
+    QHash<quint32, qint64> m_largeAllocated;
+    QHash<quint32, HardLink> m_hardLinks;
+};
+
+#endif // FILETREE_H
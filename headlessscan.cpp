@@ -0,0 +1,259 @@
+#include "headlessscan.h"
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+#include <cstdio>
+
+// Вывод копится в буфере и сбрасывается раз за снимок прогресса
+static constexpr int FlushThreshold = 64 * 1024;
+
+static QByteArray csvField(const QString &value)
+{
+    if (!value.contains(',') && !value.contains('"') && !value.contains('\n'))
+        return value.toUtf8();
+
+    QString quoted = value;
+    quoted.replace('"', "\"\"");
+    return '"' + quoted.toUtf8() + '"';
+}
+
+static QByteArray csvNumber(qint64 value)
+{
+    return value < 0 ? QByteArray() : QByteArray::number(value);
+}
+
+// Имя поля холодных байт для порога: cold30d, cold90d, ...
+static QString coldField(int threshold)
+{
+    return QString("cold%1d").arg(FileTree::ColdThresholdDays[threshold]);
+}
+
+HeadlessScan::HeadlessScan(const Options &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_scanner(new Scanner(options.rootPath, this))
+{
+    m_out.open(stdout, QIODevice::WriteOnly);
+
+    m_scanner->setThreadCount(options.threads);
+    m_scanner->setMaxDepth(options.maxDepth);
+    m_scanner->setUseIoUring(options.useIoUring);
+    m_scanner->setCollectStats(!options.statsFile.isEmpty());
+
+    ScanFilter filter;
+    filter.setExcludePatterns(options.exclude);
+    filter.setOneFileSystem(options.oneFileSystem);
+    filter.setSkippedTypes(options.skipTypes);
+    m_scanner->setFilter(filter);
+
+    // Если нужны только итоги директорий, узлы файлов не хранятся и память
+    // растет лишь с числом директорий (а с ограничением глубины - не растет
+    // вовсе за ее пределами)
+    const bool needFiles = options.largestFiles > 0 || options.listFiles
+                           || !options.snapshotFile.isEmpty();
+    m_scanner->setRetainFiles(needFiles);
+    if (options.largestFiles > 0) {
+        m_scanner->setLargestFilesCount(options.largestFiles);
+    }
+
+    // Группировки идут в порядке groupBy; их итоги выводятся по окончании
+    for (const QString &grouping : options.groupBy) {
+        if (grouping == "ext")
+            m_scanner->addAggregator(std::make_shared<ExtensionAggregator>());
+        else if (grouping == "owner")
+            m_scanner->addAggregator(std::make_shared<OwnerAggregator>(OwnerAggregator::User));
+        else if (grouping == "group")
+            m_scanner->addAggregator(std::make_shared<OwnerAggregator>(OwnerAggregator::Group));
+    }
+
+    connect(m_scanner, &Scanner::progress, this, &HeadlessScan::onProgress);
+    connect(m_scanner, &Scanner::finished, this, &HeadlessScan::onFinished);
+    connect(m_scanner, &Scanner::error, this, [](const QString &message) {
+        std::fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+    });
+}
+
+void HeadlessScan::start()
+{
+    if (!QFileInfo(m_options.rootPath).isDir()) {
+        std::fprintf(stderr, "Директория не существует: %s\n",
+                     m_options.rootPath.toLocal8Bit().constData());
+        emit done(1);
+        return;
+    }
+
+    if (m_options.format == Csv) {
+        m_buffer += "type,path,size,allocated,files,directories,mtime,rank";
+        for (int i = 0; i < FileTree::ColdThresholdCount; ++i)
+            m_buffer += ',' + coldField(i).toUtf8();
+        m_buffer += '\n';
+    }
+
+    m_elapsed.start();
+    m_scanner->start();
+    m_tree = m_scanner->tree();
+}
+
+void HeadlessScan::onProgress(const ScanProgress &progress)
+{
+    if (!m_tree) return;
+
+    // Файлы выводятся, как только дочитана их директория
+    if (m_options.listFiles) {
+        for (quint32 dir : progress.finishedDirectories) {
+            for (quint32 child = m_tree->firstChild(dir); child != FileTree::InvalidNode;
+                 child = m_tree->nextSibling(child)) {
+                if (m_tree->isDirectory(child))
+                    continue;
+
+                Record record;
+                record.type = "file";
+                record.path = m_tree->path(child);
+                record.size = m_tree->size(child);
+                record.allocated = m_tree->allocatedSize(child);
+                record.mtime = m_tree->mtime(child);
+                writeRecord(record);
+            }
+        }
+    }
+
+    // Директории - когда посчитано все их поддерево
+    for (quint32 dir : progress.completedDirectories) {
+        writeDirectory(dir);
+    }
+
+    flush();
+}
+
+void HeadlessScan::onFinished(std::shared_ptr<FileTree> tree)
+{
+    if (m_options.largestFiles > 0) {
+        const QVector<TopFiles::Entry> largest = m_scanner->largestFiles();
+        const int count = qMin(m_options.largestFiles, largest.size());
+        for (int i = 0; i < count; ++i) {
+            Record record;
+            record.type = "largest";
+            record.path = tree->path(largest[i].node);
+            record.size = largest[i].size;
+            record.allocated = tree->allocatedSize(largest[i].node);
+            record.mtime = tree->mtime(largest[i].node);
+            record.rank = i + 1;
+            writeRecord(record);
+        }
+    }
+
+    // Ключ группировки выводится в поле path, тип записи - имя группировки
+    const QVector<std::shared_ptr<Aggregator>> aggregates = m_scanner->aggregates();
+    for (int i = 0; i < aggregates.size(); ++i) {
+        for (const AggregateRow &row : aggregates[i]->rows()) {
+            Record record;
+            record.type = m_options.groupBy[i];
+            record.path = row.key;
+            record.size = row.bytes;
+            record.allocated = row.allocated;
+            record.files = row.files;
+            writeRecord(record);
+        }
+    }
+
+    Record summary;
+    summary.type = "summary";
+    summary.path = tree->rootPath();
+    summary.size = tree->totalSize(tree->root());
+    summary.allocated = tree->totalAllocated(tree->root());
+    summary.files = tree->fileCount(tree->root());
+    summary.directories = tree->directoryCount(tree->root());
+    for (int i = 0; i < FileTree::ColdThresholdCount; ++i)
+        summary.cold[i] = tree->coldBytes(tree->root(), i);
+    writeRecord(summary);
+    flush();
+
+    qDebug() << "Сканирование заняло" << m_elapsed.elapsed() << "мс, память дерева:"
+             << tree->memoryUsage() << "байт";
+
+    int exitCode = 0;
+    if (!m_options.snapshotFile.isEmpty()) {
+        QString errorString;
+        if (!tree->save(m_options.snapshotFile, &errorString)) {
+            std::fprintf(stderr, "Не удалось сохранить снимок: %s\n",
+                         errorString.toLocal8Bit().constData());
+            exitCode = 1;
+        }
+    }
+
+    if (!m_options.statsFile.isEmpty()) {
+        QSaveFile file(m_options.statsFile);
+        if (!file.open(QIODevice::WriteOnly)
+            || file.write(QJsonDocument(m_scanner->stats().toJson()).toJson()) < 0
+            || !file.commit()) {
+            std::fprintf(stderr, "Не удалось сохранить статистику: %s\n",
+                         file.errorString().toLocal8Bit().constData());
+            exitCode = 1;
+        }
+    }
+
+    emit done(exitCode);
+}
+
+void HeadlessScan::writeDirectory(quint32 node)
+{
+    // Исключенная директория не обходилась, итогов у нее нет
+    Record record;
+    record.path = m_tree->path(node);
+    if (m_tree->isExcluded(node)) {
+        record.type = "excluded";
+        writeRecord(record);
+        return;
+    }
+
+    record.type = "directory";
+    record.size = m_tree->totalSize(node);
+    record.allocated = m_tree->totalAllocated(node);
+    record.files = m_tree->fileCount(node);
+    record.directories = m_tree->directoryCount(node);
+    record.mtime = m_tree->mtime(node);
+    for (int i = 0; i < FileTree::ColdThresholdCount; ++i)
+        record.cold[i] = m_tree->coldBytes(node, i);
+    writeRecord(record);
+}
+
+void HeadlessScan::writeRecord(const Record &record)
+{
+    if (m_options.format == Csv) {
+        m_buffer += csvField(record.type) + ',' + csvField(record.path) + ','
+                    + csvNumber(record.size) + ',' + csvNumber(record.allocated) + ','
+                    + csvNumber(record.files) + ','
+                    + csvNumber(record.directories) + ',' + csvNumber(record.mtime) + ','
+                    + csvNumber(record.rank);
+        for (qint64 cold : record.cold)
+            m_buffer += ',' + csvNumber(cold);
+        m_buffer += '\n';
+    } else {
+        QJsonObject object;
+        object.insert("type", record.type);
+        object.insert("path", record.path);
+        if (record.size >= 0) object.insert("size", record.size);
+        if (record.allocated >= 0) object.insert("allocated", record.allocated);
+        if (record.files >= 0) object.insert("files", record.files);
+        if (record.directories >= 0) object.insert("directories", record.directories);
+        if (record.mtime >= 0) object.insert("mtime", record.mtime);
+        if (record.rank >= 0) object.insert("rank", record.rank);
+        for (int i = 0; i < FileTree::ColdThresholdCount; ++i) {
+            if (record.cold[i] >= 0) object.insert(coldField(i), record.cold[i]);
+        }
+        m_buffer += QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+    }
+
+    if (m_buffer.size() >= FlushThreshold)
+        flush();
+}
+
+void HeadlessScan::flush()
+{
+    if (m_buffer.isEmpty()) return;
+    m_out.write(m_buffer);
+    m_out.flush();
+    m_buffer.clear();
+}
@@ -0,0 +1,79 @@
+#ifndef HEADLESSSCAN_H
+#define HEADLESSSCAN_H
+
+#include <QObject>
+#include <QFile>
+#include <QElapsedTimer>
+#include <memory>
+#include "scanner.h"
+
+// Сканирование без графического интерфейса: результаты пишутся в stdout
+// по мере готовности, в виде JSON-строк или CSV
+class HeadlessScan : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format {
+        JsonLines,
+        Csv
+    };
+
+    struct Options
+    {
+        QString rootPath;
+        int threads = 0;          // 0 - по числу ядер
+        int maxDepth = -1;        // Глубже директории выводятся в итогах предка
+        int largestFiles = 0;     // Сколько самых больших файлов вывести в конце
+        Format format = JsonLines;
+        bool listFiles = false;   // Выводить каждый файл
+        bool useIoUring = false;
+        QString snapshotFile;     // Куда сохранить снимок по окончании
+        QString statsFile;        // Куда сохранить статистику сканирования (JSON)
+        QStringList groupBy;      // Итоги по ext, owner, group в конце вывода
+        QStringList exclude;      // Шаблоны исключения директорий (ScanFilter)
+        bool oneFileSystem = false;
+        QStringList skipTypes;    // Типы файловых систем, в которые не спускаться
+    };
+
+    // Допустимые значения groupBy
+    static QStringList groupings() { return {"ext", "owner", "group"}; }
+
+    explicit HeadlessScan(const Options &options, QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    void done(int exitCode);
+
+private:
+    // Одна строка вывода; отрицательные поля не выводятся
+    struct Record
+    {
+        QString type;
+        QString path;
+        qint64 size = -1;
+        qint64 allocated = -1;    // Место на диске
+        qint64 files = -1;
+        qint64 directories = -1;
+        qint64 mtime = -1;
+        int rank = -1;
+        // Байты старше порогов FileTree::ColdThresholdDays
+        qint64 cold[FileTree::ColdThresholdCount] = {-1, -1, -1};
+    };
+
+    void onProgress(const ScanProgress &progress);
+    void onFinished(std::shared_ptr<FileTree> tree);
+    void writeDirectory(quint32 node);
+    void writeRecord(const Record &record);
+    void flush();
+
+    Options m_options;
+    Scanner *m_scanner;
+    std::shared_ptr<FileTree> m_tree;
+    QFile m_out;
+    QByteArray m_buffer;
+    QElapsedTimer m_elapsed;
+};
+
+#endif // HEADLESSSCAN_H
@@ -0,0 +1,39 @@
+#include "inodeset.h"
+
+quint64 InodeSet::mix(const Key &key)
+{
+    // Финализатор splitmix64: номера inode идут подряд, а сегмент
+    // выбирается по старшим битам, поэтому их нужно перемешать
+    quint64 value = key.inode ^ (key.device * 0x9e3779b97f4a7c15ULL);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+bool InodeSet::insert(quint64 device, quint64 inode)
+{
+    static_assert(ShardCount == 64, "сегмент выбирается по старшим 6 битам");
+    const Key key{device, inode};
+    Shard &shard = m_shards[mix(key) >> 58];
+
+    QMutexLocker locker(&shard.mutex);
+    return shard.keys.insert(key).second;
+}
+
+void InodeSet::clear()
+{
+    for (Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        shard.keys.clear();
+    }
+}
+
+qint64 InodeSet::size() const
+{
+    qint64 total = 0;
+    for (const Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        total += static_cast<qint64>(shard.keys.size());
+    }
+    return total;
+}
@@ -0,0 +1,49 @@
+#ifndef INODESET_H
+#define INODESET_H
+
+#include <QMutex>
+#include <unordered_set>
+
+// Множество уже учтенных inode для файлов с несколькими жесткими ссылками.
+// Разбито на независимые сегменты со своими мьютексами: потоки сканера
+// блокируют только сегмент своего ключа, и общей блокировки нет. Файлы с
+// одной ссылкой сюда не попадают, поэтому множество остается маленьким
+class InodeSet
+{
+public:
+    // true, если пара (device, inode) встретилась впервые
+    bool insert(quint64 device, quint64 inode);
+    void clear();
+    qint64 size() const;
+
+private:
+    struct Key
+    {
+        quint64 device;
+        quint64 inode;
+        bool operator==(const Key &other) const
+        {
+            return device == other.device && inode == other.inode;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const { return static_cast<size_t>(mix(key)); }
+    };
+
+    static quint64 mix(const Key &key);
+
+    static constexpr int ShardCount = 64;
+
+    // Каждый сегмент на своей кэш-линии, чтобы не было ложного разделения
+    struct alignas(64) Shard
+    {
+        mutable QMutex mutex;
+        std::unordered_set<Key, KeyHash> keys;
+    };
+
+    Shard m_shards[ShardCount];
+};
+
+#endif // INODESET_H
@@ -1,6 +1,12 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "scanner.h"
+#include "filesmodel.h"
+#include "dirtreemodel.h"
+#include "treewatcher.h"
+#include "duplicatefinder.h"
+#include "treemapwidget.h"
+#include "namesearch.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
@@ -13,17 +19,39 @@
 #include <QDesktopServices>
 #include <QUrl>
 #include <QMenu>
+#include <QSpinBox>
 #include <QClipboard>
 #include <QFileInfo>
 #include <QDateTime>
 #include <QDebug>
+#include <QMenuBar>
+#include <QApplication>
+#include <QFontDatabase>
+#include <QJsonDocument>
+#include <QSaveFile>
+
+// Группировки для вкладки "Группировка": расширение, владелец, группа
+static QVector<std::shared_ptr<Aggregator>> groupingPrototypes()
+{
+    return {std::make_shared<ExtensionAggregator>(),
+            std::make_shared<OwnerAggregator>(OwnerAggregator::User),
+            std::make_shared<OwnerAggregator>(OwnerAggregator::Group)};
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , m_scanner(nullptr)
+    , m_watcher(nullptr)
+    , m_duplicateFinder(nullptr)
+    , m_filesModel(new FilesModel(this))
+    , m_dirModel(new DirTreeModel(this))
+    , m_nameSearch(new NameSearch(this))
+    , m_searchModel(new FilesModel(this))
+    , m_saveSnapshotAction(nullptr)
     , m_updateTimer(new QTimer(this))
     , m_isScanning(false)
+    , m_staleViews(0)
 {
     ui->setupUi(this);
     setupConnections();
@@ -31,10 +59,14 @@ MainWindow::MainWindow(QWidget *parent)
     setWindowTitle("Анализатор дискового пространства");
     resize(1200, 800);
 
-    // Настройка таблицы
-    ui->filesTable->setColumnCount(4);
-    ui->filesTable->setHorizontalHeaderLabels({"Имя файла", "Размер", "Путь", "Дата изменения"});
+    // Настройка таблицы: ячейки формирует модель только для видимых строк,
+    // поэтому ширина колонок задается заранее, а не по содержимому
+    ui->filesTable->setModel(m_filesModel);
     ui->filesTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+    ui->filesTable->horizontalHeader()->setSectionResizeMode(FilesModel::PathColumn, QHeaderView::Stretch);
+    ui->filesTable->setColumnWidth(FilesModel::NameColumn, 250);
+    ui->filesTable->setColumnWidth(FilesModel::SizeColumn, 100);
+    ui->filesTable->setColumnWidth(FilesModel::ModifiedColumn, 130);
     ui->filesTable->verticalHeader()->setDefaultSectionSize(20);
     ui->filesTable->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui->filesTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
@@ -43,7 +75,27 @@ MainWindow::MainWindow(QWidget *parent)
     ui->filesTable->setSelectionMode(QAbstractItemView::ExtendedSelection);
 
     // Настройка сортировки по размеру по умолчанию (по убыванию)
-    ui->filesTable->sortByColumn(1, Qt::DescendingOrder);
+    ui->filesTable->sortByColumn(FilesModel::SizeColumn, Qt::DescendingOrder);
+
+    // Дерево директорий: дети подгружаются при раскрытии
+    ui->dirTree->setModel(m_dirModel);
+    ui->dirTree->header()->setSectionResizeMode(QHeaderView::Interactive);
+    ui->dirTree->setColumnWidth(DirTreeModel::NameColumn, 400);
+    ui->dirTree->setColumnWidth(DirTreeModel::SizeColumn, 100);
+    ui->dirTree->setColumnWidth(DirTreeModel::AllocatedColumn, 100);
+    ui->dirTree->setColumnWidth(DirTreeModel::FilesColumn, 90);
+
+    // Результаты поиска дописываются в конец по мере нахождения
+    ui->searchTable->setModel(m_searchModel);
+    ui->searchTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+    ui->searchTable->horizontalHeader()->setSectionResizeMode(FilesModel::PathColumn, QHeaderView::Stretch);
+    ui->searchTable->setColumnWidth(FilesModel::NameColumn, 250);
+    ui->searchTable->setColumnWidth(FilesModel::SizeColumn, 100);
+    ui->searchTable->setColumnWidth(FilesModel::ModifiedColumn, 130);
+    ui->searchTable->verticalHeader()->setDefaultSectionSize(20);
+    ui->searchTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    ui->searchTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    ui->searchTable->setSortingEnabled(true);
 
     // Таймер для обновления визуализаций
     m_updateTimer->setInterval(1000);
@@ -53,6 +105,38 @@ MainWindow::MainWindow(QWidget *parent)
 
     // Инициализация QChartView
     ui->chartView->setRenderHint(QPainter::Antialiasing);
+
+    // Группировки, которые сканер ведет по ходу обхода; пункты списка
+    // идут в том же порядке, что и группировки у сканера
+    for (const std::shared_ptr<Aggregator> &prototype : groupingPrototypes()) {
+        ui->groupByCombo->addItem(prototype->title());
+    }
+    ui->groupChartView->setRenderHint(QPainter::Antialiasing);
+    ui->groupTable->verticalHeader()->setDefaultSectionSize(20);
+    ui->groupTable->setColumnWidth(0, 200);
+
+    // Пороги холодных данных берутся из дерева: итоги ведутся по каждому
+    for (int days : FileTree::ColdThresholdDays) {
+        ui->coldThresholdCombo->addItem(QString("%1 дней").arg(days));
+    }
+    ui->coldTable->verticalHeader()->setDefaultSectionSize(20);
+    ui->coldTable->setColumnWidth(0, 300);
+    ui->coldTable->setColumnWidth(1, 110);
+    ui->coldTable->setColumnWidth(2, 110);
+
+    ui->duplicatesTree->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    ui->duplicatesTree->header()->setStretchLastSection(false);
+    ui->duplicatesTree->setColumnWidth(1, 100);
+    ui->duplicatesTree->setColumnWidth(2, 130);
+    ui->ioThreadsSpin->setValue(DuplicateFinder::DefaultIoConcurrency);
+    ui->minDuplicateSizeSpin->setValue(DuplicateFinder::DefaultMinimumSize / 1024);
+
+    // Вкладка статистики видна, только пока включен ее сбор
+    ui->statsText->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    ui->tabWidget->removeTab(ui->tabWidget->indexOf(ui->tabStats));
+#ifndef DISKANALYZER_SCAN_STATS
+    ui->statsCheck->setVisible(false);
+#endif
 }
 
 MainWindow::~MainWindow()
@@ -66,16 +150,108 @@ MainWindow::~MainWindow()
 
 void MainWindow::setupConnections()
 {
+    // Меню "Файл": снимки позволяют открыть результаты без повторного сканирования
+    QMenu *fileMenu = menuBar()->addMenu("Файл");
+    fileMenu->addAction("Открыть снимок...", this, &MainWindow::onOpenSnapshotClicked);
+    m_saveSnapshotAction = fileMenu->addAction("Сохранить снимок...", this, &MainWindow::onSaveSnapshotClicked);
+    m_saveSnapshotAction->setEnabled(false);
+    fileMenu->addSeparator();
+    fileMenu->addAction("Выход", this, &QWidget::close);
+
     connect(ui->browseBtn, &QPushButton::clicked, this, &MainWindow::onBrowseClicked);
+    connect(ui->tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onTabChanged);
     connect(ui->scanBtn, &QPushButton::clicked, this, &MainWindow::onScanClicked);
     connect(ui->stopBtn, &QPushButton::clicked, this, &MainWindow::onStopClicked);
 
+    connect(ui->watchCheck, &QCheckBox::toggled, this, &MainWindow::onWatchToggled);
+    connect(ui->statsCheck, &QCheckBox::toggled, this, &MainWindow::onStatsToggled);
+    connect(ui->exportStatsBtn, &QPushButton::clicked, this, &MainWindow::onExportStatsClicked);
+
+    connect(ui->groupByCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::updateGroupsView);
+
+    // Карта: щелчок по директории открывает ее, подпись показывает путь уровня
+    connect(ui->treemapView, &TreemapWidget::rootChanged, this, [this](quint32 node) {
+        const bool isRoot = !m_tree || node == m_tree->root();
+        ui->treemapUpBtn->setEnabled(!isRoot);
+        if (m_tree && node != FileTree::InvalidNode) {
+            ui->treemapPathLabel->setText(QString("%1 - %2")
+                .arg(m_tree->path(node), formatSize(m_tree->totalSize(node))));
+        }
+    });
+    connect(ui->treemapUpBtn, &QPushButton::clicked, ui->treemapView, &TreemapWidget::zoomOut);
+
+    // Поиск по именам
+    connect(ui->searchBtn, &QPushButton::clicked, this, &MainWindow::onSearchRequested);
+    connect(ui->searchEdit, &QLineEdit::returnPressed, this, &MainWindow::onSearchRequested);
+    connect(ui->trigramCheck, &QCheckBox::toggled, this, &MainWindow::onTrigramToggled);
+    connect(m_nameSearch, &NameSearch::results, this, [this](const QVector<quint32> &nodes) {
+        m_searchModel->appendFiles(nodes);
+        ui->searchLabel->setText(QString("Найдено: %1...").arg(m_searchModel->rowCount()));
+    });
+    connect(m_nameSearch, &NameSearch::finished, this, &MainWindow::onSearchFinished);
+    connect(m_nameSearch, &NameSearch::indexReady, this, [this]() {
+        if (!m_nameSearch->isRunning())
+            ui->searchLabel->setText("Индекс триграмм готов");
+    });
+    // Двойной клик по результату открывает содержащую его директорию
+    connect(ui->searchTable, &QTableView::doubleClicked, this, [this](const QModelIndex &index) {
+        const FileItem item = m_searchModel->file(index.row());
+        if (!item.isValid()) return;
+        const QString dirPath = QFileInfo(item.path()).absolutePath();
+        if (!QDesktopServices::openUrl(QUrl::fromLocalFile(dirPath))) {
+            QMessageBox::warning(this, "Ошибка",
+                QString("Не удалось открыть директорию:\n%1").arg(dirPath));
+        }
+    });
+
+    // Вкладка холодных данных: двойной клик открывает поддиректорию
+    connect(ui->coldThresholdCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::updateColdView);
+    connect(ui->coldUpBtn, &QPushButton::clicked, this, [this]() {
+        if (!m_coldItem.isValid() || m_coldItem.node() == m_tree->root()) return;
+        m_coldItem = m_coldItem.parent();
+        updateColdView();
+    });
+    connect(ui->coldTable, &QTableWidget::itemDoubleClicked, this, [this](QTableWidgetItem *item) {
+        const FileItem child(m_tree.get(), ui->coldTable->item(item->row(), 0)->data(Qt::UserRole).toUInt());
+        if (!child.isDirectory()) return;
+        m_coldItem = child;
+        updateColdView();
+    });
+
+    connect(ui->findDuplicatesBtn, &QPushButton::clicked, this, &MainWindow::onFindDuplicatesClicked);
+    connect(ui->stopDuplicatesBtn, &QPushButton::clicked, this, [this]() {
+        stopDuplicateSearch();
+        ui->duplicatesLabel->setText("Поиск остановлен");
+    });
+    // Двойной клик по копии открывает ее директорию
+    connect(ui->duplicatesTree, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem *item, int) {
+        if (!item->parent()) return;
+        const QString dirPath = QFileInfo(item->text(0)).absolutePath();
+        if (!QDesktopServices::openUrl(QUrl::fromLocalFile(dirPath))) {
+            QMessageBox::warning(this, "Ошибка",
+                QString("Не удалось открыть директорию:\n%1").arg(dirPath));
+        }
+    });
+
+    // Размер списка больших файлов можно менять и во время сканирования
+    connect(ui->largestCountSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int count) {
+        if (m_scanner) {
+            m_scanner->setLargestFilesCount(count);
+        } else if (m_tree) {
+            if (m_watcher)
+                m_watcher->setLargestFilesCount(count);
+            refreshLargestFiles();
+        }
+    });
+
     // Контекстное меню таблицы
-    connect(ui->filesTable, &QTableWidget::customContextMenuRequested,
+    connect(ui->filesTable, &QTableView::customContextMenuRequested,
             this, &MainWindow::onFilesTableCustomContextMenuRequested);
 
     // Двойной клик по строке таблицы
-    connect(ui->filesTable, &QTableWidget::doubleClicked, this, [this](const QModelIndex &index) {
+    connect(ui->filesTable, &QTableView::doubleClicked, this, [this](const QModelIndex &index) {
         if (index.isValid()) {
             openSelectedFile();
         }
@@ -111,8 +287,15 @@ void MainWindow::onScanClicked()
     qDebug() << "Начинаем сканирование:" << path;
 
     // Очистка предыдущих результатов
-    ui->filesTable->setRowCount(0);
-    m_allFiles.clear();
+    m_filesModel->clear();
+    m_dirModel->clear();
+    m_nameSearch->setTree(nullptr);
+    m_searchModel->clear();
+    ui->searchLabel->clear();
+    m_saveSnapshotAction->setEnabled(false);
+    stopWatching();
+    stopDuplicateSearch();
+    ui->duplicatesTree->clear();
 
     // Создаем сканер
     if (m_scanner) {
@@ -120,8 +303,31 @@ void MainWindow::onScanClicked()
     }
 
     m_scanner = new Scanner(path, this);
+    m_scanner->setLargestFilesCount(ui->largestCountSpin->value());
+    m_scanner->setCollectStats(ui->statsCheck->isChecked());
+
+    // Исключенные директории не читаются, но остаются в дереве с пометкой
+    ScanFilter filter;
+    filter.setExcludePatterns({ui->excludeEdit->text()});
+    filter.setOneFileSystem(ui->oneFileSystemCheck->isChecked());
+    if (ui->skipPseudoCheck->isChecked()) {
+        filter.setSkippedTypes(ScanFilter::pseudoFileSystemTypes());
+    }
+    m_scanner->setFilter(filter);
+    m_scanFilter = filter;
+
+    for (const std::shared_ptr<Aggregator> &prototype : groupingPrototypes()) {
+        m_scanner->addAggregator(prototype);
+    }
+    m_aggregates.clear();
+    updateGroupsView();
+
+    // Прошлый результат (в том числе открытый снимок) служит основой для
+    // повторного сканирования; сканер сам проверит, что путь тот же
+    if (ui->incrementalCheck->isChecked() && m_tree) {
+        m_scanner->setBaseline(m_tree);
+    }
     connect(m_scanner, &Scanner::progress, this, &MainWindow::onScannerProgress);
-    connect(m_scanner, &Scanner::fileFound, this, &MainWindow::onScannerFileFound);
     connect(m_scanner, &Scanner::finished, this, &MainWindow::onScannerFinished);
     connect(m_scanner, &Scanner::error, this, &MainWindow::onScannerError);
 
@@ -131,7 +337,7 @@ void MainWindow::onScanClicked()
     ui->progressBar->setVisible(true);
     ui->progressBar->setRange(0, 100);
     ui->progressBar->setValue(0);
-    ui->statusLabel->setText("Подсчет файлов...");
+    ui->statusLabel->setText("Сканирование...");
 
     m_isScanning = true;
     m_updateTimer->start();
@@ -139,6 +345,14 @@ void MainWindow::onScanClicked()
     // Запуск сканирования
     qDebug() << "Запускаем сканер...";
     m_scanner->start();
+
+    // Дерево доступно с начала сканирования: итоги и список больших файлов
+    // обновляются по таймеру, не дожидаясь завершения
+    m_tree = m_scanner->tree();
+    m_rootItem = m_tree ? FileItem(m_tree.get(), m_tree->root()) : FileItem();
+    m_coldItem = m_rootItem;
+    updateColdView();
+    ui->treemapView->setTree(m_tree);
 }
 
 void MainWindow::onStopClicked()
@@ -154,15 +368,30 @@ void MainWindow::onStopClicked()
     }
 }
 
-void MainWindow::onScannerProgress(int percent, const QString &path, int filesCount, qint64 totalSize)
+void MainWindow::onScannerProgress(const ScanProgress &snapshot)
 {
+    // Основной индикатор - по байтам, по inode показываем в строке состояния
+    int percent = snapshot.bytesPercent;
     ui->progressBar->setValue(percent);
 
-    QString status = QString("Сканирование: %1% | Файлов: %2 | Размер: %3")
-                        .arg(percent)
-                        .arg(filesCount)
-                        .arg(formatSize(totalSize));
+    QString status = QString("Сканирование: %1% по объему, %2% по inode | Файлов: %3 | Директорий: %4 | Размер: %5 | На диске: %6")
+                        .arg(snapshot.bytesPercent)
+                        .arg(snapshot.entriesPercent)
+                        .arg(snapshot.files)
+                        .arg(snapshot.directories)
+                        .arg(formatSize(snapshot.bytes))
+                        .arg(formatSize(snapshot.allocatedBytes));
+
+    if (snapshot.reusedDirectories > 0) {
+        status += QString(" (без изменений: %1, перечитано: %2)")
+                      .arg(snapshot.reusedDirectories)
+                      .arg(snapshot.rereadDirectories);
+    }
+    if (snapshot.excludedDirectories > 0) {
+        status += QString(" | Исключено: %1").arg(snapshot.excludedDirectories);
+    }
 
+    const QString &path = snapshot.currentDirectory;
     if (!path.isEmpty() && path.length() < 50) {
         QString fileName = QFileInfo(path).fileName();
         if (!fileName.isEmpty()) {
@@ -174,34 +403,12 @@ void MainWindow::onScannerProgress(int percent, const QString &path, int filesCo
 
     // Обновляем заголовок окна
     setWindowTitle(QString("Анализатор дискового пространства - %1%").arg(percent));
-
-    // Обновляем таблицу каждые 100 файлов
-    static int lastUpdateCount = 0;
-    if (filesCount - lastUpdateCount >= 100) {
-        if (m_rootItem) {
-            updateLargestFiles(m_rootItem);
-        }
-        lastUpdateCount = filesCount;
-    }
-}
-
-void MainWindow::onScannerFileFound(const QString &filePath, qint64 size)
-{
-
-    static int fileCounter = 0;
-    fileCounter++;
-
-    // Обновляем UI каждые 500 файлов
-    if (fileCounter % 500 == 0) {
-        QApplication::processEvents();
-    }
 }
 
-void MainWindow::onScannerFinished(std::shared_ptr<FileItem> root)
+void MainWindow::onScannerFinished(std::shared_ptr<FileTree> tree)
 {
     qDebug() << "Сканирование завершено";
 
-    m_rootItem = root;
     m_isScanning = false;
     m_updateTimer->stop();
 
@@ -209,23 +416,23 @@ void MainWindow::onScannerFinished(std::shared_ptr<FileItem> root)
     ui->scanBtn->setEnabled(true);
     ui->stopBtn->setEnabled(false);
 
-    if (root) {
-        // Собираем все файлы в m_allFiles для быстрого доступа
-        m_allFiles.clear();
-        collectFiles(root, m_allFiles);
-
-        qint64 totalSize = root->totalSize();
-        ui->statusLabel->setText(
-            QString("Готово. Всего: %1 | Файлов: %2")
-                .arg(formatSize(totalSize))
-                .arg(m_allFiles.size())
-        );
+    // Статистику тоже забираем, пока сканер еще жив
+    if (m_scanner && ui->statsCheck->isChecked()) {
+        m_lastStats = m_scanner->stats();
+        updateStatsPanel(m_lastStats);
+        ui->exportStatsBtn->setEnabled(m_lastStats.enabled);
+    }
 
-        qDebug() << "Обновляем визуализации...";
+    // Группировки сливаются сканером к сигналу finished
+    if (m_scanner && tree) {
+        m_aggregates = m_scanner->aggregates();
+        updateGroupsView();
+    }
 
-        // Обновляем визуализации
-        updateChart(root);
-        updateLargestFiles(root);
+    if (tree) {
+        // Итоговый список забираем, пока сканер еще жив
+        showTree(tree);
+        qDebug() << "Память дерева:" << tree->memoryUsage();
     } else {
         ui->statusLabel->setText("Сканирование отменено");
     }
@@ -241,6 +448,368 @@ void MainWindow::onScannerFinished(std::shared_ptr<FileItem> root)
     qDebug() << "Обработка завершения сканирования окончена";
 }
 
+void MainWindow::showTree(std::shared_ptr<FileTree> tree)
+{
+    m_tree = tree;
+    m_rootItem = FileItem(m_tree.get(), m_tree->root());
+    // После сканирования дерево то же, открытая директория сохраняется
+    if (m_coldItem.tree() != m_tree.get()) {
+        m_coldItem = m_rootItem;
+    }
+    m_saveSnapshotAction->setEnabled(!m_tree->isReadOnly());
+
+    refreshLargestFiles();
+    updateSummary();
+    updateChart(m_rootItem);
+    updateColdView();
+    ui->treemapView->setTree(m_tree);
+    showDirectoryTree();
+    m_staleViews = 0;
+
+    // Индекс строится по готовому дереву; узлы, добавленные слежением
+    // позже, поиск проверяет без индекса
+    m_nameSearch->setTree(m_tree);
+    m_searchModel->clear();
+    ui->searchLabel->clear();
+    if (ui->trigramCheck->isChecked()) {
+        onTrigramToggled(true);
+    }
+
+    if (ui->watchCheck->isChecked()) {
+        onWatchToggled(true);
+    }
+}
+
+void MainWindow::updateSummary()
+{
+    QString status = QString("Готово. Всего: %1 | На диске: %2 | Файлов: %3")
+                        .arg(formatSize(m_rootItem.totalSize()))
+                        .arg(formatSize(m_rootItem.totalAllocated()))
+                        .arg(m_rootItem.fileCount());
+    if (m_watcher) {
+        status += " | Слежение включено";
+    }
+    ui->statusLabel->setText(status);
+}
+
+void MainWindow::onWatchToggled(bool enabled)
+{
+    if (!enabled) {
+        stopWatching();
+        if (m_rootItem.isValid() && !m_isScanning) updateSummary();
+        return;
+    }
+
+    // Слежение начинается только для готового дерева; во время сканирования
+    // оно включится в showTree
+    if (m_watcher || !m_tree || m_isScanning) return;
+
+    m_watcher = new TreeWatcher(m_tree, this);
+    m_watcher->setLargestFilesCount(ui->largestCountSpin->value());
+    m_watcher->setFilter(m_scanFilter);
+    connect(m_watcher, &TreeWatcher::treeChanged, this, &MainWindow::onTreeChanged);
+    connect(m_watcher, &TreeWatcher::rescanRequired, this, [this]() {
+        ui->statusLabel->setText("Слишком много изменений, часть пропущена - запустите сканирование заново");
+    });
+
+    if (!m_watcher->start()) {
+        stopWatching();
+        ui->statusLabel->setText(m_tree->isReadOnly()
+            ? "Слежение недоступно для снимка - запустите сканирование"
+            : "Не удалось включить слежение за изменениями");
+        return;
+    }
+    updateSummary();
+}
+
+void MainWindow::stopWatching()
+{
+    if (m_watcher) {
+        m_watcher->stop();
+        m_watcher->deleteLater();
+        m_watcher = nullptr;
+    }
+}
+
+void MainWindow::onFindDuplicatesClicked()
+{
+    if (!m_tree || m_isScanning) {
+        QMessageBox::warning(this, "Ошибка", "Дождитесь окончания сканирования");
+        return;
+    }
+
+    stopDuplicateSearch();
+    ui->duplicatesTree->clear();
+
+    // Поиск держит дерево у себя и не зависит от последующих сканирований
+    m_duplicateFinder = new DuplicateFinder(m_tree, this);
+    m_duplicateFinder->setIoConcurrency(ui->ioThreadsSpin->value());
+    m_duplicateFinder->setMinimumSize(qint64(ui->minDuplicateSizeSpin->value()) * 1024);
+    connect(m_duplicateFinder, &DuplicateFinder::progress, this, &MainWindow::onDuplicatesProgress);
+    connect(m_duplicateFinder, &DuplicateFinder::finished, this, &MainWindow::onDuplicatesFinished);
+
+    ui->findDuplicatesBtn->setEnabled(false);
+    ui->stopDuplicatesBtn->setEnabled(true);
+    m_duplicateFinder->start();
+}
+
+void MainWindow::onDuplicatesProgress(const DuplicateProgress &progress)
+{
+    QString stage;
+    switch (progress.stage) {
+    case DuplicateProgress::Grouping:    stage = "Группировка по размеру"; break;
+    case DuplicateProgress::PartialHash: stage = "Сравнение начала и конца"; break;
+    case DuplicateProgress::FullHash:    stage = "Сравнение содержимого"; break;
+    case DuplicateProgress::Done:        stage = "Готово"; break;
+    }
+
+    ui->duplicatesLabel->setText(QString("%1: файлов %2 из %3, прочитано %4 из %5")
+                                     .arg(stage)
+                                     .arg(progress.filesDone)
+                                     .arg(progress.files)
+                                     .arg(formatSize(progress.bytesDone))
+                                     .arg(formatSize(progress.bytes)));
+}
+
+void MainWindow::onDuplicatesFinished(const QVector<DuplicateGroup> &groups)
+{
+    ui->findDuplicatesBtn->setEnabled(true);
+    ui->stopDuplicatesBtn->setEnabled(false);
+
+    // Групп может быть очень много; показываются самые выгодные
+    const int MaxShownGroups = 1000;
+    qint64 reclaimable = 0;
+    QList<QTreeWidgetItem *> items;
+    for (int i = 0; i < groups.size(); ++i) {
+        const DuplicateGroup &group = groups[i];
+        reclaimable += group.reclaimable();
+        if (i >= MaxShownGroups)
+            continue;
+
+        QTreeWidgetItem *groupItem = new QTreeWidgetItem();
+        groupItem->setText(0, QString("%1 - копий: %2")
+                                  .arg(QFileInfo(group.paths.first()).fileName())
+                                  .arg(group.paths.size()));
+        groupItem->setText(1, formatSize(group.size));
+        groupItem->setText(2, formatSize(group.reclaimable()));
+        for (const QString &path : group.paths) {
+            QTreeWidgetItem *fileItem = new QTreeWidgetItem(groupItem);
+            fileItem->setText(0, path);
+        }
+        items.append(groupItem);
+    }
+    ui->duplicatesTree->addTopLevelItems(items);
+
+    ui->duplicatesLabel->setText(QString("Групп дубликатов: %1 | Можно освободить: %2")
+                                     .arg(groups.size())
+                                     .arg(formatSize(reclaimable)));
+
+    m_duplicateFinder->deleteLater();
+    m_duplicateFinder = nullptr;
+}
+
+void MainWindow::stopDuplicateSearch()
+{
+    if (m_duplicateFinder) {
+        m_duplicateFinder->stop();
+        m_duplicateFinder->deleteLater();
+        m_duplicateFinder = nullptr;
+    }
+    ui->findDuplicatesBtn->setEnabled(true);
+    ui->stopDuplicatesBtn->setEnabled(false);
+}
+
+void MainWindow::onSearchRequested()
+{
+    if (!m_tree || m_isScanning) {
+        ui->searchLabel->setText("Поиск доступен после сканирования");
+        return;
+    }
+
+    m_searchModel->setFiles(m_tree, {});
+    ui->searchLabel->setText("Поиск...");
+    m_nameSearch->search(ui->searchEdit->text());
+}
+
+void MainWindow::onSearchFinished(int count, qint64 elapsedMs, bool usedIndex, bool truncated)
+{
+    QString text = QString("Найдено: %1 за %2 мс").arg(count).arg(elapsedMs);
+    if (usedIndex) {
+        text += " (по индексу)";
+    }
+    if (truncated) {
+        text += QString(", показаны первые %1").arg(NameSearch::MaxResults);
+    }
+    ui->searchLabel->setText(text);
+}
+
+void MainWindow::onTrigramToggled(bool enabled)
+{
+    if (!enabled) {
+        m_nameSearch->dropIndex();
+        return;
+    }
+    if (m_tree && !m_isScanning && !m_nameSearch->hasIndex()) {
+        ui->searchLabel->setText("Строится индекс триграмм...");
+        m_nameSearch->buildIndex();
+    }
+}
+
+void MainWindow::onTreeChanged(const QVector<quint32> &directories)
+{
+    // Итоги директорий уже обновлены наблюдателем, а большие файлы он ведет
+    // сам: список обновляется на месте, без прохода по дереву
+    refreshLargestFiles();
+    updateSummary();
+
+    // Перестраиваются только представления, в поддереве которых были
+    // изменения; скрытые вкладки - при переключении на них
+    QWidget *current = ui->tabWidget->currentWidget();
+    if (containsChange(m_rootItem.node(), directories)) {
+        if (current == ui->tabChart)
+            updateChart(m_rootItem);
+        else
+            m_staleViews |= StaleChart;
+    }
+
+    // Открытая директория могла исчезнуть
+    if (m_coldItem.isValid() && m_tree->isRemoved(m_coldItem.node())) {
+        m_coldItem = m_rootItem;
+        m_staleViews |= StaleCold;
+    }
+    if ((m_staleViews & StaleCold) || containsChange(m_coldItem.node(), directories)) {
+        if (current == ui->tabCold) {
+            updateColdView();
+            m_staleViews &= ~StaleCold;
+        } else {
+            m_staleViews |= StaleCold;
+        }
+    }
+
+    const quint32 treemapRoot = ui->treemapView->rootNode();
+    if (m_tree->isRemoved(treemapRoot) || containsChange(treemapRoot, directories)) {
+        if (current == ui->tabTreemap)
+            ui->treemapView->refresh();
+        else
+            m_staleViews |= StaleTreemap;
+    }
+
+    m_dirModel->refresh(directories);
+}
+
+void MainWindow::onTabChanged(int index)
+{
+    QWidget *tab = ui->tabWidget->widget(index);
+    if ((m_staleViews & StaleChart) && tab == ui->tabChart) {
+        updateChart(m_rootItem);
+        m_staleViews &= ~StaleChart;
+    } else if ((m_staleViews & StaleTreemap) && tab == ui->tabTreemap) {
+        ui->treemapView->refresh();
+        m_staleViews &= ~StaleTreemap;
+    } else if ((m_staleViews & StaleCold) && tab == ui->tabCold) {
+        updateColdView();
+        m_staleViews &= ~StaleCold;
+    }
+}
+
+bool MainWindow::containsChange(quint32 node, const QVector<quint32> &directories) const
+{
+    if (node == FileTree::InvalidNode)
+        return false;
+    if (node == m_tree->root())
+        return !directories.isEmpty();
+
+    // Изменений в пачке немного, а глубина дерева невелика
+    for (quint32 directory : directories) {
+        for (quint32 current = directory; current != FileTree::InvalidNode;
+             current = m_tree->parent(current)) {
+            if (current == node)
+                return true;
+        }
+    }
+    return false;
+}
+
+void MainWindow::showDirectoryTree()
+{
+    // Порядок детей зависит от итогов, поэтому модель строится заново;
+    // корень сразу раскрыт
+    m_dirModel->setTree(m_tree);
+    ui->dirTree->expand(m_dirModel->index(0, 0));
+}
+
+void MainWindow::onOpenSnapshotClicked()
+{
+    if (m_isScanning) {
+        QMessageBox::warning(this, "Ошибка", "Дождитесь окончания сканирования");
+        return;
+    }
+
+    QString fileName = QFileDialog::getOpenFileName(
+        this,
+        "Открыть снимок",
+        QDir::homePath(),
+        "Снимки сканирования (*.dasnap);;Все файлы (*)"
+    );
+    if (fileName.isEmpty()) return;
+
+    QString errorString;
+    std::shared_ptr<FileTree> tree = FileTree::load(fileName, &errorString);
+    if (!tree) {
+        QMessageBox::warning(this, "Ошибка",
+            QString("Не удалось открыть снимок:\n%1\n%2").arg(fileName, errorString));
+        return;
+    }
+
+    qDebug() << "Загружен снимок" << fileName << "узлов:" << tree->nodeCount();
+
+    // Список больших файлов строится по дереву, сканер больше не нужен
+    stopWatching();
+    stopDuplicateSearch();
+    ui->duplicatesTree->clear();
+    if (m_scanner) {
+        m_scanner->deleteLater();
+        m_scanner = nullptr;
+    }
+
+    // Владельцы в снимок не попадают, группировки доступны только после сканирования
+    m_aggregates.clear();
+    updateGroupsView();
+
+    ui->pathEdit->setText(tree->rootPath());
+    showTree(tree);
+    ui->statusLabel->setText(ui->statusLabel->text() + QString(" | Снимок от %1")
+        .arg(QDateTime::fromSecsSinceEpoch(tree->scanTime()).toString("dd.MM.yyyy HH:mm")));
+}
+
+void MainWindow::onSaveSnapshotClicked()
+{
+    if (!m_tree || m_isScanning) return;
+
+    QString fileName = QFileDialog::getSaveFileName(
+        this,
+        "Сохранить снимок",
+        QDir::homePath() + "/scan.dasnap",
+        "Снимки сканирования (*.dasnap)"
+    );
+    if (fileName.isEmpty()) return;
+    if (QFileInfo(fileName).suffix().isEmpty()) {
+        fileName += ".dasnap";
+    }
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QString errorString;
+    const bool saved = m_tree->save(fileName, &errorString);
+    QApplication::restoreOverrideCursor();
+
+    if (!saved) {
+        QMessageBox::warning(this, "Ошибка",
+            QString("Не удалось сохранить снимок:\n%1\n%2").arg(fileName, errorString));
+        return;
+    }
+    ui->statusLabel->setText(QString("Снимок сохранен: %1").arg(fileName));
+}
+
 void MainWindow::onScannerError(const QString &message)
 {
     qDebug() << "Ошибка сканирования:" << message;
@@ -250,81 +819,151 @@ void MainWindow::onScannerError(const QString &message)
 
 void MainWindow::updateVisualizations()
 {
-    // Периодическое обновление визуализаций во время сканирования
-    if (m_rootItem && !m_isScanning) {
-        // Если сканирование завершено, обновляем все
+    // Периодическое обновление визуализаций во время сканирования: итоги
+    // директорий и список больших файлов читаются без обхода дерева
+    if (m_rootItem.isValid() && m_isScanning) {
+        refreshLargestFiles();
         updateChart(m_rootItem);
-        updateLargestFiles(m_rootItem);
+        updateColdView();
+        ui->treemapView->refresh();
+    }
+
+    if (m_scanner && m_isScanning && ui->statsCheck->isChecked()) {
+        updateStatsPanel(m_scanner->stats());
     }
 }
 
-void MainWindow::updateChart(std::shared_ptr<FileItem> root)
+void MainWindow::onStatsToggled(bool enabled)
 {
-    if (!root || root->children().isEmpty()) {
-        // Создаем пустую диаграмму
-        auto chart = new QtCharts::QChart();
-        chart->setTitle("Распределение дискового пространства");
-        chart->legend()->hide();
+    // Сбор включается со следующего сканирования
+    const int index = ui->tabWidget->indexOf(ui->tabStats);
+    if (enabled && index < 0) {
+        ui->tabWidget->addTab(ui->tabStats, "Статистика");
+    } else if (!enabled && index >= 0) {
+        ui->tabWidget->removeTab(index);
+    }
+}
 
-        auto series = new QtCharts::QPieSeries();
-        series->append("Нет данных", 1);
-        chart->addSeries(series);
+void MainWindow::updateStatsPanel(const ScanStats &stats)
+{
+    if (!stats.enabled) {
+        ui->statsText->setPlainText("Статистика не собиралась - включите ее до начала сканирования");
+        return;
+    }
+
+    auto ms = [](qint64 nanoseconds) { return QString::number(nanoseconds / 1000000.0, 'f', 1); };
+
+    QStringList lines;
+    lines << QString("Время: %1 с").arg(stats.elapsedMs / 1000.0, 0, 'f', 2);
+    lines << QString("Директорий: %1 (%2/с), записей: %3 (%4/с)")
+                 .arg(stats.directories)
+                 .arg(stats.directoriesPerSecond(), 0, 'f', 0)
+                 .arg(stats.entries)
+                 .arg(stats.entriesPerSecond(), 0, 'f', 0);
+    if (stats.excludedDirectories > 0) {
+        lines << QString("Исключено директорий: %1").arg(stats.excludedDirectories);
+    }
+    lines << QString("Суммарно по потокам: чтение списков %1 мс, stat %2 мс, вставка в дерево %3 мс")
+                 .arg(ms(stats.listingNs), ms(stats.statNs), ms(stats.insertNs));
+
+    lines << QString() << "Поток  Директорий   Занят, мс  Простой, мс   Кражи  Очередь";
+    for (int i = 0; i < stats.workers.size(); ++i) {
+        const ScanStats::Worker &worker = stats.workers[i];
+        lines << QString("%1  %2  %3  %4  %5  %6")
+                     .arg(i, 5)
+                     .arg(worker.directories, 10)
+                     .arg(ms(worker.busyNs), 10)
+                     .arg(ms(worker.idleNs), 11)
+                     .arg(worker.steals, 6)
+                     .arg(worker.queueDepth, 7);
+    }
+
+    lines << QString() << "Самые медленные директории:";
+    for (const ScanStats::Directory &directory : stats.slowestDirectories)
+        lines << QString("%1 мс  %2").arg(ms(directory.value), 10).arg(directory.path);
+
+    lines << QString() << "Самые большие директории:";
+    for (const ScanStats::Directory &directory : stats.largestDirectories)
+        lines << QString("%1 записей  %2").arg(directory.value, 10).arg(directory.path);
+
+    ui->statsText->setPlainText(lines.join('\n'));
+}
+
+void MainWindow::onExportStatsClicked()
+{
+    if (!m_lastStats.enabled) return;
 
-        ui->chartView->setChart(chart);
+    QString fileName = QFileDialog::getSaveFileName(
+        this,
+        "Экспорт статистики",
+        QDir::homePath() + "/scan-stats.json",
+        "JSON (*.json)"
+    );
+    if (fileName.isEmpty()) return;
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(QJsonDocument(m_lastStats.toJson()).toJson()) < 0
+        || !file.commit()) {
+        QMessageBox::warning(this, "Ошибка",
+            QString("Не удалось сохранить статистику:\n%1\n%2").arg(fileName, file.errorString()));
         return;
     }
+    ui->statusLabel->setText(QString("Статистика сохранена: %1").arg(fileName));
+}
 
-    // Создаем круговую диаграмму из дочерних элементов корня
+// Круговая диаграмма по частям целого: до 8 крупнейших частей не меньше 0.5%,
+// остальное сводится в "Другие"
+static QtCharts::QChart *createPieChart(const QString &title, QVector<QPair<qint64, QString>> parts,
+                                        qint64 total)
+{
     auto chart = new QtCharts::QChart();
-    chart->setTitle("Распределение дискового пространства");
-    chart->legend()->setAlignment(Qt::AlignRight);
-    chart->setAnimationOptions(QtCharts::QChart::SeriesAnimations);
-
+    chart->setTitle(title);
     auto series = new QtCharts::QPieSeries();
 
-    // Берем топ-8 самых крупных элементов
-    auto children = root->children();
-    qint64 totalSize = root->totalSize();
-
-    if (totalSize == 0) {
+    if (total <= 0 || parts.isEmpty()) {
+        chart->legend()->hide();
         series->append("Нет данных", 1);
         chart->addSeries(series);
-        ui->chartView->setChart(chart);
-        return;
+        return chart;
     }
 
+    chart->legend()->setAlignment(Qt::AlignRight);
+    chart->setAnimationOptions(QtCharts::QChart::SeriesAnimations);
+
     // Сортируем по размеру
-    std::sort(children.begin(), children.end(),
+    std::sort(parts.begin(), parts.end(),
               [](const auto &a, const auto &b) {
-                  return a->totalSize() > b->totalSize();
+                  return a.first > b.first;
               });
 
     int count = 0;
     qint64 othersSize = 0;
 
-    for (const auto &child : children) {
-        if (count < 8 && child->totalSize() > 0) {
-            qreal percentage = (child->totalSize() * 100.0) / totalSize;
+    for (const auto &part : parts) {
+        const qint64 partSize = part.first;
+        if (count < 8 && partSize > 0) {
+            qreal percentage = (partSize * 100.0) / total;
             if (percentage >= 0.5) { // Показываем только если > 0.5%
                 auto slice = series->append(
                     QString("%1\n%2%")
-                        .arg(child->name())
+                        .arg(part.second)
                         .arg(percentage, 0, 'f', 1),
-                    child->totalSize()
+                    partSize
                 );
                 slice->setLabelVisible(percentage > 2.0);
                 count++;
             } else {
-                othersSize += child->totalSize();
+                othersSize += partSize;
             }
         } else {
-            othersSize += child->totalSize();
+            othersSize += partSize;
         }
     }
 
     // Добавляем категорию "Другие"
     if (othersSize > 0) {
-        qreal percentage = (othersSize * 100.0) / totalSize;
+        qreal percentage = (othersSize * 100.0) / total;
         if (percentage > 0) {
             auto slice = series->append(
                 QString("Другие\n%1%").arg(percentage, 0, 'f', 1),
@@ -339,94 +978,145 @@ void MainWindow::updateChart(std::shared_ptr<FileItem> root)
     }
 
     chart->addSeries(series);
-    ui->chartView->setChart(chart);
+    return chart;
 }
 
-void MainWindow::updateLargestFiles(std::shared_ptr<FileItem> root)
+void MainWindow::updateChart(const FileItem &root)
 {
-    if (!root) return;
-
-    // Если файлы уже собраны в m_allFiles (в onScannerFinished), используем их
-    if (m_allFiles.isEmpty()) {
-        collectFiles(root, m_allFiles);
+    // Круговая диаграмма из дочерних элементов корня. Итоги поддерева
+    // читаются один раз: во время сканирования они растут, а сортировке
+    // нужны неизменные ключи
+    QVector<QPair<qint64, QString>> children;
+    qint64 totalSize = 0;
+    if (root.isValid()) {
+        for (const FileItem &child : root.children()) {
+            children.append(qMakePair(child.totalSize(), child.name()));
+        }
+        totalSize = root.totalSize();
     }
 
-    // Сортируем по размеру (по убыванию)
-    std::sort(m_allFiles.begin(), m_allFiles.end(),
-              [](const auto &a, const auto &b) {
-                  return a->size() > b->size();
-              });
-
-    // Отображаем топ-100
-    int count = qMin(100, m_allFiles.size());
-    ui->filesTable->setRowCount(count);
-
-    for (int i = 0; i < count; ++i) {
-        const auto &file = m_allFiles[i];
-
-        // Проверяем, что у нас есть все необходимые данные
-        if (!file) continue;
+    ui->chartView->setChart(createPieChart("Распределение дискового пространства",
+                                           children, totalSize));
+}
 
-        // Заполняем все 4 колонки данными, даже если некоторые пустые
-        ui->filesTable->setItem(i, 0, new QTableWidgetItem(
-            !file->name().isEmpty() ? file->name() : "Неизвестно"
-        ));
+void MainWindow::updateGroupsView()
+{
+    // Порядок пунктов списка совпадает с порядком группировок у сканера
+    const int index = ui->groupByCombo->currentIndex();
+    const QVector<AggregateRow> rows = index >= 0 && index < m_aggregates.size()
+                                       ? m_aggregates[index]->rows() : QVector<AggregateRow>();
+
+    QVector<QPair<qint64, QString>> parts;
+    qint64 total = 0;
+    for (const AggregateRow &row : rows) {
+        parts.append(qMakePair(row.bytes, row.key));
+        total += row.bytes;
+    }
+    ui->groupChartView->setChart(createPieChart(ui->groupByCombo->currentText(), parts, total));
+
+    // Таблица ограничена: у расширений бывает длинный хвост из единичных файлов
+    const int MaxGroupRows = 1000;
+    const int rowCount = qMin(rows.size(), MaxGroupRows);
+    ui->groupTable->setRowCount(rowCount);
+    for (int i = 0; i < rowCount; ++i) {
+        const AggregateRow &row = rows[i];
+        ui->groupTable->setItem(i, 0, new QTableWidgetItem(row.key));
+        ui->groupTable->setItem(i, 1, new QTableWidgetItem(formatSize(row.bytes)));
+        ui->groupTable->setItem(i, 2, new QTableWidgetItem(formatSize(row.allocated)));
+        ui->groupTable->setItem(i, 3, new QTableWidgetItem(QString::number(row.files)));
+    }
+}
 
-        ui->filesTable->setItem(i, 1, new QTableWidgetItem(
-            formatSize(file->size())
-        ));
+void MainWindow::updateColdView()
+{
+    // Холодные байты сведены в итоги каждой директории при сканировании,
+    // поэтому сортировка детей не требует обхода их поддеревьев
+    const int threshold = qMax(0, ui->coldThresholdCombo->currentIndex());
+    struct ColdRow
+    {
+        qint64 cold;
+        qint64 total;
+        FileItem item;
+    };
+    QVector<ColdRow> rows;
+    if (m_coldItem.isValid()) {
+        for (const FileItem &child : m_coldItem.children()) {
+            rows.append({child.coldBytes(threshold), child.totalSize(), child});
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const ColdRow &a, const ColdRow &b) {
+        return a.cold > b.cold;
+    });
 
-        ui->filesTable->setItem(i, 2, new QTableWidgetItem(
-            !file->path().isEmpty() ? file->path() : "-"
-        ));
+    auto share = [](qint64 cold, qint64 total) {
+        return total > 0 ? QString("%1%").arg(100.0 * cold / total, 0, 'f', 1) : QString("-");
+    };
 
-        ui->filesTable->setItem(i, 3, new QTableWidgetItem(
-            file->modified().isValid() ?
-            file->modified().toString("dd.MM.yyyy HH:mm") :
-            "-"
-        ));
+    ui->coldUpBtn->setEnabled(m_coldItem.isValid() && m_coldItem.node() != m_tree->root());
+    if (m_coldItem.isValid()) {
+        const qint64 cold = m_coldItem.coldBytes(threshold);
+        const qint64 total = m_coldItem.totalSize();
+        ui->coldPathLabel->setText(QString("%1 - холодных %2 из %3 (%4)")
+            .arg(m_coldItem.path(), formatSize(cold), formatSize(total), share(cold, total)));
+    } else {
+        ui->coldPathLabel->clear();
     }
 
-    ui->filesTable->resizeColumnsToContents();
-    ui->filesTable->horizontalHeader()->setSectionResizeMode(2, QHeaderView::Stretch);
-
-    // Восстанавливаем сортировку по размеру (по убыванию)
-    ui->filesTable->sortByColumn(1, Qt::DescendingOrder);
+    const int MaxColdRows = 1000;
+    const int rowCount = qMin(rows.size(), MaxColdRows);
+    ui->coldTable->setRowCount(rowCount);
+    for (int i = 0; i < rowCount; ++i) {
+        const ColdRow &row = rows[i];
+        QString name = row.item.isDirectory() ? row.item.name() + "/" : row.item.name();
+        if (row.item.isExcluded()) {
+            name += " (исключено)";
+        }
+        QTableWidgetItem *nameItem = new QTableWidgetItem(name);
+        nameItem->setData(Qt::UserRole, row.item.node());
+        ui->coldTable->setItem(i, 0, nameItem);
+        ui->coldTable->setItem(i, 1, new QTableWidgetItem(formatSize(row.cold)));
+        ui->coldTable->setItem(i, 2, new QTableWidgetItem(formatSize(row.total)));
+        ui->coldTable->setItem(i, 3, new QTableWidgetItem(share(row.cold, row.total)));
+    }
 }
 
-void MainWindow::collectFiles(std::shared_ptr<FileItem> item, QList<std::shared_ptr<FileItem>> &files)
+void MainWindow::refreshLargestFiles()
 {
-    if (!item) return;
+    if (!m_tree) return;
 
-    if (!item->isDirectory()) {
-        files.append(item);
-        return;
+    // Без сканера (дерево из снимка или уже после сканирования) список
+    // собирается одним проходом по узлам
+    QVector<TopFiles::Entry> entries;
+    if (m_scanner) {
+        entries = m_scanner->largestFiles();
+    } else if (m_watcher) {
+        entries = m_watcher->largestFiles();
+    } else {
+        TopFiles largest(ui->largestCountSpin->value());
+        const quint32 count = m_tree->nodeCount();
+        for (quint32 node = 0; node < count; ++node) {
+            if (!m_tree->isDirectory(node) && !m_tree->isRemoved(node)) {
+                largest.insert(m_tree->size(node), node);
+            }
+        }
+        entries = largest.entries();
+        TopFiles::selectLargest(entries, largest.capacity());
     }
 
-    for (const auto &child : item->children()) {
-        collectFiles(child, files);
+    QVector<quint32> nodes;
+    nodes.reserve(entries.size());
+    for (const TopFiles::Entry &entry : entries) {
+        nodes.append(entry.node);
     }
+
+    // Модель применяет выбранную в таблице сортировку сама. Список того же
+    // дерева обновляется на месте, без сброса выделения на каждом тике
+    m_filesModel->updateFiles(m_tree, nodes);
 }
 
 QString MainWindow::formatSize(qint64 bytes) const
 {
-    constexpr qint64 KB = 1024;
-    constexpr qint64 MB = KB * 1024;
-    constexpr qint64 GB = MB * 1024;
-    constexpr qint64 TB = GB * 1024;
-
-    if (bytes == 0) return "0 Б";
-
-    if (bytes >= TB)
-        return QString("%1 TB").arg(bytes / static_cast<double>(TB), 0, 'f', 2);
-    else if (bytes >= GB)
-        return QString("%1 GB").arg(bytes / static_cast<double>(GB), 0, 'f', 2);
-    else if (bytes >= MB)
-        return QString("%1 MB").arg(bytes / static_cast<double>(MB), 0, 'f', 2);
-    else if (bytes >= KB)
-        return QString("%1 KB").arg(bytes / static_cast<double>(KB), 0, 'f', 2);
-    else
-        return QString("%1 Б").arg(bytes);
+    return FilesModel::formatSize(bytes);
 }
 
 
@@ -439,15 +1129,7 @@ void MainWindow::onFilesTableCustomContextMenuRequested(const QPoint &pos)
     QMenu contextMenu(this);
 
     // Определяем количество выделенных файлов
-    QList<QTableWidgetItem*> selectedItems = ui->filesTable->selectedItems();
-    int selectedRows = 0;
-    if (!selectedItems.isEmpty()) {
-        QSet<int> rows;
-        for (auto item : selectedItems) {
-            rows.insert(item->row());
-        }
-        selectedRows = rows.size();
-    }
+    int selectedRows = ui->filesTable->selectionModel()->selectedRows(0).size();
 
     // Добавляем действия в меню
     QAction *openAction = contextMenu.addAction(
@@ -483,31 +1165,28 @@ void MainWindow::onFilesTableCustomContextMenuRequested(const QPoint &pos)
     contextMenu.exec(ui->filesTable->viewport()->mapToGlobal(pos));
 }
 
-QList<std::shared_ptr<FileItem>> MainWindow::getSelectedFiles() const
+QVector<FileItem> MainWindow::getSelectedFiles() const
 {
-    QList<std::shared_ptr<FileItem>> selectedFiles;
+    QVector<FileItem> selectedFiles;
 
     QModelIndexList selectedIndexes = ui->filesTable->selectionModel()->selectedRows(0);
     for (const QModelIndex &index : selectedIndexes) {
-        int row = index.row();
-        if (row >= 0 && row < m_allFiles.size()) {
-            selectedFiles.append(m_allFiles[row]);
+        FileItem file = m_filesModel->file(index.row());
+        if (file.isValid()) {
+            selectedFiles.append(file);
         }
     }
 
     return selectedFiles;
 }
 
-std::shared_ptr<FileItem> MainWindow::getFirstSelectedFile() const
+FileItem MainWindow::getFirstSelectedFile() const
 {
     QModelIndexList selectedIndexes = ui->filesTable->selectionModel()->selectedRows(0);
     if (!selectedIndexes.isEmpty()) {
-        int row = selectedIndexes.first().row();
-        if (row >= 0 && row < m_allFiles.size()) {
-            return m_allFiles[row];
-        }
+        return m_filesModel->file(selectedIndexes.first().row());
     }
-    return nullptr;
+    return FileItem();
 }
 
 void MainWindow::openSelectedFile()
@@ -515,15 +1194,15 @@ void MainWindow::openSelectedFile()
     auto selectedFiles = getSelectedFiles();
 
     for (const auto &file : selectedFiles) {
-        if (file && QFile::exists(file->path())) {
-            QUrl fileUrl = QUrl::fromLocalFile(file->path());
+        if (file.isValid() && QFile::exists(file.path())) {
+            QUrl fileUrl = QUrl::fromLocalFile(file.path());
             if (!QDesktopServices::openUrl(fileUrl)) {
                 QMessageBox::warning(this, "Ошибка",
-                    QString("Не удалось открыть файл:\n%1").arg(file->path()));
+                    QString("Не удалось открыть файл:\n%1").arg(file.path()));
             }
         } else {
             QMessageBox::warning(this, "Ошибка",
-                QString("Файл не существует:\n%1").arg(file ? file->path() : ""));
+                QString("Файл не существует:\n%1").arg(file.isValid() ? file.path() : QString()));
         }
     }
 }
@@ -538,10 +1217,10 @@ void MainWindow::openSelectedFileLocation()
 
         if (selectedFiles.size() == 1) {
             // Для одного файла - его директорию
-            dirPath = QFileInfo(selectedFiles.first()->path()).absolutePath();
+            dirPath = QFileInfo(selectedFiles.first().path()).absolutePath();
         } else {
             // Для нескольких файлов - директорию первого файла
-            dirPath = QFileInfo(selectedFiles.first()->path()).absolutePath();
+            dirPath = QFileInfo(selectedFiles.first().path()).absolutePath();
         }
 
         if (QDir(dirPath).exists()) {
@@ -566,7 +1245,7 @@ void MainWindow::showFileProperties()
     if (selectedFiles.size() == 1) {
         // Показываем детальные свойства для одного файла
         auto file = selectedFiles.first();
-        QFileInfo fileInfo(file->path());
+        QFileInfo fileInfo(file.path());
 
         QString properties = QString(
             "<b>Свойства файла:</b><br>"
@@ -601,7 +1280,7 @@ void MainWindow::showFileProperties()
         QDateTime newestDate = QDateTime::fromSecsSinceEpoch(0);
 
         for (const auto &file : selectedFiles) {
-            QFileInfo fileInfo(file->path());
+            QFileInfo fileInfo(file.path());
             totalSize += fileInfo.size();
 
             if (fileInfo.lastModified() < oldestDate) {
@@ -637,7 +1316,7 @@ void MainWindow::copyFilePath()
 
     QStringList paths;
     for (const auto &file : selectedFiles) {
-        paths.append(file->path());
+        paths.append(file.path());
     }
 
     QString clipboardText = paths.join("\n");
@@ -658,7 +1337,7 @@ void MainWindow::copyFileName()
 
     QStringList names;
     for (const auto &file : selectedFiles) {
-        names.append(file->name());
+        names.append(file.name());
     }
 
     QString clipboardText = names.join("\n");
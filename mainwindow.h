@@ -4,12 +4,23 @@
 #include <QMainWindow>
 #include <memory>
 #include "fileitem.h"
+#include "aggregator.h"
+#include "scanfilter.h"
+#include "scanstats.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
 class Scanner;
+class FilesModel;
+class DirTreeModel;
+class TreeWatcher;
+class DuplicateFinder;
+class NameSearch;
+struct ScanProgress;
+struct DuplicateProgress;
+struct DuplicateGroup;
 
 class MainWindow : public QMainWindow
 {
@@ -24,13 +35,35 @@ private slots:
     void onScanClicked();
     void onStopClicked();
 
-    void onScannerProgress(int percent, const QString &path, int filesCount, qint64 totalSize);
-    void onScannerFileFound(const QString &filePath, qint64 size);
-    void onScannerFinished(std::shared_ptr<FileItem> root);
+    void onScannerProgress(const ScanProgress &snapshot);
+    void onScannerFinished(std::shared_ptr<FileTree> tree);
     void onScannerError(const QString &message);
 
+    // Снимки результатов сканирования
+    void onOpenSnapshotClicked();
+    void onSaveSnapshotClicked();
+
+    // Слежение за деревом после сканирования
+    void onWatchToggled(bool enabled);
+    void onTreeChanged(const QVector<quint32> &directories);
+    void onTabChanged(int index);
+
     void updateVisualizations();
 
+    // Панель статистики сканирования
+    void onStatsToggled(bool enabled);
+    void onExportStatsClicked();
+
+    // Поиск дубликатов по готовому дереву
+    void onFindDuplicatesClicked();
+    void onDuplicatesProgress(const DuplicateProgress &progress);
+    void onDuplicatesFinished(const QVector<DuplicateGroup> &groups);
+
+    // Поиск по именам
+    void onSearchRequested();
+    void onSearchFinished(int count, qint64 elapsedMs, bool usedIndex, bool truncated);
+    void onTrigramToggled(bool enabled);
+
     // Слоты для контекстного меню таблицы
     void onFilesTableCustomContextMenuRequested(const QPoint &pos);
     void openSelectedFile();
@@ -42,22 +75,51 @@ private slots:
 private:
     void setupUi();
     void setupConnections();
-    void updateChart(std::shared_ptr<FileItem> root);
-    void updateLargestFiles(std::shared_ptr<FileItem> root);
-    void collectFiles(std::shared_ptr<FileItem> item, QList<std::shared_ptr<FileItem>> &files);
+    void updateChart(const FileItem &root);
+    void refreshLargestFiles();
+    void showTree(std::shared_ptr<FileTree> tree);
+    void updateSummary();
+    void stopWatching();
+    void stopDuplicateSearch();
+    void updateStatsPanel(const ScanStats &stats);
+    void updateGroupsView();
+    void updateColdView();
+    void showDirectoryTree();
+    // Лежит ли одна из измененных директорий в поддереве node (или это сам node)
+    bool containsChange(quint32 node, const QVector<quint32> &directories) const;
     QString formatSize(qint64 bytes) const;
 
     // Вспомогательные методы для работы с выделенными файлами
-    QList<std::shared_ptr<FileItem>> getSelectedFiles() const;
-    std::shared_ptr<FileItem> getFirstSelectedFile() const;
+    QVector<FileItem> getSelectedFiles() const;
+    FileItem getFirstSelectedFile() const;
 
     Ui::MainWindow *ui;
     Scanner *m_scanner;
-    std::shared_ptr<FileItem> m_rootItem;
+    std::shared_ptr<FileTree> m_tree;   // Владеет узлами, на которые ссылаются FileItem
+    FileItem m_rootItem;
+    FileItem m_coldItem;                // Директория, открытая на вкладке холодных данных
 
-    QList<std::shared_ptr<FileItem>> m_allFiles;  // Все файлы для быстрого доступа
+    TreeWatcher *m_watcher;
+    DuplicateFinder *m_duplicateFinder;
+    FilesModel *m_filesModel;  // Самые большие файлы текущего дерева
+    DirTreeModel *m_dirModel;  // Иерархия текущего дерева
+    NameSearch *m_nameSearch;
+    FilesModel *m_searchModel; // Результаты поиска по именам
+    QAction *m_saveSnapshotAction;
+    ScanStats m_lastStats;     // Статистика последнего сканирования для экспорта
+    QVector<std::shared_ptr<Aggregator>> m_aggregates;  // Группировки последнего сканирования
+    ScanFilter m_scanFilter;   // Правила исключения последнего сканирования, для слежения
     QTimer *m_updateTimer;
     bool m_isScanning;
+
+    // Вкладки, которые слежение пометило устаревшими, пока они были скрыты;
+    // перестраиваются при переключении на них
+    enum StaleView {
+        StaleChart = 0x1,
+        StaleTreemap = 0x2,
+        StaleCold = 0x4
+    };
+    int m_staleViews;
 };
 
 #endif // MAINWINDOW_H
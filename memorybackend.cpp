@@ -0,0 +1,266 @@
+#include "memorybackend.h"
+#include <QDir>
+#include <QThread>
+#include <algorithm>
+
+// Времена изменения разбросаны по году от этой точки
+static constexpr qint64 BaseTime = 1600000000;
+static constexpr qint64 TimeSpread = 365 * 24 * 3600;
+
+// Соли разделяют независимые случайные величины одного пути
+enum Salt : quint64 {
+    AttributesSalt = 0,
+    JitterSalt = 1,
+    StragglerSalt = 2,
+    ErrorSalt = 3
+};
+
+// Финализатор splitmix64: хорошо перемешивает близкие значения
+static quint64 mix(quint64 value)
+{
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+static bool hits(quint64 hash, double fraction)
+{
+    constexpr quint64 Scale = 1000000;
+    return fraction > 0 && static_cast<double>(hash % Scale) < fraction * Scale;
+}
+
+// Индекс из имени вида "<prefix><число>" или -1
+static int indexOf(const QByteArray &name, char prefix)
+{
+    if (name.size() < 2 || name.at(0) != prefix)
+        return -1;
+    bool ok = false;
+    const int index = name.mid(1).toInt(&ok);
+    return ok && index >= 0 && QByteArray::number(index) == name.mid(1) ? index : -1;
+}
+
+MemoryBackend::MemoryBackend(const QString &rootPath, const Shape &shape)
+    : m_rootPath(QDir::cleanPath(rootPath))
+    , m_shape(shape)
+    , m_latency(0)
+    , m_jitter(0)
+    , m_stragglerFraction(0)
+    , m_stragglerLatency(0)
+    , m_errorRate(0)
+    , m_calls(0)
+{
+}
+
+void MemoryBackend::setLatency(int latency, int jitter)
+{
+    m_latency = qMax(0, latency);
+    m_jitter = qMax(0, jitter);
+}
+
+void MemoryBackend::setStragglers(double fraction, int latency)
+{
+    m_stragglerFraction = fraction;
+    m_stragglerLatency = qMax(0, latency);
+}
+
+qint64 MemoryBackend::directoryCount() const
+{
+    qint64 directories = 0;
+    qint64 level = 1;
+    for (int i = 0; i < m_shape.depth; ++i) {
+        level *= m_shape.fanout;
+        directories += level;
+    }
+    return directories;
+}
+
+qint64 MemoryBackend::entryCount() const
+{
+    const qint64 directories = directoryCount();
+    return directories + (directories + 1) * m_shape.filesPerDir;
+}
+
+int MemoryBackend::levelOf(const QString &path) const
+{
+    if (path == m_rootPath)
+        return 0;
+    if (!path.startsWith(m_rootPath + '/'))
+        return -1;
+
+    int level = 0;
+    QStringList parts = path.mid(m_rootPath.size() + 1).split('/');
+    parts.removeAll(QString());
+    for (const QString &part : parts) {
+        const int index = indexOf(part.toUtf8(), 'd');
+        if (index < 0 || index >= m_shape.fanout || ++level > m_shape.depth)
+            return -1;
+    }
+    return level;
+}
+
+quint64 MemoryBackend::hashOf(const QString &path, quint64 salt) const
+{
+    // FNV-1a по символам пути, затем перемешивание с зерном и солью
+    quint64 hash = 0xcbf29ce484222325ULL;
+    for (const QChar ch : path) {
+        hash ^= ch.unicode();
+        hash *= 0x100000001b3ULL;
+    }
+    return mix(hash ^ mix(m_shape.seed + salt));
+}
+
+void MemoryBackend::fillDirectory(quint64 pathHash, DirEntry &entry) const
+{
+    entry.type = DirEntry::Directory;
+    entry.inode = pathHash | 1;
+    entry.mtime = BaseTime + static_cast<qint64>(pathHash % TimeSpread);
+    entry.ctime = entry.mtime;
+    entry.hasStat = true;
+}
+
+void MemoryBackend::fillFile(quint64 pathHash, int index, DirEntry &entry) const
+{
+    const quint64 hash = mix(pathHash + static_cast<quint64>(index));
+    entry.type = DirEntry::File;
+    entry.size = static_cast<qint64>(hash % static_cast<quint64>(m_shape.maxFileSize + 1));
+    // Место на диске - размер, округленный до блока 4 КБ
+    entry.allocated = (entry.size + 4095) & ~qint64(4095);
+    // Несколько владельцев, чтобы группировка по ним было что считать
+    entry.uid = 1000 + static_cast<quint32>((hash >> 40) % 4);
+    entry.gid = 100 + static_cast<quint32>((hash >> 48) % 2);
+    entry.mtime = BaseTime + static_cast<qint64>((hash >> 20) % TimeSpread);
+    entry.atime = entry.mtime;
+    entry.ctime = entry.mtime;
+    entry.inode = hash | 1;
+    entry.hasStat = true;
+}
+
+bool MemoryBackend::beginCall(const QString &path, int level, QString *errorString)
+{
+    m_calls.fetch_add(1, std::memory_order_relaxed);
+
+    if (level < 0) {
+        if (errorString) *errorString = "Нет такой директории";
+        return false;
+    }
+
+    qint64 delay = m_latency;
+    if (m_jitter > 0)
+        delay += static_cast<qint64>(hashOf(path, JitterSalt) % (m_jitter + 1));
+    if (hits(hashOf(path, StragglerSalt), m_stragglerFraction))
+        delay += m_stragglerLatency;
+    if (delay > 0)
+        QThread::usleep(static_cast<unsigned long>(delay));
+
+    // Корень всегда читается, иначе сканировать было бы нечего
+    if (level > 0 && hits(hashOf(path, ErrorSalt), m_errorRate)) {
+        if (errorString) *errorString = "Ошибка ввода-вывода (имитация)";
+        return false;
+    }
+    return true;
+}
+
+bool MemoryBackend::read(const DirLocation &location, QVector<DirEntry> &entries,
+                         DirReader::Options options, DirEntry *self, QString *errorString,
+                         std::shared_ptr<DirHandle> *handle)
+{
+    Q_UNUSED(handle);
+    const QString &path = location.path;
+    entries.clear();
+
+    const int level = levelOf(path);
+    if (!beginCall(path, level, errorString))
+        return false;
+
+    const quint64 pathHash = hashOf(path, AttributesSalt);
+    if (self) {
+        fillDirectory(pathHash, *self);
+    }
+
+    const int directories = level < m_shape.depth ? m_shape.fanout : 0;
+    entries.reserve(directories + m_shape.filesPerDir);
+
+    for (int i = 0; i < directories; ++i) {
+        DirEntry entry;
+        entry.name = "d" + QByteArray::number(i);
+        entry.type = DirEntry::Directory;
+        if (options & DirReader::StatDirectories) {
+            const QString child = path + "/" + QString::fromLatin1(entry.name);
+            fillDirectory(hashOf(child, AttributesSalt), entry);
+        }
+        entries.append(std::move(entry));
+    }
+
+    for (int i = 0; i < m_shape.filesPerDir; ++i) {
+        DirEntry entry;
+        entry.name = "f" + QByteArray::number(i);
+        entry.type = DirEntry::File;
+        if (options & DirReader::StatFiles) {
+            fillFile(pathHash, i, entry);
+        }
+        entries.append(std::move(entry));
+    }
+
+    if (options & DirReader::Sorted) {
+        std::sort(entries.begin(), entries.end(), [](const DirEntry &a, const DirEntry &b) {
+            return a.name < b.name;
+        });
+    }
+    return true;
+}
+
+bool MemoryBackend::restat(const DirLocation &location, QVector<DirEntry> &entries,
+                           DirReader::Options options, DirEntry *self, QString *errorString,
+                           std::shared_ptr<DirHandle> *handle)
+{
+    Q_UNUSED(handle);
+    const QString &path = location.path;
+    const int level = levelOf(path);
+    if (!beginCall(path, level, errorString))
+        return false;
+
+    const quint64 pathHash = hashOf(path, AttributesSalt);
+    if (self) {
+        fillDirectory(pathHash, *self);
+    }
+
+    // Записи, которых в модели нет, удаляются, как исчезнувшие с диска
+    QVector<DirEntry> result;
+    result.reserve(entries.size());
+    for (DirEntry &entry : entries) {
+        if (entry.type == DirEntry::Directory) {
+            const int index = indexOf(entry.name, 'd');
+            if (level >= m_shape.depth || index < 0 || index >= m_shape.fanout)
+                continue;
+            if (options & DirReader::StatDirectories) {
+                const QString child = path + "/" + QString::fromLatin1(entry.name);
+                fillDirectory(hashOf(child, AttributesSalt), entry);
+            }
+        } else {
+            const int index = indexOf(entry.name, 'f');
+            if (index < 0 || index >= m_shape.filesPerDir)
+                continue;
+            if (options & DirReader::StatFiles) {
+                fillFile(pathHash, index, entry);
+            }
+        }
+        result.append(std::move(entry));
+    }
+    entries = std::move(result);
+    return true;
+}
+
+bool MemoryBackend::exists(const QString &path)
+{
+    return levelOf(path) >= 0;
+}
+
+void MemoryBackend::estimateUsage(const QString &path, qint64 *bytes, qint64 *entries)
+{
+    Q_UNUSED(path);
+    // Размеры файлов распределены равномерно, в среднем половина максимума
+    const qint64 files = (directoryCount() + 1) * m_shape.filesPerDir;
+    *entries = entryCount();
+    *bytes = files * (m_shape.maxFileSize / 2);
+}
@@ -0,0 +1,71 @@
+#ifndef MEMORYBACKEND_H
+#define MEMORYBACKEND_H
+
+#include <atomic>
+#include "filesystembackend.h"
+
+// Детерминированная файловая система в памяти для замеров планировщика без
+// шума настоящего диска. Дерево не хранится: содержимое директории
+// вычисляется по ее пути, поэтому размер дерева ничем не ограничен.
+// Под корнем на каждом уровне fanout директорий "d<i>" и в каждой
+// директории filesPerDir файлов "f<i>". Задержки и ошибки тоже зависят
+// только от пути, так что медленные и сбойные директории одни и те же
+// от запуска к запуску
+class MemoryBackend : public FileSystemBackend
+{
+public:
+    struct Shape
+    {
+        int fanout = 10;
+        int depth = 4;
+        int filesPerDir = 100;
+        qint64 maxFileSize = 1 << 20;
+        quint64 seed = 1;
+    };
+
+    MemoryBackend(const QString &rootPath, const Shape &shape);
+
+    // Задержка каждого вызова: latency плюс случайная добавка до jitter, мкс
+    void setLatency(int latency, int jitter = 0);
+    // Доля "отстающих" директорий (как на медленном NFS) и их задержка, мкс
+    void setStragglers(double fraction, int latency);
+    // Доля директорий, чтение которых завершается ошибкой
+    void setErrorRate(double fraction) { m_errorRate = fraction; }
+
+    // Дескрипторов нет: handle остается пустым, используется location.path
+    bool read(const DirLocation &location, QVector<DirEntry> &entries,
+              DirReader::Options options, DirEntry *self, QString *errorString,
+              std::shared_ptr<DirHandle> *handle) override;
+    bool restat(const DirLocation &location, QVector<DirEntry> &entries,
+                DirReader::Options options, DirEntry *self, QString *errorString,
+                std::shared_ptr<DirHandle> *handle) override;
+    bool exists(const QString &path) override;
+    void estimateUsage(const QString &path, qint64 *bytes, qint64 *entries) override;
+
+    // Число обращений к read/restat с момента создания
+    qint64 callCount() const { return m_calls.load(std::memory_order_relaxed); }
+
+    QString rootPath() const { return m_rootPath; }
+    // Директорий и всех записей в дереве под корнем (без самого корня)
+    qint64 directoryCount() const;
+    qint64 entryCount() const;
+
+private:
+    // Уровень директории (корень - 0) или -1, если такой директории нет
+    int levelOf(const QString &path) const;
+    quint64 hashOf(const QString &path, quint64 salt) const;
+    void fillDirectory(quint64 pathHash, DirEntry &entry) const;
+    void fillFile(quint64 pathHash, int index, DirEntry &entry) const;
+    bool beginCall(const QString &path, int level, QString *errorString);
+
+    QString m_rootPath;
+    Shape m_shape;
+    int m_latency;
+    int m_jitter;
+    double m_stragglerFraction;
+    int m_stragglerLatency;
+    double m_errorRate;
+    std::atomic<qint64> m_calls;
+};
+
+#endif // MEMORYBACKEND_H
@@ -0,0 +1,194 @@
+#include "namematcher.h"
+#include <QFile>
+#include <algorithm>
+#include <cstring>
+
+static bool isGlobMeta(char c)
+{
+    return c == '*' || c == '?' || c == '[';
+}
+
+NameMatcher::NameMatcher(const QString &query, bool smartCase)
+{
+    m_pattern = QFile::encodeName(query);
+    m_caseSensitive = !smartCase || query != query.toLower();
+    if (!m_caseSensitive) {
+        for (char &c : m_pattern)
+            c = static_cast<char>(fold(static_cast<uchar>(c)));
+    }
+
+    m_glob = std::any_of(m_pattern.cbegin(), m_pattern.cend(), isGlobMeta);
+    if (!m_glob) {
+        m_literal = m_pattern;
+    } else {
+        // Куски между метасимволами; содержимое [...] к литералу не относится
+        int start = 0;
+        for (int i = 0; i <= m_pattern.size(); ++i) {
+            if (i < m_pattern.size() && !isGlobMeta(m_pattern[i]))
+                continue;
+            if (i - start > m_literal.size())
+                m_literal = m_pattern.mid(start, i - start);
+            if (i < m_pattern.size() && m_pattern[i] == '[') {
+                const int close = parseClass(i);
+                if (close > 0)
+                    i = close;
+            }
+            start = i + 1;
+        }
+    }
+
+    // Якорь для memchr: лучше байт, который не меняется при сворачивании
+    // регистра, - его ищет один проход. Если литерал весь из латинских
+    // букв, якорем становится первая, и ищутся обе ее формы
+    for (int i = 0; i < m_literal.size(); ++i) {
+        const uchar c = static_cast<uchar>(m_literal[i]);
+        if (m_caseSensitive || c < 'a' || c > 'z') {
+            m_anchor = i;
+            return;
+        }
+    }
+    m_anchorFolds = !m_literal.isEmpty();
+}
+
+bool NameMatcher::matches(const char *name, int length) const
+{
+    if (m_pattern.isEmpty())
+        return false;
+    if (!m_literal.isEmpty() && !contains(name, length))
+        return false;
+    return !m_glob || globMatches(name, length);
+}
+
+bool NameMatcher::contains(const char *name, int length) const
+{
+    const int needleLength = m_literal.size();
+    if (length < needleLength)
+        return false;
+
+    const char *needle = m_literal.constData();
+    const char *last = name + length - needleLength;
+
+    // Кандидаты ищет memchr: в libc он векторизован и проходит по 16-32
+    // байта за шаг. Остальные байты сверяются только у кандидатов. У буквы
+    // без учета регистра две формы ищутся отдельно, и берется раннее
+    // попадание; позднее сохраняется до следующего шага
+    const char *to = last + m_anchor + 1;
+    const auto find = [to](char c, const char *from) {
+        const char *hit = from < to ? static_cast<const char *>(memchr(from, c, to - from)) : nullptr;
+        return hit ? hit : to;
+    };
+
+    const char anchor = needle[m_anchor];
+    const char upper = m_anchorFolds ? static_cast<char>(anchor - ('a' - 'A')) : anchor;
+    const char *hitAnchor = find(anchor, name + m_anchor);
+    const char *hitUpper = m_anchorFolds ? find(upper, name + m_anchor) : to;
+
+    while (true) {
+        const char *hit = qMin(hitAnchor, hitUpper);
+        if (hit == to)
+            return false;
+
+        const char *start = hit - m_anchor;
+        if (m_caseSensitive) {
+            if (memcmp(start, needle, needleLength) == 0)
+                return true;
+        } else {
+            int i = 0;
+            while (i < needleLength && fold(static_cast<uchar>(start[i])) == static_cast<uchar>(needle[i]))
+                ++i;
+            if (i == needleLength)
+                return true;
+        }
+
+        if (hit == hitAnchor)
+            hitAnchor = find(anchor, hit + 1);
+        else
+            hitUpper = find(upper, hit + 1);
+    }
+}
+
+bool NameMatcher::matchElement(int pattern, uchar c, int *next) const
+{
+    const uchar p = static_cast<uchar>(m_pattern[pattern]);
+    if (p == '?') {
+        *next = pattern + 1;
+        return true;
+    }
+
+    if (p == '[') {
+        int i = 0;
+        bool negate = false;
+        const int close = parseClass(pattern, &i, &negate);
+        if (close > 0) {
+            bool found = false;
+            for (; i < close; ++i) {
+                const uchar low = static_cast<uchar>(m_pattern[i]);
+                if (i + 2 < close && m_pattern[i + 1] == '-') {
+                    const uchar high = static_cast<uchar>(m_pattern[i + 2]);
+                    found = found || (c >= low && c <= high);
+                    i += 2;
+                } else {
+                    found = found || c == low;
+                }
+            }
+            *next = close + 1;
+            return found != negate;
+        }
+    }
+
+    *next = pattern + 1;
+    return p == c;
+}
+
+int NameMatcher::parseClass(int pattern, int *first, bool *negate) const
+{
+    // [abc], [a-z], [!abc]; ']' сразу после скобки (и после '!') - обычный символ
+    int i = pattern + 1;
+    const bool negated = i < m_pattern.size() && (m_pattern[i] == '!' || m_pattern[i] == '^');
+    if (negated)
+        ++i;
+    if (first)
+        *first = i;
+    if (negate)
+        *negate = negated;
+    return m_pattern.indexOf(']', i + 1);
+}
+
+bool NameMatcher::globMatches(const char *name, int length) const
+{
+    // Жадное сопоставление с возвратом к последней звездочке: без рекурсии
+    // и за O(длина имени * длина шаблона) в худшем случае
+    const int patternLength = m_pattern.size();
+    int p = 0;
+    int n = 0;
+    int starPattern = -1;
+    int starName = 0;
+
+    while (n < length) {
+        if (p < patternLength && m_pattern[p] == '*') {
+            starPattern = ++p;
+            starName = n;
+            continue;
+        }
+
+        int next = 0;
+        if (p < patternLength && matchElement(p, normalize(static_cast<uchar>(name[n])), &next)) {
+            // '?' и класс символов поглощают символ UTF-8 целиком
+            const bool wholeCharacter = m_pattern[p] == '?' || m_pattern[p] == '[';
+            p = next;
+            ++n;
+            while (wholeCharacter && n < length && (static_cast<uchar>(name[n]) & 0xC0) == 0x80)
+                ++n;
+            continue;
+        }
+
+        if (starPattern < 0)
+            return false;
+        p = starPattern;
+        n = ++starName;
+    }
+
+    while (p < patternLength && m_pattern[p] == '*')
+        ++p;
+    return p == patternLength;
+}
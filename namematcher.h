@@ -0,0 +1,50 @@
+#ifndef NAMEMATCHER_H
+#define NAMEMATCHER_H
+
+#include <QByteArray>
+#include <QString>
+
+// Проверка имени файла на соответствие поисковому запросу.
+//
+// Запрос с символами * ? [ - шаблон для всего имени, как в shell; иначе
+// ищется подстрока. Если в запросе нет заглавных букв, регистр латиницы
+// не учитывается (при smartCase = false регистр учитывается всегда). Сравнение идет по байтам имени в кодировке файловой
+// системы, без перевода имен в QString.
+class NameMatcher
+{
+public:
+    NameMatcher() = default;
+    explicit NameMatcher(const QString &query, bool smartCase = true);
+
+    bool isEmpty() const { return m_pattern.isEmpty(); }
+    bool isGlob() const { return m_glob; }
+    bool isCaseSensitive() const { return m_caseSensitive; }
+    // Самый длинный кусок запроса без метасимволов: он обязан встретиться
+    // в подходящем имени. Пригоден для предварительного отбора
+    QByteArray requiredLiteral() const { return m_literal; }
+
+    bool matches(const char *name, int length) const;
+
+    static uchar fold(uchar c) { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; }
+
+private:
+    bool contains(const char *name, int length) const;
+    bool globMatches(const char *name, int length) const;
+    // Один элемент шаблона с позиции pattern против байта c; next - позиция
+    // после элемента
+    bool matchElement(int pattern, uchar c, int *next) const;
+    // Класс [...] с позиции pattern: индекс закрывающей скобки или -1, если
+    // ее нет и '[' - обычный символ. В first - начало перечня символов, в
+    // negate - признак [!...] / [^...]
+    int parseClass(int pattern, int *first = nullptr, bool *negate = nullptr) const;
+    uchar normalize(uchar c) const { return m_caseSensitive ? c : fold(c); }
+
+    QByteArray m_pattern;      // Без учета регистра - в нижнем регистре
+    QByteArray m_literal;
+    int m_anchor = 0;          // Байт литерала для memchr
+    bool m_anchorFolds = false; // Якорь - буква без учета регистра: ищутся оба варианта
+    bool m_glob = false;
+    bool m_caseSensitive = false;
+};
+
+#endif // NAMEMATCHER_H
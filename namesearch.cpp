@@ -0,0 +1,210 @@
+#include "namesearch.h"
+#include <QtConcurrent>
+#include <QDebug>
+
+NameSearch::NameSearch(QObject *parent)
+    : QObject(parent)
+    , m_running(false)
+    , m_cancelRequested(false)
+    , m_usedIndex(false)
+    , m_truncated(false)
+    , m_found(0)
+    , m_searchGeneration(0)
+    , m_indexing(false)
+    , m_cancelIndexing(false)
+    , m_indexGeneration(0)
+{
+    m_publishTimer.setInterval(PublishInterval);
+    connect(&m_publishTimer, &QTimer::timeout, this, &NameSearch::publishResults);
+}
+
+NameSearch::~NameSearch()
+{
+    stop();
+    stopIndexing();
+}
+
+void NameSearch::setTree(std::shared_ptr<FileTree> tree)
+{
+    stop();
+    dropIndex();
+    m_tree = std::move(tree);
+}
+
+void NameSearch::buildIndex()
+{
+    if (!m_tree || m_index || m_indexing)
+        return;
+
+    m_indexing = true;
+    m_cancelIndexing = false;
+    const std::shared_ptr<FileTree> tree = m_tree;
+    const quint64 generation = m_indexGeneration;
+    m_indexFuture = QtConcurrent::run([this, tree, generation]() {
+        QElapsedTimer timer;
+        timer.start();
+        std::shared_ptr<const TrigramIndex> index = TrigramIndex::build(*tree, m_cancelIndexing);
+        if (index) {
+            qDebug() << "Индекс триграмм:" << index->nodeCount() << "узлов," << timer.elapsed()
+                     << "мс," << index->memoryUsage() << "байт";
+        }
+
+        QMetaObject::invokeMethod(this, [this, index, generation]() {
+            m_indexing = false;
+            if (!index || generation != m_indexGeneration)
+                return;
+            m_index = index;
+            emit indexReady();
+        }, Qt::QueuedConnection);
+    });
+}
+
+void NameSearch::dropIndex()
+{
+    stopIndexing();
+    ++m_indexGeneration;
+    m_index.reset();
+}
+
+void NameSearch::stopIndexing()
+{
+    if (!m_indexing)
+        return;
+    m_cancelIndexing = true;
+    m_indexFuture.waitForFinished();
+    m_indexing = false;
+}
+
+void NameSearch::search(const QString &query)
+{
+    stop();
+
+    const NameMatcher matcher(query);
+    if (!m_tree || matcher.isEmpty()) {
+        emit finished(0, 0, false, false);
+        return;
+    }
+
+    m_running = true;
+    ++m_searchGeneration;
+    m_cancelRequested = false;
+    m_usedIndex = false;
+    m_truncated = false;
+    m_found = 0;
+    m_pending.clear();
+    m_elapsed.start();
+    m_publishTimer.start();
+
+    const std::shared_ptr<FileTree> tree = m_tree;
+    const std::shared_ptr<const TrigramIndex> index = m_index;
+    const quint64 generation = m_searchGeneration;
+    m_future = QtConcurrent::run([this, tree, matcher, index, generation]() {
+        run(tree, matcher, index, generation);
+    });
+}
+
+void NameSearch::stop()
+{
+    if (!m_running)
+        return;
+
+    m_cancelRequested = true;
+    m_future.waitForFinished();
+    m_publishTimer.stop();
+    m_running = false;
+}
+
+void NameSearch::run(std::shared_ptr<FileTree> tree, NameMatcher matcher,
+                     std::shared_ptr<const TrigramIndex> index, quint64 generation)
+{
+    const quint32 nodeCount = tree->nodeCount();
+    quint32 scanFrom = 0;
+
+    QVector<quint32> candidates;
+    if (index && index->candidates(matcher.requiredLiteral(), &candidates)) {
+        m_usedIndex = true;
+        searchNodes(*tree, matcher, candidates.size(), [&candidates](quint32 i) { return candidates[i]; });
+        scanFrom = index->nodeCount();
+    }
+
+    if (scanFrom < nodeCount) {
+        searchNodes(*tree, matcher, nodeCount - scanFrom, [scanFrom](quint32 i) { return scanFrom + i; });
+    }
+
+    QMetaObject::invokeMethod(this, [this, generation]() {
+        if (generation == m_searchGeneration)
+            onSearchFinished();
+    }, Qt::QueuedConnection);
+}
+
+template <typename NodeAt>
+void NameSearch::searchNodes(const FileTree &tree, const NameMatcher &matcher, quint32 count, NodeAt nodeAt)
+{
+    const int threads = qMax(1, m_threadPool.maxThreadCount());
+    QVector<QVector<quint32>> found(threads);
+
+    for (quint32 block = 0; block < count && !m_cancelRequested; block += BlockSize) {
+        const quint32 blockEnd = qMin<quint64>(quint64(block) + BlockSize, count);
+        const quint32 step = (blockEnd - block + threads - 1) / threads;
+
+        // Блок делится на равные части по числу потоков; каждая часть
+        // складывает найденное в свой вектор, поэтому порядок сохраняется
+        QVector<QFuture<void>> futures;
+        for (int t = 0; t < threads; ++t) {
+            const quint32 from = block + t * step;
+            const quint32 to = qMin(blockEnd, from + step);
+            found[t].clear();
+            if (from >= to)
+                continue;
+            futures.append(QtConcurrent::run(&m_threadPool, [&tree, &matcher, &nodeAt, &found, t, from, to]() {
+                for (quint32 i = from; i < to; ++i) {
+                    const quint32 node = nodeAt(i);
+                    int length = 0;
+                    const char *name = tree.nameData(node, &length);
+                    if (matcher.matches(name, length) && !tree.isRemoved(node))
+                        found[t].append(node);
+                }
+            }));
+        }
+        for (QFuture<void> &future : futures)
+            future.waitForFinished();
+
+        QMutexLocker locker(&m_pendingMutex);
+        for (const QVector<quint32> &part : found) {
+            const int room = MaxResults - m_found;
+            if (part.size() > room) {
+                m_pending += part.mid(0, room);
+                m_found += room;
+                m_truncated = true;
+                m_cancelRequested = true;
+                return;
+            }
+            m_pending += part;
+            m_found += part.size();
+        }
+    }
+}
+
+void NameSearch::publishResults()
+{
+    QVector<quint32> batch;
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        batch.swap(m_pending);
+    }
+    if (!batch.isEmpty())
+        emit results(batch);
+}
+
+void NameSearch::onSearchFinished()
+{
+    if (!m_running)
+        return;
+
+    m_publishTimer.stop();
+    m_running = false;
+    publishResults();
+
+    // Отмену по лимиту результатов от остановки пользователем отличает m_truncated
+    emit finished(m_found, m_elapsed.elapsed(), m_usedIndex, m_truncated);
+}
@@ -0,0 +1,95 @@
+#ifndef NAMESEARCH_H
+#define NAMESEARCH_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QMutex>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "namematcher.h"
+#include "trigramindex.h"
+
+// Поиск по именам готового дерева.
+//
+// Без индекса имена узлов проверяются подряд: узлы делятся на блоки, блок
+// разбирают потоки пула, найденное в блоке добавляется к результатам по
+// порядку узлов. Результаты отдаются порциями по таймеру, так что таблица
+// заполняется, пока поиск идет. Если построен индекс триграмм и в запросе
+// есть литерал от трех байт, проверяются только кандидаты из индекса.
+//
+// Фоновые потоки только читают имена и флаги узлов; слежение меняет флаги
+// атомарно, а сами имена в пуле не трогает, поэтому поиск не мешает
+// обновлению дерева. Узлы, добавленные после построения индекса,
+// проверяются подряд.
+class NameSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit NameSearch(QObject *parent = nullptr);
+    ~NameSearch();
+
+    // Останавливает поиск и сбрасывает индекс
+    void setTree(std::shared_ptr<FileTree> tree);
+
+    // Индекс строится в фоне; готовность сообщает indexReady
+    void buildIndex();
+    void dropIndex();
+    bool hasIndex() const { return m_index != nullptr; }
+    bool isIndexing() const { return m_indexing; }
+
+    // Прежний поиск останавливается. Пустой запрос сразу дает finished
+    void search(const QString &query);
+    void stop();
+    bool isRunning() const { return m_running; }
+
+    static constexpr int MaxResults = 1000000;
+    static constexpr int BlockSize = 1 << 18;      // Узлов в блоке
+    static constexpr int PublishInterval = 100;    // мс
+
+signals:
+    void indexReady();
+    // Очередная порция, узлы по возрастанию
+    void results(const QVector<quint32> &nodes);
+    // truncated - найдено больше MaxResults, показаны первые
+    void finished(int count, qint64 elapsedMs, bool usedIndex, bool truncated);
+
+private slots:
+    void publishResults();
+
+private:
+    void run(std::shared_ptr<FileTree> tree, NameMatcher matcher,
+             std::shared_ptr<const TrigramIndex> index, quint64 generation);
+    void onSearchFinished();
+    // Проверяет узлы nodeAt(0..count) блоками в потоках пула
+    template <typename NodeAt>
+    void searchNodes(const FileTree &tree, const NameMatcher &matcher, quint32 count, NodeAt nodeAt);
+    void stopIndexing();
+
+    std::shared_ptr<FileTree> m_tree;
+    std::shared_ptr<const TrigramIndex> m_index;
+
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_cancelRequested;
+    std::atomic<bool> m_usedIndex;
+    std::atomic<bool> m_truncated;
+    std::atomic<int> m_found;
+    QFuture<void> m_future;
+    QThreadPool m_threadPool;
+    QMutex m_pendingMutex;
+    QVector<quint32> m_pending;    // Найдено, но еще не отдано
+    QTimer m_publishTimer;
+    QElapsedTimer m_elapsed;
+    quint64 m_searchGeneration;    // Номер поиска: завершение прежнего не закроет новый
+
+    std::atomic<bool> m_indexing;
+    std::atomic<bool> m_cancelIndexing;
+    QFuture<void> m_indexFuture;
+    quint64 m_indexGeneration;     // Растет при сбросе индекса: устаревшая сборка отбрасывается
+};
+
+#endif // NAMESEARCH_H
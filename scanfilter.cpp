@@ -0,0 +1,169 @@
+#include "scanfilter.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+static bool hasGlobMeta(const QString &pattern)
+{
+    return pattern.contains('*') || pattern.contains('?') || pattern.contains('[');
+}
+
+void ScanFilter::setExcludePatterns(const QStringList &patterns)
+{
+    m_patterns.clear();
+    m_names.clear();
+    m_paths.clear();
+    m_nameGlobs.clear();
+    m_pathGlobs.clear();
+
+    for (const QString &item : patterns) {
+        for (QString pattern : item.split(',')) {
+            pattern = pattern.trimmed();
+            // "build/" - то же, что "build": правила и так только для директорий
+            while (pattern.size() > 1 && pattern.endsWith('/'))
+                pattern.chop(1);
+            if (pattern.isEmpty())
+                continue;
+            m_patterns.append(pattern);
+
+            const bool isPath = pattern.contains('/');
+            if (isPath && !hasGlobMeta(pattern)) {
+                m_paths.insert(QFile::encodeName(QDir::cleanPath(pattern)));
+            } else if (isPath) {
+                m_pathGlobs.append(NameMatcher(pattern, false));
+            } else if (!hasGlobMeta(pattern)) {
+                m_names.insert(QFile::encodeName(pattern));
+            } else {
+                m_nameGlobs.append(NameMatcher(pattern, false));
+            }
+        }
+    }
+}
+
+void ScanFilter::setSkippedTypes(const QStringList &types)
+{
+    m_skippedTypes.clear();
+    for (const QString &type : types) {
+        if (!type.trimmed().isEmpty())
+            m_skippedTypes.insert(type.trimmed());
+    }
+}
+
+QStringList ScanFilter::pseudoFileSystemTypes()
+{
+    return {"proc", "sysfs", "devtmpfs", "devpts", "tmpfs", "cgroup", "cgroup2", "securityfs",
+            "debugfs", "tracefs", "pstore", "bpf", "configfs", "fusectl", "mqueue", "hugetlbfs",
+            "autofs", "binfmt_misc", "efivarfs", "rpc_pipefs", "nsfs", "selinuxfs"};
+}
+
+// В mountinfo пробелы, табуляции, переводы строк и '\' записаны как \ooo
+static QByteArray unescapeMountPath(const QByteArray &field)
+{
+    QByteArray result;
+    result.reserve(field.size());
+    for (int i = 0; i < field.size(); ++i) {
+        if (field[i] == '\\' && i + 3 < field.size()) {
+            bool ok = false;
+            const int code = field.mid(i + 1, 3).toInt(&ok, 8);
+            if (ok) {
+                result += static_cast<char>(code);
+                i += 3;
+                continue;
+            }
+        }
+        result += field[i];
+    }
+    return result;
+}
+
+void ScanFilter::prepare(const QString &rootPath)
+{
+    m_mounts.clear();
+#ifdef Q_OS_LINUX
+    if (!m_oneFileSystem && m_skippedTypes.isEmpty())
+        return;
+
+    // Таблица монтирования хранит канонические пути, а сканер строит пути
+    // от rootPath как есть; нужны только точки монтирования внутри корня
+    const QString canonical = QFileInfo(rootPath).canonicalFilePath();
+    if (canonical.isEmpty())
+        return;
+    const QString canonicalPrefix = canonical.endsWith('/') ? canonical : canonical + '/';
+    const QString rootPrefix = rootPath.endsWith('/') ? rootPath : rootPath + '/';
+
+    // Файлы /proc сообщают нулевой размер, поэтому читаются целиком до конца
+    QFile file("/proc/self/mountinfo");
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Не удалось прочитать таблицу монтирования:" << file.errorString();
+        return;
+    }
+    const QByteArray data = file.readAll();
+
+    // Поля: id, родитель, major:minor, корень, точка монтирования, опции,
+    // необязательные поля, "-", тип ФС, источник, опции суперблока
+    for (const QByteArray &line : data.split('\n')) {
+        const QList<QByteArray> fields = line.split(' ');
+        const int separator = fields.indexOf("-");
+        if (fields.size() < 5 || separator < 5 || separator + 1 >= fields.size())
+            continue;
+
+        const QString mountPoint = QFile::decodeName(unescapeMountPath(fields[4]));
+        if (!mountPoint.startsWith(canonicalPrefix) || mountPoint.size() == canonicalPrefix.size())
+            continue;
+
+        // Более поздняя строка - монтирование поверх прежнего, оно и видно
+        m_mounts.insert(rootPrefix + mountPoint.mid(canonicalPrefix.size()),
+                        QString::fromLatin1(fields[separator + 1]));
+    }
+
+    qDebug() << "Точек монтирования внутри" << rootPath << ":" << m_mounts.size();
+#else
+    Q_UNUSED(rootPath);
+#endif
+}
+
+bool ScanFilter::isEmpty() const
+{
+    return m_patterns.isEmpty() && !m_oneFileSystem && m_skippedTypes.isEmpty();
+}
+
+ScanFilter::Reason ScanFilter::check(const QString &path, const DirEntry &entry,
+                                     quint64 rootDevice) const
+{
+    // Сначала дешевые проверки по имени, путь кодируется только при нужде
+    if (m_names.contains(entry.name))
+        return Pattern;
+    for (const NameMatcher &glob : m_nameGlobs) {
+        if (glob.matches(entry.name.constData(), entry.name.size()))
+            return Pattern;
+    }
+
+    if (!m_paths.isEmpty() || !m_pathGlobs.isEmpty()) {
+        const QByteArray encoded = QFile::encodeName(path);
+        if (m_paths.contains(encoded))
+            return Pattern;
+        for (const NameMatcher &glob : m_pathGlobs) {
+            if (glob.matches(encoded.constData(), encoded.size()))
+                return Pattern;
+        }
+    }
+
+    if (!m_mounts.isEmpty()) {
+        const auto mount = m_mounts.constFind(path);
+        if (mount != m_mounts.cend()) {
+            if (m_skippedTypes.contains(mount.value()))
+                return SkippedFileSystem;
+            if (m_oneFileSystem)
+                return OtherFileSystem;
+        }
+    }
+
+    // Без mountinfo (не Linux) граница видна только по st_dev
+    if (m_oneFileSystem && rootDevice != 0 && entry.hasStat && entry.device != 0
+        && entry.device != rootDevice) {
+        return OtherFileSystem;
+    }
+
+    return NotExcluded;
+}
@@ -0,0 +1,76 @@
+#ifndef SCANFILTER_H
+#define SCANFILTER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "dirreader.h"
+#include "namematcher.h"
+
+// Правила, по которым сканер не спускается в директорию.
+//
+// Шаблоны исключения разбираются один раз при настройке: имена без
+// метасимволов попадают в хеш-множество, шаблоны с * ? [ - в список
+// NameMatcher. Шаблон без '/' сравнивается с именем директории, с '/' -
+// с ее полным путем. Регистр учитывается всегда.
+//
+// Границы файловых систем берутся из /proc/self/mountinfo, прочитанного
+// в начале сканирования: точка монтирования с типом из списка пропуска
+// (по умолчанию псевдо-ФС вроде proc и sysfs) исключается. В режиме одной
+// файловой системы исключается любая точка монтирования внутри корня, в
+// том числе bind-монтирование той же ФС, а также директория с другим
+// st_dev (так граница находится и без mountinfo).
+//
+// После prepare() объект только читается и проверки можно вызывать из
+// всех рабочих потоков одновременно.
+class ScanFilter
+{
+public:
+    enum Reason {
+        NotExcluded,
+        Pattern,            // Совпал шаблон исключения
+        OtherFileSystem,    // Граница файловой системы в режиме одной ФС
+        SkippedFileSystem   // Тип файловой системы в списке пропуска
+    };
+
+    // Шаблоны через запятую или по одному в элементе списка; пустые пропускаются
+    void setExcludePatterns(const QStringList &patterns);
+    QStringList excludePatterns() const { return m_patterns; }
+
+    void setOneFileSystem(bool enabled) { m_oneFileSystem = enabled; }
+    bool oneFileSystem() const { return m_oneFileSystem; }
+
+    void setSkippedTypes(const QStringList &types);
+    QStringList skippedTypes() const { return m_skippedTypes.values(); }
+    // Псевдо-ФС ядра: их содержимое не занимает места на дисках
+    static QStringList pseudoFileSystemTypes();
+
+    // Читает таблицу монтирования для сканирования rootPath. Точки
+    // монтирования переводятся в пути от rootPath в том виде, в каком их
+    // строит сканер, даже если rootPath не канонический
+    void prepare(const QString &rootPath);
+
+    bool isEmpty() const;
+    // Для проверки st_dev поддиректории нужно stat-нуть
+    bool needsDevice() const { return m_oneFileSystem; }
+
+    // Проверка поддиректории entry, лежащей по пути path. rootDevice - st_dev
+    // корня сканирования, 0 - неизвестен
+    Reason check(const QString &path, const DirEntry &entry, quint64 rootDevice) const;
+
+private:
+    QStringList m_patterns;
+    QSet<QByteArray> m_names;           // Имена без метасимволов
+    QSet<QByteArray> m_paths;           // Пути без метасимволов
+    QVector<NameMatcher> m_nameGlobs;
+    QVector<NameMatcher> m_pathGlobs;
+
+    bool m_oneFileSystem = false;
+    QSet<QString> m_skippedTypes;
+    QHash<QString, QString> m_mounts;   // Точка монтирования внутри корня -> тип ФС
+};
+
+#endif // SCANFILTER_H
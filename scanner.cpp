@@ -1,24 +1,40 @@
 #include "scanner.h"
-#include <QFileInfo>
+#include "dirreader.h"
+#include <QBitArray>
 #include <QDir>
+#include <QHash>
 #include <QDebug>
-#include <QApplication>
-#include <QMutexLocker>
+#include <QPair>
+
+// Счетчик пишет только его поток, поэтому атомарное сложение не нужно
+static void addToCounter(std::atomic<qint64> &counter, qint64 value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
 
 Scanner::Scanner(const QString &path, QObject *parent)
     : QObject(parent)
     , m_rootPath(path)
     , m_running(false)
     , m_cancelRequested(false)
-    , m_totalFiles(0)
-    , m_scannedFiles(0)
-    , m_totalSize(0)
-    , m_activeTasks(0)
+    , m_estimatedBytes(0)
+    , m_estimatedEntries(0)
+    , m_useIoUring(false)
+    , m_backend(std::make_shared<LocalBackend>())
+    , m_restatFiles(true)
+    , m_largestFilesCount(TopFiles::MinCapacity)
+    , m_maxDepth(-1)
+    , m_retainFiles(true)
+    , m_collectStats(false)
+    , m_rootDevice(0)
+    , m_elapsedMs(0)
+    , m_workerCount(0)
 {
-    // Оптимальное количество потоков
-    int threadCount = QThread::idealThreadCount();
-    m_threadPool.setMaxThreadCount(threadCount > 2 ? threadCount : 2);
+    setThreadCount(0);
     qDebug() << "Scanner создан, потоков:" << m_threadPool.maxThreadCount();
+
+    m_progressTimer.setInterval(ProgressInterval);
+    connect(&m_progressTimer, &QTimer::timeout, this, &Scanner::publishProgress);
 }
 
 Scanner::~Scanner()
@@ -36,40 +52,68 @@ void Scanner::start()
 
     m_running = true;
     m_cancelRequested = false;
-    m_totalFiles = 0;
-    m_scannedFiles = 0;
-    m_totalSize = 0;
-    m_activeTasks = 0;
+    m_estimatedBytes = 0;
+    m_estimatedEntries = 0;
 
     qDebug() << "Запуск сканирования:" << m_rootPath;
 
-    // Создаем корневой элемент
-    QFileInfo rootInfo(m_rootPath);
-    m_rootItem = std::make_shared<FileItem>(
-        rootInfo.fileName().isEmpty() ? rootInfo.absoluteFilePath() : rootInfo.fileName(),
-        m_rootPath,
-        0,
-        rootInfo.lastModified(),
-        true
-    );
-
-    // Сначала считаем общее количество файлов для прогресса
-    QtConcurrent::run(&m_threadPool, [this]() {
-        try {
-            m_totalFiles = countFilesInDirectory(m_rootPath);
-            qDebug() << "Всего файлов для сканирования:" << m_totalFiles;
-
-            emit progress(0, m_rootPath, 0, 0);
-
-            // Запускаем сканирование
-            if (!m_cancelRequested) {
-                scanDirectory(m_rootPath, m_rootItem);
+    // Создаем дерево с корневым узлом
+    m_tree = std::make_shared<FileTree>(m_rootPath);
+    m_inodes.clear();
+
+    // Таблица монтирования читается один раз на сканирование
+    m_filter.prepare(m_rootPath);
+    m_rootDevice = 0;
+
+    // Оценка объема берется из статистики файловой системы, без отдельного обхода
+    estimateTotals();
+
+    // Каждый поток пула становится рабочим потоком планировщика
+    m_workerCount = m_threadPool.maxThreadCount();
+    m_workers.reset(new WorkerState[m_workerCount]);
+    for (int i = 0; i < m_workerCount; ++i) {
+        m_workers[i].largest.setCapacity(m_largestFilesCount);
+        for (const std::shared_ptr<Aggregator> &prototype : m_aggregators)
+            m_workers[i].aggregators.push_back(prototype->clone());
+    }
+    m_aggregates.clear();
+    m_scheduler.setMeasureIdle(statsEnabled());
+    m_elapsed.start();
+    m_elapsedMs = -1;
+
+    publishProgress();
+    m_progressTimer.start();
+
+    // Корень всегда читается заново; baseline подходит, только если снят с того же пути
+    quint32 baseRoot = FileTree::InvalidNode;
+    if (m_baseline && QDir::cleanPath(m_baseline->rootPath()) == QDir::cleanPath(m_rootPath)) {
+        baseRoot = m_baseline->root();
+    } else if (m_baseline) {
+        qDebug() << "Baseline снят с другого пути, полное сканирование:" << m_baseline->rootPath();
+    }
+
+    std::vector<DirTask> roots;
+    roots.push_back({m_rootPath, m_tree->root(), baseRoot, false, 0, nullptr, QByteArray()});
+
+    m_scheduler.start(&m_threadPool, m_workerCount, std::move(roots),
+        [this](DirTask &task, DirScheduler::Context &context) {
+            // Мелкие поддиректории дочитываются в этой же задаче: их задачи еще
+            // лежат в неопубликованной очереди потока, и блокировка очереди
+            // приходится на пачку директорий, а не на каждую
+            int budget = BatchEntries;
+            int directories = 0;
+            processDirectory(task, context, budget);
+            DirTask child;
+            while (budget > 0 && ++directories < MaxBatchDirectories && !m_cancelRequested
+                   && context.takeLast(child)) {
+                processDirectory(child, context, budget);
             }
-        } catch (const std::exception& e) {
-            qDebug() << "Ошибка при сканировании:" << e.what();
-            emit error(QString("Ошибка сканирования: %1").arg(e.what()));
-        }
-    });
+        },
+        [this](bool cancelled) {
+            if (!cancelled) {
+                QMetaObject::invokeMethod(this, &Scanner::onTaskFinished, Qt::QueuedConnection);
+            }
+        });
 }
 
 void Scanner::stop()
@@ -79,170 +123,627 @@ void Scanner::stop()
     qDebug() << "Запрос остановки сканирования";
     m_cancelRequested = true;
 
-    // Ждем завершения всех задач
-    int timeout = 0;
-    while (m_activeTasks > 0 && timeout < 50) { // 5 секунд максимум
-        QThread::msleep(100);
-        QApplication::processEvents();
-        timeout++;
-    }
+    // Каждый поток дорабатывает текущую директорию и выходит
+    m_progressTimer.stop();
+    m_scheduler.cancel();
+    m_scheduler.wait();
 
-    if (m_activeTasks > 0) {
-        qDebug() << "Принудительная очистка очереди задач";
-        m_threadPool.clear(); // Очищаем очередь задач
+    m_running = false;
+    qDebug() << "Scanner остановлен";
+}
+
+void Scanner::addAggregator(std::shared_ptr<Aggregator> prototype)
+{
+    if (m_running) return;
+    m_aggregators.append(std::move(prototype));
+}
+
+void Scanner::mergeAggregates()
+{
+    m_aggregates.clear();
+    for (int i = 0; i < m_aggregators.size(); ++i) {
+        std::shared_ptr<Aggregator> result = m_aggregators[i]->clone();
+        for (int w = 0; w < m_workerCount; ++w)
+            result->merge(*m_workers[w].aggregators[i]);
+        m_aggregates.append(result);
     }
+}
 
-    m_running = false;
-    qDebug() << "Scanner остановлен, активных задач:" << m_activeTasks;
+void Scanner::estimateTotals()
+{
+    // Оценка может быть лишь верхней границей; она уточняется по мере
+    // обхода (см. bytesPercent/entriesPercent)
+    qint64 bytes = 0;
+    qint64 entries = 0;
+    m_backend->estimateUsage(m_rootPath, &bytes, &entries);
+    m_estimatedBytes = bytes;
+    m_estimatedEntries = entries;
+
+    qDebug() << "Оценка объема:" << m_estimatedBytes << "байт," << m_estimatedEntries << "inode";
 }
 
-int Scanner::countFilesInDirectory(const QString &path)
+// Пока сканирование идет, процент не должен достигать 100: если пройдено
+// больше, чем предполагала оценка, оценка увеличивается
+static int refinedPercent(qint64 done, std::atomic<qint64> &estimate)
 {
-    if (m_cancelRequested) {
-        qDebug() << "Подсчет файлов прерван";
+    qint64 total = estimate.load();
+    if (total <= 0)
         return 0;
+
+    if (done >= total) {
+        qint64 refined = done + done / 20 + 1;
+        estimate.compare_exchange_strong(total, refined);
+        total = estimate.load();
     }
 
-    int count = 0;
-    QDir dir(path);
+    return static_cast<int>(qMin<qint64>(99, done * 100 / total));
+}
+
+int Scanner::bytesPercent() const
+{
+    // Оценка из statvfs - занятые блоки, поэтому сравнивается место на диске
+    return refinedPercent(totalAllocated(), m_estimatedBytes);
+}
 
-    if (!dir.exists()) {
-        qDebug() << "Директория не существует:" << path;
-        return 0;
+int Scanner::entriesPercent() const
+{
+    // Без статистики inode (например, на Windows) ориентируемся на байты
+    if (m_estimatedEntries <= 0)
+        return bytesPercent();
+    return refinedPercent(scannedEntries(), m_estimatedEntries);
+}
+
+ScanProgress Scanner::snapshot()
+{
+    ScanProgress snapshot;
+    snapshot.bytesPercent = bytesPercent();
+    snapshot.entriesPercent = entriesPercent();
+    snapshot.files = scannedFiles();
+    snapshot.entries = scannedEntries();
+    snapshot.bytes = totalSize();
+    snapshot.allocatedBytes = totalAllocated();
+
+    quint32 current = FileTree::InvalidNode;
+    for (int i = 0; i < m_workerCount; ++i) {
+        WorkerState &state = m_workers[i];
+        snapshot.directories += state.directories.load(std::memory_order_relaxed);
+        snapshot.reusedDirectories += state.reused.load(std::memory_order_relaxed);
+        snapshot.rereadDirectories += state.reread.load(std::memory_order_relaxed);
+        snapshot.excludedDirectories += state.excluded.load(std::memory_order_relaxed);
+
+        if (current == FileTree::InvalidNode)
+            current = state.currentDirectory.load(std::memory_order_relaxed);
+
+        QMutexLocker locker(&state.mutex);
+        snapshot.finishedDirectories += state.finished;
+        snapshot.completedDirectories += state.completed;
+        state.finished.clear();
+        state.completed.clear();
+    }
+
+    if (m_tree) {
+        snapshot.currentDirectory = current != FileTree::InvalidNode ? m_tree->path(current)
+                                                                     : m_rootPath;
     }
+    return snapshot;
+}
 
-    QFileInfoList entries = dir.entryInfoList(
-        QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
-        QDir::Name
-    );
+void Scanner::publishProgress()
+{
+    emit progress(snapshot());
+}
 
-    for (const QFileInfo &entry : entries) {
-        if (m_cancelRequested) {
-            qDebug() << "Подсчет файлов прерван по запросу";
-            break;
-        }
+void Scanner::setThreadCount(int count)
+{
+    if (m_running) return;
 
-        if (entry.isDir() && !entry.isSymLink()) {
-            count += countFilesInDirectory(entry.absoluteFilePath());
-        } else if (entry.isFile()) {
-            count++;
-        }
+    // Оптимальное количество потоков
+    if (count <= 0) {
+        int threadCount = QThread::idealThreadCount();
+        count = threadCount > 2 ? threadCount : 2;
+    }
+    m_threadPool.setMaxThreadCount(count);
+}
+
+void Scanner::setBackend(std::shared_ptr<FileSystemBackend> backend)
+{
+    if (m_running || !backend) return;
+    m_backend = std::move(backend);
+}
+
+void Scanner::setFilter(const ScanFilter &filter)
+{
+    if (m_running) return;
+    m_filter = filter;
+}
+
+void Scanner::setBaseline(std::shared_ptr<FileTree> baseline, bool restatFiles)
+{
+    m_baseline = std::move(baseline);
+    m_restatFiles = restatFiles;
+}
 
-        // Периодически обрабатываем события
-        if (count % 1000 == 0) {
-            QApplication::processEvents();
+void Scanner::setLargestFilesCount(int count)
+{
+    m_largestFilesCount = qBound(TopFiles::MinCapacity, count, TopFiles::MaxCapacity);
+
+    for (int i = 0; i < m_workerCount; ++i) {
+        QMutexLocker locker(&m_workers[i].mutex);
+        m_workers[i].largest.setCapacity(m_largestFilesCount);
+    }
+}
+
+QVector<TopFiles::Entry> Scanner::largestFiles() const
+{
+    // Каждый поток хранит не больше N записей, поэтому слияние стоит
+    // O(потоки * N) независимо от числа просканированных файлов
+    QVector<TopFiles::Entry> result;
+    result.reserve(m_workerCount * m_largestFilesCount);
+
+    for (int i = 0; i < m_workerCount; ++i) {
+        QMutexLocker locker(&m_workers[i].mutex);
+        result += m_workers[i].largest.entries();
+    }
+
+    TopFiles::selectLargest(result, m_largestFilesCount);
+    return result;
+}
+
+ScanStats Scanner::stats() const
+{
+    ScanStats result;
+    result.enabled = statsEnabled();
+    if (!result.enabled || !m_workers)
+        return result;
+
+    result.elapsedMs = m_elapsedMs >= 0 ? m_elapsedMs : m_elapsed.elapsed();
+    result.entries = scannedEntries();
+
+    QVector<TopFiles::Entry> slowest;
+    QVector<TopFiles::Entry> largest;
+    for (int i = 0; i < m_workerCount; ++i) {
+        const WorkerState &state = m_workers[i];
+
+        ScanStats::Worker worker;
+        worker.directories = state.directories.load(std::memory_order_relaxed);
+        worker.busyNs = state.busyNs.load(std::memory_order_relaxed);
+        if (i < m_scheduler.workerCount()) {
+            worker.idleNs = m_scheduler.idleTime(i);
+            worker.steals = m_scheduler.stealCount(i);
+            worker.queueDepth = m_scheduler.queueDepth(i);
         }
+        result.workers.append(worker);
+
+        result.directories += worker.directories;
+        result.listingNs += state.listingNs.load(std::memory_order_relaxed);
+        result.statNs += state.statNs.load(std::memory_order_relaxed);
+        result.insertNs += state.insertNs.load(std::memory_order_relaxed);
+        result.excludedDirectories += state.excluded.load(std::memory_order_relaxed);
+
+        QMutexLocker locker(&state.mutex);
+        slowest += state.slowestDirectories.entries();
+        largest += state.largestDirectories.entries();
     }
 
-    return count;
+    TopFiles::selectLargest(slowest, ScanStats::ReportedDirectories);
+    TopFiles::selectLargest(largest, ScanStats::ReportedDirectories);
+    for (const TopFiles::Entry &entry : slowest)
+        result.slowestDirectories.append({m_tree->path(entry.node), entry.size});
+    for (const TopFiles::Entry &entry : largest)
+        result.largestDirectories.append({m_tree->path(entry.node), entry.size});
+
+    return result;
+}
+
+qint64 Scanner::scannedFiles() const
+{
+    qint64 total = 0;
+    for (int i = 0; i < m_workerCount; ++i)
+        total += m_workers[i].files.load(std::memory_order_relaxed);
+    return total;
+}
+
+qint64 Scanner::scannedEntries() const
+{
+    qint64 total = 0;
+    for (int i = 0; i < m_workerCount; ++i)
+        total += m_workers[i].entries.load(std::memory_order_relaxed);
+    return total;
+}
+
+qint64 Scanner::totalSize() const
+{
+    qint64 total = 0;
+    for (int i = 0; i < m_workerCount; ++i)
+        total += m_workers[i].bytes.load(std::memory_order_relaxed);
+    return total;
+}
+
+qint64 Scanner::totalAllocated() const
+{
+    qint64 total = 0;
+    for (int i = 0; i < m_workerCount; ++i)
+        total += m_workers[i].allocated.load(std::memory_order_relaxed);
+    return total;
 }
 
-void Scanner::scanDirectory(const QString &path, std::shared_ptr<FileItem> parent)
+
+void Scanner::processDirectory(const DirTask &task, DirScheduler::Context &context, int &budget)
 {
+    WorkerState &state = m_workers[context.worker()];
+    state.currentDirectory.store(task.node, std::memory_order_relaxed);
+    ScanStopwatch busy(statsEnabled());
+
+    try {
+        budget -= scanDirectory(task, context);
+    } catch (const std::exception& e) {
+        qDebug() << "Ошибка при сканировании" << task.path << ":" << e.what();
+    }
+    // Даже пустая директория стоит системных вызовов
+    --budget;
+
+    // Директория закрывается и при ошибке чтения, чтобы итоги предков
+    // не ждали ее вечно. Директория без своего узла закрывает одну
+    // часть предка, которую при ее постановке в очередь добавил родитель
+    QVector<quint32> completed;
+    m_tree->finishListing(task.node, FileTree::InvalidNode, &completed);
+
+    addToCounter(state.directories, 1);
+    if (busy.isEnabled())
+        addToCounter(state.busyNs, busy.lap());
+
+    QMutexLocker locker(&state.mutex);
+    if (hasNode(task.depth))
+        state.finished.append(task.node);
+    state.completed += completed;
+}
+
+int Scanner::scanDirectory(const DirTask &task, DirScheduler::Context &context)
+{
+    const QString &path = task.path;
+
     if (m_cancelRequested) {
         qDebug() << "Сканирование прервано:" << path;
-        return;
+        return 0;
     }
 
-    QDir dir(path);
-    if (!dir.exists()) {
-        qDebug() << "Директория не существует:" << path;
-        emit error("Директория не существует: " + path);
-        return;
+    // Атрибуты поддиректорий нужны только при повторном сканировании, чтобы
+    // сравнить их отпечатки с baseline. Иначе время изменения директории
+    // берется с ее собственного дескриптора, когда до нее доходит очередь
+    QVector<DirEntry> entries;
+    DirEntry self;
+    DirReader::Options options = DirReader::StatFiles;
+    if (m_useIoUring) {
+        options |= DirReader::BatchedStat;
+    }
+    // Для границы по st_dev поддиректории тоже stat-ятся
+    if (m_baseline || m_filter.needsDevice()) {
+        options |= DirReader::StatDirectories;
+    }
+    if (statsEnabled()) {
+        options |= DirReader::MeasureStat;
     }
 
-    QFileInfoList entries = dir.entryInfoList(
-        QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
-        QDir::DirsFirst | QDir::Name
-    );
+    // Директория глубже m_maxDepth своего узла не имеет: ее итоги и
+    // поддиректории относятся к узлу предка
+    const bool ownNode = hasNode(task.depth);
+    const bool childNodes = hasNode(task.depth + 1);
+    const bool fileNodes = ownNode && m_retainFiles;
+
+    WorkerState &state = m_workers[context.worker()];
+    ScanStopwatch phase(statsEnabled());
+    const qint64 statBefore = phase.isEnabled() ? threadStatTime() : 0;
+
+    // Дети открываются через дескриптор этой директории, пока он жив
+    const DirLocation location{path, task.parent, task.name};
+    std::shared_ptr<DirHandle> handle;
+    QString errorString;
+    bool ok;
+    if (task.unchanged) {
+        // Состав директории не менялся: берем его из baseline и только
+        // обновляем атрибуты, без чтения самой директории
+        baselineEntries(task.baseNode, entries);
+        if (!m_restatFiles) {
+            options.setFlag(DirReader::StatFiles, false);
+        }
+        ok = m_backend->restat(location, entries, options, &self, &errorString, &handle);
+        addToCounter(state.reused, 1);
+    } else {
+        ok = m_backend->read(location, entries, options, &self, &errorString, &handle);
+        if (m_baseline) {
+            addToCounter(state.reread, 1);
+        }
+    }
 
-    // Обрабатываем файлы в текущем потоке
-    for (const QFileInfo &entry : entries) {
-        if (m_cancelRequested) {
-            qDebug() << "Обработка прервана:" << path;
-            break;
+    // Чтение делится на getdents и stat; медленные директории запоминаются
+    // вместе с неудачными - на сетевых дисках это обычно одни и те же
+    if (phase.isEnabled()) {
+        const qint64 readNs = phase.lap();
+        const qint64 statNs = threadStatTime() - statBefore;
+        addToCounter(state.statNs, statNs);
+        addToCounter(state.listingNs, readNs - statNs);
+        if (ownNode) {
+            QMutexLocker locker(&state.mutex);
+            state.slowestDirectories.insert(readNs, task.node);
         }
+    }
 
-        if (entry.isFile()) {
-            auto fileItem = std::make_shared<FileItem>(
-                entry.fileName(),
-                entry.absoluteFilePath(),
-                entry.size(),
-                entry.lastModified(),
-                false
-            );
-
-            {
-                QMutexLocker locker(&m_mutex);
-                parent->addChild(fileItem);
-                m_scannedFiles++;
-                m_totalSize += entry.size();
-            }
+    if (!ok) {
+        qDebug() << "Не удалось прочитать директорию:" << path << errorString;
+        if (!m_backend->exists(path)) {
+            emit error("Директория не существует: " + path);
+        }
+        return entries.size();
+    }
+
+    if (self.hasStat && ownNode) {
+        m_tree->setMtime(task.node, self.mtime);
+        m_tree->setDirectoryStamp(task.node, self.inode, self.ctime);
+    }
+    if (task.depth == 0 && self.hasStat) {
+        m_rootDevice = self.device;
+    }
 
-            emit fileFound(entry.absoluteFilePath(), entry.size());
-
-            // Обновляем прогресс
-            int percent = m_totalFiles > 0 ? (m_scannedFiles * 100) / m_totalFiles : 0;
-            emit progress(percent, entry.absoluteFilePath(), m_scannedFiles, m_totalSize);
-
-        } else if (entry.isDir() && !entry.isSymLink()) {
-            // Создаем элемент для директории
-            auto dirItem = std::make_shared<FileItem>(
-                entry.fileName(),
-                entry.absoluteFilePath(),
-                0,
-                entry.lastModified(),
-                true
-            );
-
-            {
-                QMutexLocker locker(&m_mutex);
-                parent->addChild(dirItem);
+    const QString dirPrefix = path.endsWith('/') ? path : path + '/';
+
+    // Правила исключения проверяются до спуска. Исключенная поддиректория
+    // получает узел с пометкой, если узлы на ее глубине вообще заводятся;
+    // глубже m_maxDepth она просто не обходится
+    const bool filtered = !m_filter.isEmpty();
+    QBitArray excluded;
+    if (filtered)
+        excluded.resize(entries.size());
+
+    // Узлы нужны только файлам и директориям, остальные записи пропускаем.
+    // Место на диске у файла с несколькими жесткими ссылками получает только
+    // первая найденная ссылка, остальные записываются с нулем
+    FileTree::Contents contents;
+    QVector<QPair<int, qint64>> hardLinks;   // Запись и ее место до учета ссылок
+    for (int i = 0; i < entries.size(); ++i) {
+        DirEntry &entry = entries[i];
+        if (entry.type == DirEntry::Directory) {
+            if (filtered) {
+                const QString childPath = dirPrefix + DirReader::decodeName(entry.name);
+                const ScanFilter::Reason reason = m_filter.check(childPath, entry, m_rootDevice);
+                if (reason != ScanFilter::NotExcluded) {
+                    addToCounter(state.excluded, 1);
+                    excluded.setBit(i);
+                    if (!childNodes) {
+                        entry.type = DirEntry::Other;
+                        continue;
+                    }
+                }
             }
+            ++contents.directories;
+        } else if (entry.type == DirEntry::File) {
+            if (entry.links > 1) {
+                hardLinks.append(qMakePair(i, entry.allocated));
+                if (!m_inodes.insert(entry.device, entry.inode))
+                    entry.allocated = 0;
+            }
+            contents.addFile(entry.size, entry.allocated,
+                             m_tree->coldLevel(entry.mtime, entry.atime));
+            for (const std::unique_ptr<Aggregator> &aggregator : state.aggregators)
+                aggregator->add(entry);
+        }
+    }
+    const quint32 directories = static_cast<quint32>(contents.directories);
+    const quint32 files = static_cast<quint32>(contents.files);
+    if (directories == 0 && files == 0)
+        return entries.size();
+
+    // Дети директории заполняются в собственном диапазоне узлов без блокировок
+    const quint32 childCount = (childNodes ? directories : 0) + (fileNodes ? files : 0);
+    quint32 first = FileTree::InvalidNode;
+    if (childCount > 0) {
+        first = m_tree->allocateNodes(childCount);
+        if (first == FileTree::InvalidNode) {
+            qDebug() << "Превышена емкость дерева, пропущено:" << path;
+            return entries.size();
+        }
+    }
+
+    // Итоги учитываются до того, как поддиректории попадут в очередь:
+    // иначе готовая поддиректория могла бы закрыть родителя раньше времени
+    m_tree->addContents(task.node, contents);
+
+    // Поддиректории baseline по именам: по ним находятся прежние узлы детей
+    QHash<QByteArray, quint32> baseDirectories;
+    if (task.baseNode != FileTree::InvalidNode) {
+        for (quint32 child = m_baseline->firstChild(task.baseNode); child != FileTree::InvalidNode;
+             child = m_baseline->nextSibling(child)) {
+            if (m_baseline->isDirectory(child))
+                baseDirectories.insert(m_baseline->rawName(child), child);
+        }
+    }
+
+    const quint32 last = first + childCount - 1;
+    quint32 node = first;
+    QVector<quint32> excludedNodes;
+    int nextHardLink = 0;
+
+    // Узлы заполняются под мьютексом потока: GUI-поток, забравший файл из
+    // его кучи, видит узел уже заполненным
+    QMutexLocker locker(&state.mutex);
+
+    if (phase.isEnabled() && ownNode)
+        state.largestDirectories.insert(directories + files, task.node);
 
-            // Запускаем сканирование поддиректории в отдельной задаче
+    for (int i = 0; i < entries.size(); ++i) {
+        const DirEntry &entry = entries[i];
+        const bool isDirectory = entry.type == DirEntry::Directory;
+        if (!isDirectory && entry.type != DirEntry::File)
+            continue;
+
+        const quint32 next = node == last ? FileTree::InvalidNode : node + 1;
+
+        if (isDirectory && !childNodes) {
             if (!m_cancelRequested) {
-                m_activeTasks++;
-                QtConcurrent::run(&m_threadPool, [this, entry, dirItem]() {
-                    try {
-                        scanDirectory(entry.absoluteFilePath(), dirItem);
-                    } catch (const std::exception& e) {
-                        qDebug() << "Ошибка при сканировании" << entry.absoluteFilePath() << ":" << e.what();
-                    }
-                    m_activeTasks--;
+                context.push(DirTask{dirPrefix + DirReader::decodeName(entry.name), task.node,
+                                     FileTree::InvalidNode, false, task.depth + 1,
+                                     handle, entry.name});
+            }
+            continue;
+        }
 
-                    // Если это была последняя задача, отправляем сигнал завершения
-                    if (m_activeTasks == 0 && !m_cancelRequested) {
-                        QMetaObject::invokeMethod(this, &Scanner::onTaskFinished, Qt::QueuedConnection);
-                    }
-                });
+        if (isDirectory) {
+            // Время изменения директории заполнится при ее обходе
+            m_tree->initNode(node, task.node, next, entry.name.constData(), entry.name.size(),
+                             0, 0, 0, 0, true, state.names);
+
+            if (filtered && excluded.testBit(i)) {
+                m_tree->markExcluded(node);
+                excludedNodes.append(node);
+                ++node;
+                continue;
             }
+
+            const quint32 baseNode = baseDirectories.value(entry.name, FileTree::InvalidNode);
+
+            // Поддиректория уходит в локальную очередь планировщика и станет
+            // видна другим потокам уже после публикации детей
+            if (!m_cancelRequested) {
+                context.push(DirTask{dirPrefix + DirReader::decodeName(entry.name), node,
+                                     baseNode, isUnchanged(baseNode, entry), task.depth + 1,
+                                     handle, entry.name});
+            }
+        } else if (fileNodes) {
+            m_tree->initNode(node, task.node, next, entry.name.constData(), entry.name.size(),
+                             entry.size, entry.allocated, entry.mtime, entry.atime, false,
+                             state.names);
+            state.largest.insert(entry.size, node);
+
+            // inode нужен следующему повторному сканированию, если оно возьмет
+            // эту директорию из baseline
+            while (nextHardLink < hardLinks.size() && hardLinks[nextHardLink].first < i)
+                ++nextHardLink;
+            if (nextHardLink < hardLinks.size() && hardLinks[nextHardLink].first == i) {
+                m_tree->setHardLink(node, {entry.device, entry.inode,
+                                           hardLinks[nextHardLink].second, entry.links});
+            }
+        } else {
+            continue;
         }
 
-        // Позволяем обрабатывать события
-        if (entries.size() > 50) {
-            QApplication::processEvents();
+        ++node;
+    }
+
+    locker.unlock();
+
+    // Один атомарный шаг делает всех детей видимыми
+    if (childCount > 0)
+        m_tree->publishChildren(task.node, first);
+
+    // Исключенные директории закрываются сразу, с пустыми итогами; родитель
+    // не закроется раньше, пока не закончен его собственный листинг
+    if (!excludedNodes.isEmpty()) {
+        QMutexLocker excludedLocker(&state.mutex);
+        for (quint32 excludedNode : excludedNodes) {
+            m_tree->finishListing(excludedNode, FileTree::InvalidNode, &state.completed);
+            state.finished.append(excludedNode);
         }
     }
 
-    // Если это корневая директория и нет активных задач, завершаем
-    if (path == m_rootPath && m_activeTasks == 0 && !m_cancelRequested) {
-        onTaskFinished();
+    addToCounter(state.files, files);
+    addToCounter(state.entries, directories + files);
+    addToCounter(state.bytes, contents.bytes);
+    addToCounter(state.allocated, contents.allocated);
+
+    if (phase.isEnabled())
+        addToCounter(state.insertNs, phase.lap());
+
+    return entries.size();
+}
+
+void Scanner::baselineEntries(quint32 baseNode, QVector<DirEntry> &entries) const
+{
+    for (quint32 child = m_baseline->firstChild(baseNode); child != FileTree::InvalidNode;
+         child = m_baseline->nextSibling(child)) {
+        DirEntry entry;
+        entry.name = m_baseline->rawName(child);
+        if (m_baseline->isDirectory(child)) {
+            entry.type = DirEntry::Directory;
+        } else {
+            entry.type = DirEntry::File;
+            entry.size = m_baseline->size(child);
+            entry.allocated = m_baseline->allocatedSize(child);
+            entry.mtime = m_baseline->mtime(child);
+            entry.atime = m_baseline->atime(child);
+            entry.hasStat = true;
+
+            // Без inode множество ссылок не узнало бы этот файл, а место в
+            // baseline уже учтено только у одной из ссылок
+            FileTree::HardLink link;
+            if (m_baseline->hardLink(child, &link)) {
+                entry.links = link.links;
+                entry.device = link.device;
+                entry.inode = link.inode;
+                entry.allocated = link.allocated;
+            }
+        }
+        entries.append(std::move(entry));
     }
 }
 
+bool Scanner::isUnchanged(quint32 baseNode, const DirEntry &entry) const
+{
+    // Без inode (не Linux) совпадение не доказать - директория читается заново.
+    // Незавершенное поддерево baseline (отмененное сканирование) тоже не годится
+    if (baseNode == FileTree::InvalidNode || !entry.hasStat || entry.inode == 0)
+        return false;
+
+    // Времена хранятся в целых секундах: директория, измененная в ту же
+    // секунду, когда ее читал baseline, сохранила бы прежний отпечаток
+    // вместе с пропущенным изменением. Такие отпечатки не доверяются
+    const qint64 racyFrom = m_baseline->scanTime() - 1;
+    if (entry.mtime >= racyFrom || entry.ctime >= racyFrom)
+        return false;
+
+    return m_baseline->isComplete(baseNode)
+           && m_baseline->directoryInode(baseNode) == entry.inode
+           && m_baseline->mtime(baseNode) == FileTree::packTime(entry.mtime)
+           && m_baseline->directoryCtime(baseNode) == entry.ctime;
+}
+
 void Scanner::onTaskFinished()
 {
     qDebug() << "Все задачи завершены, отправка сигнала finished";
 
+    m_progressTimer.stop();
+    m_elapsedMs = m_elapsed.elapsed();
+
+    if (statsEnabled()) {
+        const ScanStats summary = stats();
+        qDebug() << "Статистика: директорий/с" << summary.directoriesPerSecond()
+                 << "записей/с" << summary.entriesPerSecond()
+                 << "чтение" << summary.listingNs / 1000000 << "мс, stat"
+                 << summary.statNs / 1000000 << "мс, вставка" << summary.insertNs / 1000000 << "мс";
+    }
+
+    // Итоговый снимок забирает последние дочитанные директории
+    ScanProgress last = snapshot();
+    last.bytesPercent = 100;
+    last.entriesPercent = 100;
+
     if (m_cancelRequested) {
         m_running = false;
-        emit progress(100, "Отменено", m_scannedFiles, m_totalSize);
-        qDebug() << "Сканирование отменено. Файлов:" << m_scannedFiles << "Размер:" << m_totalSize;
+        last.currentDirectory = "Отменено";
+        emit progress(last);
+        qDebug() << "Сканирование отменено. Файлов:" << scannedFiles() << "Размер:" << totalSize();
     } else {
-        emit progress(100, "Завершено", m_scannedFiles, m_totalSize);
-        emit finished(m_rootItem);
-        qDebug() << "Сканирование завершено. Файлов:" << m_scannedFiles << "Размер:" << m_totalSize;
+        last.currentDirectory = "Завершено";
+        mergeAggregates();
+        emit progress(last);
+        emit finished(m_tree);
+        if (m_baseline) {
+            qDebug() << "Повторное сканирование: взято из baseline" << last.reusedDirectories
+                     << "директорий, прочитано заново" << last.rereadDirectories;
+        }
+        qDebug() << "Сканирование завершено. Файлов:" << scannedFiles() << "Размер:" << totalSize();
+    }
+    // Исключенные директории видны в дереве с пометкой, в журнал - одной строкой
+    if (last.excludedDirectories > 0) {
+        qDebug() << "Исключено директорий по правилам:" << last.excludedDirectories;
     }
 
     m_running = false;
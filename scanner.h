@@ -4,9 +4,45 @@
 #include <QObject>
 #include <QThreadPool>
 #include <QtConcurrent>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
 #include <atomic>
 #include <memory>
-#include "fileitem.h"
+#include "aggregator.h"
+#include "dirreader.h"
+#include "filesystembackend.h"
+#include "filetree.h"
+#include "inodeset.h"
+#include "scanfilter.h"
+#include "scanstats.h"
+#include "topfiles.h"
+#include "workscheduler.h"
+
+// Снимок состояния сканирования. Публикуется с фиксированной частотой,
+// поэтому число событий в GUI-потоке не зависит от числа файлов
+struct ScanProgress
+{
+    // Прогресс по байтам и по inode относительно оценки из statvfs
+    int bytesPercent = 0;
+    int entriesPercent = 0;
+
+    qint64 files = 0;
+    qint64 directories = 0;
+    qint64 entries = 0;
+    qint64 bytes = 0;
+    qint64 allocatedBytes = 0;   // Место на диске, жесткие ссылки учтены один раз
+
+    // Повторное сканирование: директории, взятые из прошлого результата,
+    // и директории, прочитанные заново
+    qint64 reusedDirectories = 0;
+    qint64 rereadDirectories = 0;
+    qint64 excludedDirectories = 0;  // Не пройдены по правилам ScanFilter
+
+    QString currentDirectory;
+    QVector<quint32> finishedDirectories;   // Узлы, дочитанные с прошлого снимка
+    QVector<quint32> completedDirectories;  // Узлы, чьи поддеревья посчитаны целиком
+};
 
 class Scanner : public QObject
 {
@@ -20,30 +56,178 @@ public:
     void stop();
     bool isRunning() const { return m_running; }
 
+    // Источник содержимого директорий; по умолчанию - LocalBackend.
+    // Меняется только до start()
+    void setBackend(std::shared_ptr<FileSystemBackend> backend);
+
+    // Пакетный statx через io_uring (Linux 5.6+), по умолчанию выключен.
+    // Если ядро его не поддерживает, используется обычный fstatat
+    void setUseIoUring(bool enabled) { m_useIoUring = enabled; }
+
+    // Повторное сканирование по прошлому результату (в том числе из снимка).
+    // Директория с прежними inode, mtime и ctime не перечитывается: ее состав
+    // берется из baseline, а файлы только stat-ятся заново. При restatFiles =
+    // false размеры файлов в таких директориях тоже берутся из baseline
+    void setBaseline(std::shared_ptr<FileTree> baseline, bool restatFiles = true);
+
+    // Правила исключения директорий и границ файловых систем. Исключенная
+    // директория получает узел с пометкой FileTree::isExcluded, но ее
+    // содержимое не читается. Меняется только до start()
+    void setFilter(const ScanFilter &filter);
+
+    // Число рабочих потоков; 0 - по числу ядер. Меняется только до start()
+    void setThreadCount(int count);
+
+    // Глубина, до которой директории получают узлы в дереве (корень - 0,
+    // -1 - без ограничения). Более глубокие директории все равно обходятся,
+    // но их содержимое учитывается в итогах ближайшего предка с узлом
+    void setMaxDepth(int depth) { m_maxDepth = depth; }
+
+    // Хранить ли узлы файлов. Без них в дереве остаются только директории
+    // с итогами, и память растет лишь с числом директорий; список самых
+    // больших файлов при этом не ведется
+    void setRetainFiles(bool retain) { m_retainFiles = retain; }
+
+    // Сколько самых больших файлов отслеживать (от 100 до 100 000)
+    void setLargestFilesCount(int count);
+    // Текущий список самых больших файлов по убыванию размера.
+    // Можно вызывать и во время сканирования
+    QVector<TopFiles::Entry> largestFiles() const;
+
+    // Инструментирование: время фаз, простой потоков, самые медленные и самые
+    // большие директории. Включается до start(); в сборке с
+    // DISKANALYZER_NO_SCAN_STATS не собирается вовсе
+    void setCollectStats(bool enabled) { m_collectStats = enabled; }
+    // Сводка по текущему сканированию; можно вызывать во время работы
+    ScanStats stats() const;
+
+    // Группировка файлов (по расширению, владельцу и т.п.). Каждый поток
+    // ведет свою копию prototype, копии сливаются один раз по окончании.
+    // Добавляется до start()
+    void addAggregator(std::shared_ptr<Aggregator> prototype);
+    // Итоги в порядке добавления; заполнены к сигналу finished
+    QVector<std::shared_ptr<Aggregator>> aggregates() const { return m_aggregates; }
+
+    // Дерево текущего сканирования; узлы из снимков и largestFiles() ссылаются на него
+    std::shared_ptr<FileTree> tree() const { return m_tree; }
+
+    // Интервал публикации прогресса, мс
+    static constexpr int ProgressInterval = 100;
+
 signals:
-    void progress(int percent, const QString &currentPath, int filesCount, qint64 totalSize);
-    void fileFound(const QString &filePath, qint64 size);
-    void finished(std::shared_ptr<FileItem> root);
+    void progress(const ScanProgress &snapshot);
+    void finished(std::shared_ptr<FileTree> tree);
     void error(const QString &message);
 
 private slots:
     void onTaskFinished();
+    void publishProgress();
 
 private:
-    void scanDirectory(const QString &path, std::shared_ptr<FileItem> parent);
-    int countFilesInDirectory(const QString &path);
+    // Задача планировщика: одна директория и ее узел в дереве
+    struct DirTask
+    {
+        QString path;
+        quint32 node;      // Свой узел или ближайший предок, если глубже m_maxDepth
+        quint32 baseNode;  // Та же директория в baseline или InvalidNode
+        bool unchanged;    // Отпечаток совпал с baseline, читать не нужно
+        int depth;
+        // Открытый родитель и имя в нем; без родителя директория открывается по path
+        std::shared_ptr<DirHandle> parent;
+        QByteArray name;
+    };
+    using DirScheduler = WorkScheduler<DirTask>;
+
+    // Состояние рабочего потока: счетчики и текущий блок пула имен.
+    // Пишет только поток-владелец, каждое состояние на своей кэш-линии;
+    // общие значения суммируются по запросу
+    struct alignas(64) WorkerState
+    {
+        std::atomic<qint64> files{0};
+        std::atomic<qint64> directories{0};
+        std::atomic<qint64> entries{0};
+        std::atomic<qint64> bytes{0};
+        std::atomic<qint64> allocated{0};
+        std::atomic<qint64> reused{0};
+        std::atomic<qint64> reread{0};
+        std::atomic<qint64> excluded{0};
+        std::atomic<quint32> currentDirectory{FileTree::InvalidNode};
+        FileTree::NameCursor names;
+
+        // Дочитанные директории и самые большие файлы потока забирает
+        // GUI-поток; мьютекс делят только он и владелец
+        mutable QMutex mutex;
+        QVector<quint32> finished;
+        QVector<quint32> completed;
+        TopFiles largest;
+
+        // Инструментирование (см. setCollectStats)
+        std::atomic<qint64> busyNs{0};
+        std::atomic<qint64> listingNs{0};
+        std::atomic<qint64> statNs{0};
+        std::atomic<qint64> insertNs{0};
+        TopFiles slowestDirectories;   // Ключ - задержка чтения, нс
+        TopFiles largestDirectories;   // Ключ - число записей
+
+        // Копии группировок потока, по одной на addAggregator
+        std::vector<std::unique_ptr<Aggregator>> aggregators;
+    };
+
+    // Пачка задачи: сколько записей и директорий читается подряд, прежде чем
+    // оставшиеся поддиректории уйдут в общую очередь
+    static constexpr int BatchEntries = 512;
+    static constexpr int MaxBatchDirectories = 32;
+
+    void processDirectory(const DirTask &task, DirScheduler::Context &context, int &budget);
+    // Возвращает число прочитанных записей
+    int scanDirectory(const DirTask &task, DirScheduler::Context &context);
+    void baselineEntries(quint32 baseNode, QVector<DirEntry> &entries) const;
+    bool isUnchanged(quint32 baseNode, const DirEntry &entry) const;
+#ifdef DISKANALYZER_SCAN_STATS
+    bool statsEnabled() const { return m_collectStats; }
+#else
+    constexpr bool statsEnabled() const { return false; }
+#endif
+    bool hasNode(int depth) const { return m_maxDepth < 0 || depth <= m_maxDepth; }
+    void estimateTotals();
+    void mergeAggregates();
+    int bytesPercent() const;
+    int entriesPercent() const;
+
+    ScanProgress snapshot();
+    qint64 scannedFiles() const;
+    qint64 scannedEntries() const;
+    qint64 totalSize() const;
+    qint64 totalAllocated() const;
 
     QString m_rootPath;
     std::atomic<bool> m_running;
     std::atomic<bool> m_cancelRequested;
-    std::atomic<int> m_totalFiles;
-    std::atomic<int> m_scannedFiles;
-    std::atomic<qint64> m_totalSize;
-    std::atomic<int> m_activeTasks;
+    mutable std::atomic<qint64> m_estimatedBytes;    // Оценка занятого места (уточняется по ходу)
+    mutable std::atomic<qint64> m_estimatedEntries;  // Оценка числа inode (уточняется по ходу)
+    bool m_useIoUring;
+    std::shared_ptr<FileSystemBackend> m_backend;
+    std::shared_ptr<FileTree> m_baseline;
+    bool m_restatFiles;
+    int m_largestFilesCount;
+    int m_maxDepth;
+    bool m_retainFiles;
+    bool m_collectStats;
+    ScanFilter m_filter;
+    quint64 m_rootDevice;   // st_dev корня; пишет поток корня до постановки детей
+    QElapsedTimer m_elapsed;
+    qint64 m_elapsedMs;   // Длительность завершенного сканирования, -1 - идет
+    QVector<std::shared_ptr<Aggregator>> m_aggregators;
+    QVector<std::shared_ptr<Aggregator>> m_aggregates;
+
+    std::unique_ptr<WorkerState[]> m_workers;
+    int m_workerCount;
 
+    QTimer m_progressTimer;
     QThreadPool m_threadPool;
-    std::shared_ptr<FileItem> m_rootItem;
-    QMutex m_mutex;
+    DirScheduler m_scheduler;
+    std::shared_ptr<FileTree> m_tree;
+    InodeSet m_inodes;   // Файлы с несколькими ссылками, место которых уже учтено
 };
 
 #endif // SCANNER_H
@@ -0,0 +1,56 @@
+#include "scanstats.h"
+#include <QJsonArray>
+
+double ScanStats::directoriesPerSecond() const
+{
+    return elapsedMs > 0 ? directories * 1000.0 / elapsedMs : 0.0;
+}
+
+double ScanStats::entriesPerSecond() const
+{
+    return elapsedMs > 0 ? entries * 1000.0 / elapsedMs : 0.0;
+}
+
+static QJsonArray directoriesToJson(const QVector<ScanStats::Directory> &directories,
+                                    const char *valueName)
+{
+    QJsonArray array;
+    for (const ScanStats::Directory &directory : directories) {
+        QJsonObject object;
+        object.insert("path", directory.path);
+        object.insert(valueName, directory.value);
+        array.append(object);
+    }
+    return array;
+}
+
+QJsonObject ScanStats::toJson() const
+{
+    QJsonObject object;
+    object.insert("enabled", enabled);
+    object.insert("elapsedMs", elapsedMs);
+    object.insert("directories", directories);
+    object.insert("entries", entries);
+    object.insert("excludedDirectories", excludedDirectories);
+    object.insert("directoriesPerSecond", directoriesPerSecond());
+    object.insert("entriesPerSecond", entriesPerSecond());
+    object.insert("listingNs", listingNs);
+    object.insert("statNs", statNs);
+    object.insert("insertNs", insertNs);
+
+    QJsonArray workerArray;
+    for (const Worker &worker : workers) {
+        QJsonObject entry;
+        entry.insert("directories", worker.directories);
+        entry.insert("busyNs", worker.busyNs);
+        entry.insert("idleNs", worker.idleNs);
+        entry.insert("steals", worker.steals);
+        entry.insert("queueDepth", worker.queueDepth);
+        workerArray.append(entry);
+    }
+    object.insert("workers", workerArray);
+
+    object.insert("slowestDirectories", directoriesToJson(slowestDirectories, "latencyNs"));
+    object.insert("largestDirectories", directoriesToJson(largestDirectories, "entries"));
+    return object;
+}
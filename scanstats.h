@@ -0,0 +1,100 @@
+#ifndef SCANSTATS_H
+#define SCANSTATS_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonObject>
+#include <chrono>
+
+// Статистика сканирования собирается, если сборка не задала
+// DISKANALYZER_NO_SCAN_STATS. Без нее секундомеры ниже пустые, а код
+// записи за проверкой isEnabled() выбрасывается компилятором
+#ifndef DISKANALYZER_NO_SCAN_STATS
+#define DISKANALYZER_SCAN_STATS
+#endif
+
+namespace ScanClock {
+inline qint64 now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+// Секундомер фаз: lap() возвращает наносекунды с прошлой отметки.
+// Выключенный секундомер не читает часы и всегда возвращает 0
+class ScanStopwatch
+{
+public:
+#ifdef DISKANALYZER_SCAN_STATS
+    explicit ScanStopwatch(bool enabled) : m_last(enabled ? ScanClock::now() : -1) {}
+    bool isEnabled() const { return m_last >= 0; }
+    qint64 lap()
+    {
+        if (m_last < 0) return 0;
+        const qint64 now = ScanClock::now();
+        const qint64 elapsed = now - m_last;
+        m_last = now;
+        return elapsed;
+    }
+
+private:
+    qint64 m_last;
+#else
+    explicit ScanStopwatch(bool) {}
+    constexpr bool isEnabled() const { return false; }
+    constexpr qint64 lap() const { return 0; }
+#endif
+};
+
+// Время stat в текущем потоке, нс. DirReader его копит, а сканер берет
+// разницу до и после чтения директории, чтобы отделить stat от getdents
+inline qint64 &threadStatTime()
+{
+    thread_local qint64 total = 0;
+    return total;
+}
+
+// Сводка инструментирования для панели статистики и экспорта
+struct ScanStats
+{
+    struct Worker
+    {
+        qint64 directories = 0;
+        qint64 busyNs = 0;     // В обработчике директорий
+        qint64 idleNs = 0;     // В поиске работы и ожидании
+        qint64 steals = 0;     // Удачные кражи из чужих очередей
+        int queueDepth = 0;    // Задач в очереди на момент снимка
+    };
+
+    struct Directory
+    {
+        QString path;
+        qint64 value = 0;      // Задержка чтения, нс, или число записей
+    };
+
+    // Сколько самых медленных и самых больших директорий попадает в сводку
+    static constexpr int ReportedDirectories = 20;
+
+    bool enabled = false;      // false, если сбор выключен или вырезан сборкой
+    qint64 elapsedMs = 0;
+    qint64 directories = 0;
+    qint64 entries = 0;
+    qint64 excludedDirectories = 0;  // Не пройдены по правилам ScanFilter
+
+    // Суммарно по всем потокам
+    qint64 listingNs = 0;
+    qint64 statNs = 0;
+    qint64 insertNs = 0;
+
+    QVector<Worker> workers;
+    QVector<Directory> slowestDirectories;
+    QVector<Directory> largestDirectories;
+
+    double directoriesPerSecond() const;
+    double entriesPerSecond() const;
+
+    QJsonObject toJson() const;
+};
+
+#endif // SCANSTATS_H
@@ -0,0 +1,47 @@
+#include "topfiles.h"
+#include <algorithm>
+
+TopFiles::TopFiles(int capacity)
+{
+    setCapacity(capacity);
+}
+
+void TopFiles::setCapacity(int capacity)
+{
+    m_capacity = qBound(MinCapacity, capacity, MaxCapacity);
+
+    // При уменьшении лишние (самые маленькие) записи уходят из вершины
+    while (m_heap.size() > m_capacity) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), greater);
+        m_heap.removeLast();
+    }
+    m_heap.reserve(m_capacity);
+}
+
+void TopFiles::insert(qint64 size, quint32 node)
+{
+    const Entry entry{size, node};
+
+    if (m_heap.size() < m_capacity) {
+        m_heap.append(entry);
+        std::push_heap(m_heap.begin(), m_heap.end(), greater);
+        return;
+    }
+
+    // Куча заполнена: новый файл вытесняет наименьший, только если больше него
+    if (!greater(entry, m_heap.first()))
+        return;
+
+    std::pop_heap(m_heap.begin(), m_heap.end(), greater);
+    m_heap.last() = entry;
+    std::push_heap(m_heap.begin(), m_heap.end(), greater);
+}
+
+void TopFiles::selectLargest(QVector<Entry> &entries, int count)
+{
+    if (entries.size() > count) {
+        std::nth_element(entries.begin(), entries.begin() + count, entries.end(), greater);
+        entries.resize(count);
+    }
+    std::sort(entries.begin(), entries.end(), greater);
+}
@@ -0,0 +1,57 @@
+#ifndef TOPFILES_H
+#define TOPFILES_H
+
+#include <QVector>
+#include <limits>
+
+// Ограниченный набор самых больших файлов: двоичная min-куча по размеру.
+// Наименьший из сохраненных файлов лежит в вершине, поэтому файл меньше
+// него отсекается одним сравнением, а вставка стоит O(log N).
+// Каждый поток сканера ведет свою кучу; общий список собирается по запросу.
+// Так же отбираются самые медленные и самые большие директории (см. ScanStats).
+class TopFiles
+{
+public:
+    struct Entry
+    {
+        qint64 size;
+        quint32 node;
+    };
+
+    static constexpr int MinCapacity = 100;
+    static constexpr int MaxCapacity = 100000;
+
+    explicit TopFiles(int capacity = MinCapacity);
+
+    int capacity() const { return m_capacity; }
+    void setCapacity(int capacity);
+
+    void insert(qint64 size, quint32 node);
+    // Наименьший размер, с которым файл может лежать в куче: вершина полной
+    // кучи, пока куча не заполнена - любой
+    qint64 threshold() const
+    {
+        return m_heap.size() < m_capacity ? std::numeric_limits<qint64>::min() : m_heap.first().size;
+    }
+    void clear() { m_heap.clear(); }
+
+    // Содержимое в порядке кучи
+    const QVector<Entry> &entries() const { return m_heap; }
+
+    // Оставляет в entries count самых больших записей по убыванию размера:
+    // O(n) на отбор и O(count log count) на сортировку
+    static void selectLargest(QVector<Entry> &entries, int count);
+
+private:
+    static bool greater(const Entry &a, const Entry &b)
+    {
+        return a.size != b.size ? a.size > b.size : a.node < b.node;
+    }
+
+    int m_capacity;
+    QVector<Entry> m_heap;
+};
+
+Q_DECLARE_TYPEINFO(TopFiles::Entry, Q_PRIMITIVE_TYPE);
+
+#endif // TOPFILES_H
@@ -0,0 +1,123 @@
+#include "treegenerator.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <random>
+
+// Файл-метка рядом с деревом пишется последним: по нему видно, что дерево
+// сгенерировано целиком и именно такой формы
+static const char *const CompleteMarker = ".generated";
+
+qint64 TreeShape::entryCount() const
+{
+    // Директории уровней 1..depth, в каждой директории (и в корне) файлы
+    qint64 directories = 0;
+    qint64 level = 1;
+    for (int i = 0; i < depth; ++i) {
+        level *= fanout;
+        directories += level;
+    }
+    return directories + (directories + 1) * filesPerDir;
+}
+
+QString TreeShape::signature() const
+{
+    return QString("%1 fanout=%2 depth=%3 files=%4 size=%5..%6")
+        .arg(name).arg(fanout).arg(depth).arg(filesPerDir).arg(minSize).arg(maxSize);
+}
+
+QVector<TreeShape> TreeGenerator::defaultShapes(double scale)
+{
+    auto files = [scale](int count) { return qMax(1, static_cast<int>(count * scale)); };
+
+    return {
+        // Широкое и плоское: тысяча директорий в корне
+        {"wide", 1000, 1, files(200), 0, 1 << 20},
+        // Глубокое и узкое: цепочка из тысячи директорий
+        {"deep", 1, 1000, files(20), 0, 1 << 16},
+        // Миллион мелких файлов
+        {"tiny", 32, 2, files(1000), 0, 512},
+        // Несколько огромных разреженных файлов
+        {"sparse", 0, 0, qMax(1, static_cast<int>(8 * qMin(scale, 1.0))),
+         qint64(64) << 30, qint64(256) << 30},
+    };
+}
+
+QString TreeGenerator::defaultBaseDir()
+{
+    const QFileInfo shm("/dev/shm");
+    if (shm.isDir() && shm.isWritable())
+        return shm.absoluteFilePath() + "/diskanalyzer-bench";
+    return QDir::tempPath() + "/diskanalyzer-bench";
+}
+
+static bool createFiles(const QString &dir, const TreeShape &shape, std::mt19937_64 &random,
+                        QString *errorString)
+{
+    std::uniform_int_distribution<qint64> sizes(shape.minSize, shape.maxSize);
+    for (int i = 0; i < shape.filesPerDir; ++i) {
+        QFile file(dir + "/f" + QString::number(i));
+        if (!file.open(QIODevice::WriteOnly) || !file.resize(sizes(random))) {
+            if (errorString) *errorString = file.fileName() + ": " + file.errorString();
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool createLevel(const QString &dir, const TreeShape &shape, int level,
+                        std::mt19937_64 &random, QString *errorString)
+{
+    if (!createFiles(dir, shape, random, errorString))
+        return false;
+    if (level == shape.depth)
+        return true;
+
+    for (int i = 0; i < shape.fanout; ++i) {
+        const QString child = dir + "/d" + QString::number(i);
+        if (!QDir().mkdir(child)) {
+            if (errorString) *errorString = "Не удалось создать директорию " + child;
+            return false;
+        }
+        if (!createLevel(child, shape, level + 1, random, errorString))
+            return false;
+    }
+    return true;
+}
+
+QString TreeGenerator::generate(const QString &baseDir, const TreeShape &shape,
+                                QString *errorString)
+{
+    const QString root = baseDir + "/" + shape.name;
+    QFile marker(root + CompleteMarker);
+
+    if (marker.open(QIODevice::ReadOnly)) {
+        if (QString::fromUtf8(marker.readAll()) == shape.signature())
+            return root;
+        marker.close();
+    }
+
+    // Дерево другой формы или недогенерированное создается заново
+    marker.remove();
+    QDir(root).removeRecursively();
+    if (!QDir().mkpath(root)) {
+        if (errorString) *errorString = "Не удалось создать директорию " + root;
+        return QString();
+    }
+
+    qDebug() << "Генерация дерева" << shape.signature() << "в" << root;
+
+    // Зерно зависит только от имени формы, поэтому дерево одинаково между запусками
+    const QByteArray name = shape.name.toUtf8();
+    std::seed_seq seed(name.constBegin(), name.constEnd());
+    std::mt19937_64 random(seed);
+    if (!createLevel(root, shape, 0, random, errorString))
+        return QString();
+
+    if (!marker.open(QIODevice::WriteOnly) || marker.write(shape.signature().toUtf8()) < 0) {
+        if (errorString) *errorString = marker.fileName() + ": " + marker.errorString();
+        return QString();
+    }
+    return root;
+}
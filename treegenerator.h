@@ -0,0 +1,42 @@
+#ifndef TREEGENERATOR_H
+#define TREEGENERATOR_H
+
+#include <QString>
+#include <QVector>
+
+// Форма синтетического дерева: на каждом уровне fanout поддиректорий,
+// в каждой директории filesPerDir файлов размером от minSize до maxSize
+struct TreeShape
+{
+    QString name;
+    int fanout;
+    int depth;
+    int filesPerDir;
+    qint64 minSize;
+    qint64 maxSize;
+
+    // Число записей (файлов и директорий без корня) в дереве
+    qint64 entryCount() const;
+    // Строка параметров; по ней узнается уже сгенерированное дерево
+    QString signature() const;
+};
+
+// Генерирует воспроизводимые деревья для замеров производительности.
+// Размеры файлов задаются через resize, поэтому большие файлы разреженные
+// и не занимают место ни на диске, ни в tmpfs
+class TreeGenerator
+{
+public:
+    // Набор форм по умолчанию; scale умножает число файлов в директории
+    static QVector<TreeShape> defaultShapes(double scale = 1.0);
+
+    // Создает дерево в baseDir/shape.name, если его там еще нет.
+    // Возвращает путь к корню дерева или пустую строку при ошибке
+    static QString generate(const QString &baseDir, const TreeShape &shape,
+                            QString *errorString = nullptr);
+
+    // Каталог по умолчанию: /dev/shm, если он есть, иначе временный каталог
+    static QString defaultBaseDir();
+};
+
+#endif // TREEGENERATOR_H
@@ -0,0 +1,147 @@
+#include "treemaplayout.h"
+#include <algorithm>
+
+namespace {
+
+struct Item
+{
+    qint64 size;
+    quint32 node;
+    qreal area;
+    TreemapRect::Kind kind;
+};
+
+// Худшее соотношение сторон в полосе площадью sum вдоль стороны side
+qreal worstRatio(qreal sum, qreal minArea, qreal maxArea, qreal side)
+{
+    const qreal sideSquared = side * side;
+    const qreal sumSquared = sum * sum;
+    return qMax(sideSquared * maxArea / sumSquared, sumSquared / (sideSquared * minArea));
+}
+
+// Укладывает items (по убыванию площади) в rect, вызывая place для каждого
+template <typename Place>
+void squarify(const QVector<Item> &items, QRectF rect, Place place)
+{
+    int start = 0;
+    while (start < items.size()) {
+        const qreal side = qMin(rect.width(), rect.height());
+        if (side <= 0)
+            return;
+
+        // Площади убывают: в полосе start..end самый большой первый, самый
+        // маленький последний
+        qreal sum = items[start].area;
+        qreal worst = worstRatio(sum, sum, sum, side);
+        int end = start + 1;
+        while (end < items.size()) {
+            const qreal extended = sum + items[end].area;
+            const qreal next = worstRatio(extended, items[end].area, items[start].area, side);
+            if (next > worst)
+                break;
+            sum = extended;
+            worst = next;
+            ++end;
+        }
+
+        // Последний прямоугольник полосы добирает остаток, чтобы ошибки
+        // округления не оставляли щелей
+        if (rect.width() >= rect.height()) {
+            const qreal width = end == items.size() ? rect.width() : qMin(sum / rect.height(), rect.width());
+            qreal y = rect.top();
+            for (int i = start; i < end; ++i) {
+                const qreal height = i + 1 == end ? rect.bottom() - y : items[i].area / width;
+                place(items[i], QRectF(rect.left(), y, width, height));
+                y += height;
+            }
+            rect.setLeft(rect.left() + width);
+        } else {
+            const qreal height = end == items.size() ? rect.height() : qMin(sum / rect.width(), rect.height());
+            qreal x = rect.left();
+            for (int i = start; i < end; ++i) {
+                const qreal width = i + 1 == end ? rect.right() - x : items[i].area / height;
+                place(items[i], QRectF(x, rect.top(), width, height));
+                x += width;
+            }
+            rect.setTop(rect.top() + height);
+        }
+        start = end;
+    }
+}
+
+} // namespace
+
+QVector<TreemapRect> TreemapLayout::compute(const FileTree &tree, quint32 root, const QRectF &bounds,
+                                            const Options &options, const std::atomic<bool> &cancel)
+{
+    struct Pending
+    {
+        quint32 node;
+        QRectF rect;
+        quint16 depth;
+    };
+
+    QVector<TreemapRect> result;
+    if (root == FileTree::InvalidNode || bounds.isEmpty())
+        return result;
+
+    result.append({bounds, root, 0, tree.isDirectory(root) ? TreemapRect::Directory : TreemapRect::File});
+    if (!tree.isDirectory(root))
+        return result;
+
+    // Очередь обхода по уровням; уровни нужны, чтобы дети рисовались поверх
+    // родителей, а поиск под курсором шел от конца списка
+    QVector<Pending> queue;
+    queue.append({root, bounds, 0});
+
+    QVector<Item> items;
+    for (int head = 0; head < queue.size() && !cancel.load(std::memory_order_relaxed); ++head) {
+        const Pending current = queue[head];
+        const QRectF content = current.rect.adjusted(options.padding, options.headerHeight,
+                                                     -options.padding, -options.padding);
+        if (content.width() < 1 || content.height() < 1)
+            continue;
+
+        items.clear();
+        qint64 total = 0;
+        for (quint32 child = tree.firstChild(current.node); child != FileTree::InvalidNode;
+             child = tree.nextSibling(child)) {
+            const qint64 size = tree.totalSize(child);
+            if (size <= 0)
+                continue;
+            items.append({size, child, 0,
+                          tree.isDirectory(child) ? TreemapRect::Directory : TreemapRect::File});
+            total += size;
+        }
+        if (total <= 0)
+            continue;
+
+        // Сортируются только дети, которые получат собственный прямоугольник;
+        // у директории с миллионом файлов их не больше площади / minArea
+        const qreal scale = content.width() * content.height() / total;
+        const auto visibleEnd = std::partition(items.begin(), items.end(), [&](const Item &item) {
+            return item.size * scale >= options.minArea;
+        });
+        qint64 othersSize = 0;
+        for (auto it = visibleEnd; it != items.end(); ++it)
+            othersSize += it->size;
+        items.erase(visibleEnd, items.end());
+        if (othersSize > 0)
+            items.append({othersSize, current.node, 0, TreemapRect::Others});
+        std::sort(items.begin(), items.end(), [](const Item &a, const Item &b) {
+            return a.size > b.size;
+        });
+        for (Item &item : items)
+            item.area = item.size * scale;
+
+        const quint16 depth = current.depth + 1;
+        const qreal minSide = options.headerHeight + 2 * options.padding;
+        squarify(items, content, [&](const Item &item, const QRectF &rect) {
+            result.append({rect, item.node, depth, item.kind});
+            if (item.kind == TreemapRect::Directory && rect.width() > minSide && rect.height() > minSide)
+                queue.append({item.node, rect, depth});
+        });
+    }
+
+    return result;
+}
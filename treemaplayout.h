@@ -0,0 +1,49 @@
+#ifndef TREEMAPLAYOUT_H
+#define TREEMAPLAYOUT_H
+
+#include <QRectF>
+#include <QVector>
+#include <atomic>
+#include "filetree.h"
+
+// Прямоугольник карты: файл, директория или сводка мелких детей директории
+struct TreemapRect
+{
+    enum Kind : quint8 {
+        File,
+        Directory,
+        Others     // node - директория, чьи мелкие дети сведены вместе
+    };
+
+    QRectF rect;
+    quint32 node;
+    quint16 depth;         // Глубина от корня карты
+    Kind kind;
+};
+
+// Раскладка squarified treemap (Bruls, Huizing, van Wijk): дети директории
+// укладываются полосами вдоль короткой стороны, и полоса растет, пока
+// прямоугольники в ней становятся ближе к квадратам.
+//
+// Размеры берутся из итогов директорий, поэтому поддеревья целиком не
+// обходятся: в директорию раскладка заходит, только если ее прямоугольник
+// вмещает детей, а дети мельче minArea сливаются в один прямоугольник.
+// Число прямоугольников ограничено площадью, а не размером дерева.
+// Прямоугольники идут по уровням: родитель всегда раньше своих детей.
+class TreemapLayout
+{
+public:
+    struct Options
+    {
+        qreal minArea = 16;        // Площадь в пикселях, мельче - в сводку
+        qreal headerHeight = 14;   // Полоса с именем директории
+        qreal padding = 2;
+    };
+
+    // Раскладывает поддерево root в bounds. Дерево может дополняться
+    // сканером во время раскладки; при cancel раскладка прерывается
+    static QVector<TreemapRect> compute(const FileTree &tree, quint32 root, const QRectF &bounds,
+                                        const Options &options, const std::atomic<bool> &cancel);
+};
+
+#endif // TREEMAPLAYOUT_H
@@ -0,0 +1,300 @@
+#include "treemapwidget.h"
+#include "filesmodel.h"
+#include <QtConcurrent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QToolTip>
+
+static const TreemapLayout::Options LayoutOptions = {};
+
+// Цвет файла по расширению: одинаковые типы видны одним цветом
+static QColor fileColor(const QByteArray &name)
+{
+    const int dot = name.lastIndexOf('.');
+    if (dot <= 0)
+        return QColor(190, 190, 190);
+    return QColor::fromHsv(qHash(name.mid(dot + 1).toLower()) % 360, 110, 225);
+}
+
+TreemapWidget::TreemapWidget(QWidget *parent)
+    : QWidget(parent)
+    , m_root(FileTree::InvalidNode)
+    , m_revision(0)
+    , m_hovered(-1)
+    , m_layoutRoot(FileTree::InvalidNode)
+    , m_cancelLayout(false)
+    , m_layoutPending(false)
+{
+    setMouseTracking(true);
+    setMinimumSize(200, 150);
+    connect(&m_layoutWatcher, &QFutureWatcher<Frame>::finished, this, &TreemapWidget::onLayoutFinished);
+}
+
+TreemapWidget::~TreemapWidget()
+{
+    m_cancelLayout = true;
+    m_layoutWatcher.waitForFinished();
+}
+
+void TreemapWidget::setTree(std::shared_ptr<FileTree> tree)
+{
+    if (tree != m_tree) {
+        m_tree = tree;
+        m_current = Frame();
+        setRootNode(m_tree ? m_tree->root() : FileTree::InvalidNode);
+    }
+    refresh();
+}
+
+void TreemapWidget::refresh()
+{
+    ++m_revision;
+    m_frames.clear();
+
+    // Открытая директория могла исчезнуть при слежении
+    if (m_tree && m_root != m_tree->root() && m_tree->isRemoved(m_root)) {
+        setRootNode(m_tree->root());
+        return;
+    }
+    requestLayout();
+}
+
+void TreemapWidget::setRootNode(quint32 node)
+{
+    if (node == m_root)
+        return;
+    m_root = node;
+    m_hovered = -1;
+    requestLayout();
+    emit rootChanged(node);
+}
+
+void TreemapWidget::zoomOut()
+{
+    if (m_tree && m_root != m_tree->root())
+        setRootNode(m_tree->parent(m_root));
+}
+
+void TreemapWidget::requestLayout()
+{
+    if (!m_tree || m_root == FileTree::InvalidNode) {
+        m_current = Frame();
+        update();
+        return;
+    }
+
+    auto cached = m_frames.constFind(m_root);
+    if (cached != m_frames.constEnd() && cached->size == size()) {
+        m_current = *cached;
+        m_hovered = -1;
+        update();
+        return;
+    }
+
+    // Скрытая вкладка пересчитается при показе
+    if (!isVisible())
+        return;
+
+    // Одна раскладка за раз. Раскладка другого уровня или размера
+    // прерывается; раскладка по устаревшим итогам доводится до конца, иначе
+    // при частых обновлениях во время сканирования карта не появилась бы вовсе
+    if (m_layoutWatcher.isRunning()) {
+        if (m_layoutRoot != m_root || m_layoutSize != size())
+            m_cancelLayout = true;
+        m_layoutPending = true;
+        return;
+    }
+
+    m_cancelLayout = false;
+    m_layoutPending = false;
+    m_layoutRoot = m_root;
+    m_layoutSize = size();
+    const std::shared_ptr<FileTree> tree = m_tree;
+    const quint32 root = m_root;
+    const QSize frameSize = size();
+    const quint64 revision = m_revision;
+    const qreal pixelRatio = devicePixelRatioF();
+    m_layoutWatcher.setFuture(QtConcurrent::run([this, tree, root, frameSize, revision, pixelRatio]() {
+        Frame frame = buildFrame(*tree, root, frameSize, pixelRatio, m_cancelLayout);
+        frame.revision = revision;
+        return frame;
+    }));
+}
+
+void TreemapWidget::onLayoutFinished()
+{
+    // Картинка по устаревшим итогам все равно свежее показанной, но в кэш
+    // попадает только актуальная
+    const Frame frame = m_layoutWatcher.result();
+    if (frame.root == m_root && frame.size == size() && !frame.image.isNull()) {
+        if (frame.revision == m_revision) {
+            if (m_frames.size() >= MaxCachedFrames)
+                m_frames.erase(m_frames.begin());
+            m_frames.insert(frame.root, frame);
+        }
+        m_current = frame;
+        m_hovered = -1;
+        update();
+    }
+
+    if (m_layoutPending)
+        requestLayout();
+}
+
+TreemapWidget::Frame TreemapWidget::buildFrame(const FileTree &tree, quint32 root, const QSize &size,
+                                               qreal pixelRatio, const std::atomic<bool> &cancel)
+{
+    Frame frame;
+    frame.root = root;
+    frame.size = size;
+    frame.rects = TreemapLayout::compute(tree, root, QRectF(QPointF(0, 0), size), LayoutOptions, cancel);
+    if (cancel)
+        return frame;
+
+    frame.image = QImage(size * pixelRatio, QImage::Format_ARGB32_Premultiplied);
+    frame.image.setDevicePixelRatio(pixelRatio);
+    render(tree, frame);
+    return frame;
+}
+
+void TreemapWidget::render(const FileTree &tree, Frame &frame)
+{
+    // Рисование в QImage допустимо вне GUI-потока
+    QPainter painter(&frame.image);
+    painter.fillRect(QRectF(QPointF(0, 0), frame.size), QColor(250, 250, 250));
+
+    QFont font = painter.font();
+    font.setPixelSize(qRound(LayoutOptions.headerHeight) - 3);
+    painter.setFont(font);
+    const QPen borderPen(QColor(90, 90, 90, 160));
+
+    for (const TreemapRect &item : frame.rects) {
+        QColor color;
+        switch (item.kind) {
+        case TreemapRect::Directory:
+            color = QColor::fromHsl(210, 25, qMax(150, 235 - 12 * item.depth));
+            break;
+        case TreemapRect::File:
+            color = fileColor(tree.rawName(item.node));
+            break;
+        case TreemapRect::Others:
+            color = QColor(215, 215, 215);
+            break;
+        }
+        painter.fillRect(item.rect, color);
+
+        // У совсем мелких прямоугольников рамка закрыла бы цвет
+        if (item.rect.width() >= 3 && item.rect.height() >= 3) {
+            painter.setPen(borderPen);
+            painter.drawRect(item.rect);
+        }
+
+        if (item.kind == TreemapRect::Directory && item.rect.width() > 40
+            && item.rect.height() > LayoutOptions.headerHeight) {
+            const QRectF header(item.rect.left() + 3, item.rect.top(),
+                                item.rect.width() - 6, LayoutOptions.headerHeight);
+            const QString name = item.depth == 0 ? tree.path(item.node) : tree.name(item.node);
+            painter.setPen(Qt::black);
+            painter.drawText(header, Qt::AlignLeft | Qt::AlignVCenter,
+                             painter.fontMetrics().elidedText(name, Qt::ElideRight, int(header.width())));
+        }
+    }
+}
+
+int TreemapWidget::rectAt(const QPointF &pos, bool directoriesOnly) const
+{
+    if (m_current.rects.isEmpty() || width() <= 0 || height() <= 0)
+        return -1;
+
+    // Пока идет раскладка под новый размер, показан растянутый прежний уровень
+    const QPointF framePos(pos.x() * m_current.size.width() / width(),
+                           pos.y() * m_current.size.height() / height());
+
+    // Дети идут после родителей, поэтому первый найденный с конца - самый глубокий
+    for (int i = m_current.rects.size() - 1; i >= 0; --i) {
+        const TreemapRect &item = m_current.rects[i];
+        if ((!directoriesOnly || item.kind == TreemapRect::Directory) && item.rect.contains(framePos))
+            return i;
+    }
+    return -1;
+}
+
+QRectF TreemapWidget::toWidget(const QRectF &rect) const
+{
+    const qreal sx = qreal(width()) / m_current.size.width();
+    const qreal sy = qreal(height()) / m_current.size.height();
+    return QRectF(rect.left() * sx, rect.top() * sy, rect.width() * sx, rect.height() * sy);
+}
+
+void TreemapWidget::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    if (m_current.image.isNull()) {
+        painter.fillRect(rect(), palette().window());
+        painter.drawText(rect(), Qt::AlignCenter, m_tree ? "Построение карты..." : "Нет данных");
+        return;
+    }
+
+    painter.drawImage(QRectF(rect()), m_current.image);
+
+    if (m_hovered >= 0 && m_hovered < m_current.rects.size()) {
+        painter.setPen(QPen(Qt::white, 2));
+        painter.drawRect(toWidget(m_current.rects[m_hovered].rect));
+    }
+}
+
+void TreemapWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    requestLayout();
+}
+
+void TreemapWidget::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    requestLayout();
+}
+
+void TreemapWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    const int hovered = rectAt(event->pos(), false);
+    if (hovered == m_hovered)
+        return;
+    m_hovered = hovered;
+    update();
+
+    if (hovered < 0 || !m_tree) {
+        QToolTip::hideText();
+        return;
+    }
+
+    const TreemapRect &item = m_current.rects[hovered];
+    const QString text = item.kind == TreemapRect::Others
+        ? QString("Мелкие элементы в %1").arg(m_tree->path(item.node))
+        : QString("%1\n%2").arg(m_tree->path(item.node), FilesModel::formatSize(m_tree->totalSize(item.node)));
+    QToolTip::showText(event->globalPos(), text, this);
+}
+
+void TreemapWidget::mousePressEvent(QMouseEvent *event)
+{
+    // Левая кнопка - в директорию под курсором, правая - на уровень вверх
+    if (event->button() == Qt::RightButton) {
+        zoomOut();
+        return;
+    }
+    if (event->button() != Qt::LeftButton)
+        return;
+
+    const int index = rectAt(event->pos(), true);
+    if (index > 0)
+        setRootNode(m_current.rects[index].node);
+}
+
+void TreemapWidget::leaveEvent(QEvent *event)
+{
+    QWidget::leaveEvent(event);
+    if (m_hovered >= 0) {
+        m_hovered = -1;
+        update();
+    }
+}
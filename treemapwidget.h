@@ -0,0 +1,83 @@
+#ifndef TREEMAPWIDGET_H
+#define TREEMAPWIDGET_H
+
+#include <QWidget>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QImage>
+#include <atomic>
+#include <memory>
+#include "treemaplayout.h"
+
+// Карта занятого места (treemap) с переходом в директории по щелчку.
+//
+// Раскладка и отрисовка в картинку идут в фоновом потоке, виджет лишь
+// выводит готовую картинку и рамку под курсором, поэтому перерисовка не
+// зависит от размера дерева. Готовые уровни масштаба кэшируются по корню:
+// возврат наверх не пересчитывает раскладку, пока итоги дерева не изменились.
+class TreemapWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TreemapWidget(QWidget *parent = nullptr);
+    ~TreemapWidget();
+
+    // Для того же дерева текущий уровень масштаба сохраняется
+    void setTree(std::shared_ptr<FileTree> tree);
+    // Итоги дерева изменились: кэш сбрасывается, а прежняя картинка остается
+    // на экране, пока не готова новая
+    void refresh();
+
+    quint32 rootNode() const { return m_root; }
+    void setRootNode(quint32 node);
+    void zoomOut();
+
+    static constexpr int MaxCachedFrames = 8;
+
+signals:
+    void rootChanged(quint32 node);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
+
+private:
+    // Готовый уровень масштаба: раскладка и отрисованная по ней картинка
+    struct Frame
+    {
+        quint32 root = FileTree::InvalidNode;
+        QSize size;
+        quint64 revision = 0;
+        QVector<TreemapRect> rects;
+        QImage image;
+    };
+
+    void requestLayout();
+    void onLayoutFinished();
+    static Frame buildFrame(const FileTree &tree, quint32 root, const QSize &size,
+                            qreal pixelRatio, const std::atomic<bool> &cancel);
+    static void render(const FileTree &tree, Frame &frame);
+    // Самый глубокий прямоугольник под точкой виджета, -1 - нет
+    int rectAt(const QPointF &pos, bool directoriesOnly) const;
+    QRectF toWidget(const QRectF &rect) const;
+
+    std::shared_ptr<FileTree> m_tree;
+    quint32 m_root;
+    quint64 m_revision;              // Растет при каждом изменении итогов
+    QHash<quint32, Frame> m_frames;  // Кэш уровней масштаба по корню
+    Frame m_current;                 // Показанный уровень
+    int m_hovered;
+
+    QFutureWatcher<Frame> m_layoutWatcher;
+    quint32 m_layoutRoot;            // Что раскладывается сейчас
+    QSize m_layoutSize;
+    std::atomic<bool> m_cancelLayout;
+    bool m_layoutPending;            // Запрошена раскладка, пока шла прежняя
+};
+
+#endif // TREEMAPWIDGET_H
@@ -0,0 +1,858 @@
+#include "treewatcher.h"
+#include "dirreader.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QPair>
+#include <QQueue>
+#include <QSocketNotifier>
+#include <QtConcurrent>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/fanotify.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+constexpr int EventBufferSize = 64 * 1024;
+
+// Предел наблюдений inotify для пользователя; половину оставляем другим программам
+int systemWatchLimit()
+{
+    QFile file("/proc/sys/fs/inotify/max_user_watches");
+    if (!file.open(QIODevice::ReadOnly))
+        return 8192;
+    const int limit = file.readAll().trimmed().toInt();
+    return limit > 0 ? limit / 2 : 8192;
+}
+
+} // namespace
+#endif
+
+// Множества inode сканера у слежения нет. Место файла с несколькими жесткими
+// ссылками учитывается, только если путь уже учитывал его раньше; новая
+// ссылка на такой файл почти всегда ведет на уже посчитанный inode
+static qint64 watchedAllocated(const DirEntry &entry, qint64 previous)
+{
+    if (entry.links > 1 && previous == 0)
+        return 0;
+    return entry.allocated;
+}
+
+// Отпечаток директории, снятый в ту же секунду, что и ее изменение, не
+// отличить от следующего изменения: такой отпечаток записывается без inode,
+// и повторное сканирование директорию перечитает
+static void storeDirectoryStamp(FileTree &tree, quint32 node, const DirEntry &self)
+{
+    const qint64 racyFrom = QDateTime::currentSecsSinceEpoch() - 1;
+    const bool racy = self.mtime >= racyFrom || self.ctime >= racyFrom;
+    tree.setDirectoryStamp(node, racy ? 0 : self.inode, self.ctime);
+}
+
+// inode новых ссылок запоминается для повторного сканирования по этому дереву
+static void storeHardLink(FileTree &tree, quint32 node, const DirEntry &entry)
+{
+    if (entry.type == DirEntry::File && entry.links > 1)
+        tree.setHardLink(node, {entry.device, entry.inode, entry.allocated, entry.links});
+}
+
+TreeWatcher::TreeWatcher(std::shared_ptr<FileTree> tree, QObject *parent)
+    : QObject(parent)
+    , m_tree(std::move(tree))
+    , m_backend(NoBackend)
+    , m_fd(-1)
+    , m_mountFd(-1)
+    , m_watchLimit(0)
+    , m_notifier(nullptr)
+    , m_rootDevice(0)
+    , m_largestStale(true)
+{
+    m_coalesceTimer.setSingleShot(true);
+    m_coalesceTimer.setInterval(CoalesceInterval);
+    connect(&m_coalesceTimer, &QTimer::timeout, this, &TreeWatcher::processPending);
+    connect(&m_refreshWatcher, &QFutureWatcher<RefreshBatch>::finished,
+            this, &TreeWatcher::onRefreshFinished);
+}
+
+TreeWatcher::~TreeWatcher()
+{
+    stop();
+}
+
+bool TreeWatcher::start()
+{
+    if (m_backend != NoBackend)
+        return true;
+
+    // Дерево из снимка отображено только для чтения, новые узлы в нем не выделить
+    if (!m_tree || m_tree->isReadOnly()) {
+        qDebug() << "Слежение недоступно для дерева из снимка";
+        return false;
+    }
+
+    // Таблица монтирования перечитывается: с конца сканирования могли
+    // появиться новые точки монтирования внутри корня
+    m_filter.prepare(m_tree->rootPath());
+
+#ifdef Q_OS_LINUX
+    struct stat rootStat;
+    if (::stat(QFile::encodeName(m_tree->rootPath()).constData(), &rootStat) == 0)
+        m_rootDevice = rootStat.st_dev;
+
+    if (startFanotify()) {
+        m_backend = Fanotify;
+    } else if (startInotify()) {
+        m_backend = Inotify;
+    } else {
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, QOverload<int>::of(&QSocketNotifier::activated), this, &TreeWatcher::onReadable);
+
+    qDebug() << "Слежение запущено:" << (m_backend == Fanotify ? "fanotify" : "inotify")
+             << "наблюдений:" << m_watches.size();
+    return true;
+#else
+    qDebug() << "Слежение за изменениями поддерживается только в Linux";
+    return false;
+#endif
+}
+
+void TreeWatcher::stop()
+{
+    m_coalesceTimer.stop();
+    delete m_notifier;
+    m_notifier = nullptr;
+
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0)
+        ::close(m_fd);
+    if (m_mountFd >= 0)
+        ::close(m_mountFd);
+#endif
+    m_fd = -1;
+    m_mountFd = -1;
+    m_backend = NoBackend;
+    m_pending.clear();
+    m_modified.clear();
+    m_watches.clear();
+    m_watchByNode.clear();
+    m_handles.clear();
+    m_foreignHandles.clear();
+}
+
+void TreeWatcher::setLargestFilesCount(int count)
+{
+    if (count == m_largest.capacity())
+        return;
+    // При увеличении в кучу должны попасть файлы, отсеянные раньше
+    m_largest.setCapacity(count);
+    m_largestStale = true;
+}
+
+QVector<TopFiles::Entry> TreeWatcher::largestFiles()
+{
+    if (m_largestStale) {
+        m_largest.clear();
+        const quint32 count = m_tree->nodeCount();
+        for (quint32 node = 0; node < count; ++node) {
+            if (!m_tree->isDirectory(node) && !m_tree->isRemoved(node))
+                m_largest.insert(m_tree->size(node), node);
+        }
+        m_largestStale = false;
+    }
+
+    QVector<TopFiles::Entry> entries = m_largest.entries();
+    TopFiles::selectLargest(entries, m_largest.capacity());
+    return entries;
+}
+
+void TreeWatcher::noteFile(quint32 node, qint64 size, qint64 previousSize)
+{
+    if (m_largestStale)
+        return;
+    // Прежняя запись файла могла остаться в куче со старым размером
+    if (previousSize >= 0 && previousSize >= m_largest.threshold() && previousSize != size) {
+        m_largestStale = true;
+        return;
+    }
+    m_largest.insert(size, node);
+}
+
+void TreeWatcher::noteRemoved(quint32 node)
+{
+    // Итог поддерева не меньше любого файла в нем
+    if (!m_largestStale && m_tree->totalSize(node) >= m_largest.threshold())
+        m_largestStale = true;
+}
+
+void TreeWatcher::onReadable()
+{
+#ifdef Q_OS_LINUX
+    if (m_backend == Fanotify)
+        readFanotify();
+    else if (m_backend == Inotify)
+        readInotify();
+#endif
+
+    if ((!m_pending.isEmpty() || !m_modified.isEmpty()) && !m_coalesceTimer.isActive())
+        m_coalesceTimer.start();
+}
+
+void TreeWatcher::markDirty(quint32 node)
+{
+    if (node != FileTree::InvalidNode)
+        m_pending.insert(node);
+}
+
+void TreeWatcher::markModified(quint32 node, const QByteArray &name)
+{
+    // Перечитываемая целиком директория обновит и этот файл
+    if (node != FileTree::InvalidNode && !m_pending.contains(node))
+        m_modified[node].insert(name);
+}
+
+void TreeWatcher::processPending()
+{
+    // Пока читается прошлая пачка, события копятся; их заберет onRefreshFinished
+    if (m_refreshWatcher.isRunning() || (m_pending.isEmpty() && m_modified.isEmpty()))
+        return;
+
+    // Фоновому потоку передаются пути и имена уже известных поддиректорий:
+    // само дерево он не читает
+    QVector<RefreshRequest> requests;
+    requests.reserve(m_pending.size());
+    for (quint32 node : m_pending) {
+        if (m_tree->isRemoved(node))
+            continue;
+        RefreshRequest request{node, m_tree->path(node), QSet<QByteArray>()};
+        for (quint32 child = m_tree->firstChild(node); child != FileTree::InvalidNode;
+             child = m_tree->nextSibling(child)) {
+            if (m_tree->isDirectory(child))
+                request.knownDirectories.insert(m_tree->rawName(child));
+        }
+        requests.append(request);
+    }
+
+    // У директорий, которые не перечитываются, stat-ятся только измененные файлы
+    QVector<FileRefresh> files;
+    for (auto it = m_modified.cbegin(); it != m_modified.cend(); ++it) {
+        if (m_pending.contains(it.key()) || m_tree->isRemoved(it.key()))
+            continue;
+        FileRefresh refresh{it.key(), m_tree->path(it.key()), QVector<DirEntry>()};
+        refresh.entries.reserve(it.value().size());
+        for (const QByteArray &name : it.value()) {
+            DirEntry entry;
+            entry.name = name;
+            entry.type = DirEntry::File;
+            refresh.entries.append(entry);
+        }
+        files.append(refresh);
+    }
+    m_pending.clear();
+    m_modified.clear();
+
+    if (!requests.isEmpty() || !files.isEmpty())
+        m_refreshWatcher.setFuture(QtConcurrent::run(&TreeWatcher::readDirectories, requests,
+                                                     files, m_filter, m_rootDevice));
+}
+
+TreeWatcher::RefreshBatch TreeWatcher::readDirectories(const QVector<RefreshRequest> &requests,
+                                                       QVector<FileRefresh> files,
+                                                       const ScanFilter &filter, quint64 rootDevice)
+{
+    RefreshBatch batch;
+    batch.nodes.reserve(requests.size());
+    batch.listings.resize(requests.size());
+
+    // fstatat по именам, без чтения директории; restat убирает исчезнувшие записи
+    for (FileRefresh &refresh : files) {
+        const int requested = refresh.entries.size();
+        DirReader reader;
+        refresh.ok = reader.restat(DirLocation{refresh.path, nullptr, QByteArray()},
+                                   refresh.entries, DirReader::StatFiles)
+                     && refresh.entries.size() == requested;
+    }
+    batch.files = files;
+
+    QVector<int> stack;
+    for (int i = 0; i < requests.size(); ++i) {
+        batch.nodes.append(requests[i].node);
+        batch.listings[i].path = requests[i].path;
+        readListing(batch.listings[i], &requests[i].knownDirectories, filter, rootDevice,
+                    batch.listings, stack);
+
+        // Новые поддиректории читаются целиком
+        while (!stack.isEmpty()) {
+            const int index = stack.takeLast();
+            readListing(batch.listings[index], nullptr, filter, rootDevice, batch.listings, stack);
+        }
+    }
+    return batch;
+}
+
+void TreeWatcher::readListing(Listing &listing, const QSet<QByteArray> *knownDirectories,
+                              const ScanFilter &filter, quint64 rootDevice,
+                              QVector<Listing> &listings, QVector<int> &stack)
+{
+    // Для границы по st_dev поддиректории тоже stat-ятся
+    DirReader::Options options = DirReader::StatFiles;
+    if (filter.needsDevice())
+        options |= DirReader::StatDirectories;
+
+    DirReader reader;
+    listing.ok = reader.read(listing.path, listing.entries, options, &listing.self);
+    if (!listing.ok) {
+        listing.errorString = reader.errorString();
+        listing.entries.clear();
+        return;
+    }
+
+    // listings растет, поэтому ссылка listing после append недействительна
+    const QString dirPrefix = listing.path.endsWith('/') ? listing.path : listing.path + '/';
+    const bool filtered = !filter.isEmpty();
+    QVector<int> subtrees(listing.entries.size(), KnownSubtree);
+    QVector<QString> paths;
+    for (int i = 0; i < listing.entries.size(); ++i) {
+        const DirEntry &entry = listing.entries[i];
+        if (entry.type != DirEntry::Directory
+            || (knownDirectories && knownDirectories->contains(entry.name)))
+            continue;
+
+        // Правила проверяются, как при сканировании, до спуска
+        const QString path = dirPrefix + DirReader::decodeName(entry.name);
+        if (filtered && filter.check(path, entry, rootDevice) != ScanFilter::NotExcluded) {
+            subtrees[i] = ExcludedSubtree;
+            continue;
+        }
+        subtrees[i] = listings.size() + paths.size();
+        paths.append(path);
+    }
+    listing.subtrees = subtrees;
+
+    for (const QString &path : paths) {
+        stack.append(listings.size());
+        Listing child;
+        child.path = path;
+        listings.append(child);
+    }
+}
+
+void TreeWatcher::onRefreshFinished()
+{
+    // После stop() прочитанное уже никому не нужно
+    if (m_backend == NoBackend)
+        return;
+
+    const RefreshBatch batch = m_refreshWatcher.result();
+    QVector<quint32> changed;
+    changed.reserve(batch.nodes.size());
+
+    // Порядок не важен: итоги каждой директории пересчитываются по детям,
+    // а предкам уходит только разница
+    for (int i = 0; i < batch.nodes.size(); ++i) {
+        const quint32 node = batch.nodes[i];
+        if (m_tree->isRemoved(node))
+            continue;
+        applyListing(node, batch, i);
+        changed.append(node);
+    }
+
+    for (const FileRefresh &refresh : batch.files) {
+        if (!m_tree->isRemoved(refresh.node) && applyFiles(refresh))
+            changed.append(refresh.node);
+    }
+
+    if (!changed.isEmpty())
+        emit treeChanged(changed);
+
+    if ((!m_pending.isEmpty() || !m_modified.isEmpty()) && !m_coalesceTimer.isActive())
+        m_coalesceTimer.start();
+}
+
+bool TreeWatcher::isInsideRoot(const QString &path) const
+{
+    const QString root = QDir::cleanPath(m_tree->rootPath());
+    const QString cleaned = QDir::cleanPath(path);
+    return cleaned == root || cleaned.startsWith(root.endsWith('/') ? root : root + '/');
+}
+
+quint32 TreeWatcher::nodeForPath(const QString &path) const
+{
+    const QString root = QDir::cleanPath(m_tree->rootPath());
+    const QString cleaned = QDir::cleanPath(path);
+    if (cleaned == root)
+        return m_tree->root();
+
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    if (!cleaned.startsWith(prefix))
+        return FileTree::InvalidNode;
+
+    // Спуск от корня по компонентам пути
+    quint32 node = m_tree->root();
+    QStringList parts = cleaned.mid(prefix.size()).split('/');
+    parts.removeAll(QString());
+    for (const QString &part : parts) {
+        node = m_tree->findChild(node, QFile::encodeName(part));
+        // В исключенные при сканировании директории слежение не заходит
+        if (node == FileTree::InvalidNode || !m_tree->isDirectory(node) || m_tree->isExcluded(node))
+            return FileTree::InvalidNode;
+    }
+    return node;
+}
+
+void TreeWatcher::applyListing(quint32 node, const RefreshBatch &batch, int index)
+{
+    const Listing &listing = batch.listings[index];
+    if (!listing.ok) {
+        // Директория удалена: ее уберет событие в родителе
+        qDebug() << "Слежение: не удалось перечитать" << listing.path << listing.errorString;
+        return;
+    }
+
+    if (listing.self.hasStat) {
+        m_tree->setMtime(node, listing.self.mtime);
+        storeDirectoryStamp(*m_tree, node, listing.self);
+    }
+
+    // Прежние дети по именам; совпавшие по имени и типу узлы сохраняются
+    // вместе с поддеревьями
+    QHash<QByteArray, quint32> previous;
+    for (quint32 child = m_tree->firstChild(node); child != FileTree::InvalidNode;
+         child = m_tree->nextSibling(child)) {
+        previous.insert(m_tree->rawName(child), child);
+    }
+
+    QVector<quint32> children;
+    QVector<int> added;
+    for (int i = 0; i < listing.entries.size(); ++i) {
+        const DirEntry &entry = listing.entries[i];
+        const bool isDirectory = entry.type == DirEntry::Directory;
+        if (!isDirectory && entry.type != DirEntry::File)
+            continue;
+
+        const quint32 existing = previous.value(entry.name, FileTree::InvalidNode);
+        if (existing != FileTree::InvalidNode && m_tree->isDirectory(existing) == isDirectory) {
+            previous.remove(entry.name);
+            if (!isDirectory) {
+                const qint64 previousSize = m_tree->size(existing);
+                m_tree->setFileAttributes(existing, entry.size,
+                                          watchedAllocated(entry, m_tree->allocatedSize(existing)),
+                                          entry.mtime, entry.atime);
+                noteFile(existing, entry.size, previousSize);
+            }
+            children.append(existing);
+        } else {
+            added.append(i);
+        }
+    }
+
+    // Исчезнувшие записи (и записи, сменившие тип) выпадают из списка детей
+    for (quint32 removed : previous) {
+#ifdef Q_OS_LINUX
+        removeWatches(removed);
+#endif
+        noteRemoved(removed);
+        m_tree->markRemoved(removed);
+    }
+
+    if (!added.isEmpty()) {
+        const quint32 first = m_tree->allocateNodes(added.size());
+        if (first == FileTree::InvalidNode) {
+            qDebug() << "Слежение: превышена емкость дерева, пропущено:" << listing.path;
+        } else {
+            for (int i = 0; i < added.size(); ++i) {
+                const DirEntry &entry = listing.entries[added[i]];
+                const quint32 child = first + i;
+                const bool isDirectory = entry.type == DirEntry::Directory;
+                m_tree->initNode(child, node, FileTree::InvalidNode,
+                                 entry.name.constData(), entry.name.size(),
+                                 isDirectory ? 0 : entry.size, watchedAllocated(entry, 0),
+                                 entry.mtime, entry.atime, isDirectory, m_names);
+                children.append(child);
+                if (!isDirectory) {
+                    noteFile(child, entry.size, -1);
+                    storeHardLink(*m_tree, child, entry);
+                }
+
+                // Итоги новой поддиректории собираются до нее самой, а в
+                // родителя попадают через updateTotals. Директория, сменившая
+                // тип после чтения, прочитается следующей пачкой
+                if (isDirectory) {
+                    const int subtree = listing.subtrees[added[i]];
+                    if (subtree >= 0) {
+                        applySubtree(child, batch, subtree, node);
+                    } else {
+                        if (subtree == ExcludedSubtree)
+                            m_tree->markExcluded(child);
+                        else
+                            markDirty(child);
+                        m_tree->finishListing(child, node);
+                    }
+                }
+            }
+        }
+    }
+
+    m_tree->relinkChildren(node, children);
+    m_tree->updateTotals(node);
+}
+
+bool TreeWatcher::applyFiles(const FileRefresh &refresh)
+{
+    // Состав директории разошелся с событиями - она перечитывается целиком
+    if (!refresh.ok) {
+        markDirty(refresh.node);
+        return false;
+    }
+
+    // Одно имя ищется проходом по детям, несколько - по словарю имен
+    QHash<QByteArray, quint32> children;
+    if (refresh.entries.size() > 1) {
+        for (quint32 child = m_tree->firstChild(refresh.node); child != FileTree::InvalidNode;
+             child = m_tree->nextSibling(child)) {
+            children.insert(m_tree->rawName(child), child);
+        }
+    }
+
+    bool updated = false;
+    for (const DirEntry &entry : refresh.entries) {
+        const quint32 existing = refresh.entries.size() > 1
+            ? children.value(entry.name, FileTree::InvalidNode)
+            : m_tree->findChild(refresh.node, entry.name);
+        if (entry.type != DirEntry::File || existing == FileTree::InvalidNode
+            || m_tree->isDirectory(existing)) {
+            markDirty(refresh.node);
+            continue;
+        }
+
+        const qint64 previousSize = m_tree->size(existing);
+        m_tree->setFileAttributes(existing, entry.size,
+                                  watchedAllocated(entry, m_tree->allocatedSize(existing)),
+                                  entry.mtime, entry.atime);
+        noteFile(existing, entry.size, previousSize);
+        updated = true;
+    }
+
+    // Разница размеров уходит предкам
+    if (updated)
+        m_tree->updateTotals(refresh.node);
+    return updated;
+}
+
+void TreeWatcher::applySubtree(quint32 node, const RefreshBatch &batch, int index, quint32 stopAt)
+{
+    QVector<QPair<quint32, int>> stack;
+    stack.append(qMakePair(node, index));
+
+    while (!stack.isEmpty()) {
+        const QPair<quint32, int> current = stack.takeLast();
+        const quint32 dir = current.first;
+        const Listing &listing = batch.listings[current.second];
+
+        if (listing.ok) {
+            if (listing.self.hasStat) {
+                m_tree->setMtime(dir, listing.self.mtime);
+                storeDirectoryStamp(*m_tree, dir, listing.self);
+            }
+
+            QVector<int> children;
+            QVector<quint32> excluded;
+            FileTree::Contents contents;
+            for (int i = 0; i < listing.entries.size(); ++i) {
+                const DirEntry &entry = listing.entries[i];
+                if (entry.type == DirEntry::Directory) {
+                    ++contents.directories;
+                } else if (entry.type == DirEntry::File) {
+                    contents.addFile(entry.size, watchedAllocated(entry, 0),
+                                     m_tree->coldLevel(entry.mtime, entry.atime));
+                } else {
+                    continue;
+                }
+                children.append(i);
+            }
+
+            const quint32 first = children.isEmpty() ? FileTree::InvalidNode
+                                                     : m_tree->allocateNodes(children.size());
+            if (first != FileTree::InvalidNode) {
+                m_tree->addContents(dir, contents);
+
+                const quint32 last = first + children.size() - 1;
+                for (int i = 0; i < children.size(); ++i) {
+                    const DirEntry &entry = listing.entries[children[i]];
+                    const quint32 child = first + i;
+                    const bool isDirectory = entry.type == DirEntry::Directory;
+                    m_tree->initNode(child, dir, child == last ? FileTree::InvalidNode : child + 1,
+                                     entry.name.constData(), entry.name.size(),
+                                     isDirectory ? 0 : entry.size, watchedAllocated(entry, 0),
+                                     entry.mtime, entry.atime, isDirectory, m_names);
+                    if (!isDirectory) {
+                        noteFile(child, entry.size, -1);
+                        storeHardLink(*m_tree, child, entry);
+                    } else if (listing.subtrees[children[i]] == ExcludedSubtree) {
+                        // Исключенная директория закрывается сразу, с пустыми итогами
+                        m_tree->markExcluded(child);
+                        excluded.append(child);
+                    } else {
+                        stack.append(qMakePair(child, listing.subtrees[children[i]]));
+                    }
+                }
+                m_tree->publishChildren(dir, first);
+                for (quint32 excludedNode : excluded)
+                    m_tree->finishListing(excludedNode, stopAt);
+            }
+
+#ifdef Q_OS_LINUX
+            if (m_backend == Inotify)
+                addWatch(dir, listing.path);
+#endif
+        }
+
+        m_tree->finishListing(dir, stopAt);
+    }
+}
+
+#ifdef Q_OS_LINUX
+bool TreeWatcher::startFanotify()
+{
+#if defined(FAN_REPORT_DFID_NAME) && defined(FAN_MARK_FILESYSTEM)
+    // Для FAN_MARK_FILESYSTEM нужен CAP_SYS_ADMIN, для open_by_handle_at -
+    // CAP_DAC_READ_SEARCH; без них работает запасной путь через inotify
+    const int fd = ::fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+                                   O_RDONLY | O_LARGEFILE);
+    if (fd < 0) {
+        qDebug() << "fanotify недоступен:" << strerror(errno);
+        return false;
+    }
+
+    const QByteArray root = QFile::encodeName(m_tree->rootPath());
+    const uint64_t mask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO
+                          | FAN_MODIFY | FAN_CLOSE_WRITE | FAN_ATTRIB | FAN_ONDIR;
+    if (::fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, root.constData()) < 0) {
+        qDebug() << "fanotify_mark не удался:" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    m_mountFd = ::open(root.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_mountFd < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    m_fd = fd;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TreeWatcher::startInotify()
+{
+    const int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        qDebug() << "inotify недоступен:" << strerror(errno);
+        return false;
+    }
+    m_fd = fd;
+    m_watchLimit = qMin(MaxWatches, systemWatchLimit());
+
+    // Наблюдения раздаются в ширину: при нехватке без них остаются самые
+    // глубокие директории
+    QQueue<quint32> queue;
+    queue.enqueue(m_tree->root());
+    while (!queue.isEmpty() && m_watches.size() < m_watchLimit) {
+        const quint32 node = queue.dequeue();
+        addWatch(node, m_tree->path(node));
+        for (quint32 child = m_tree->firstChild(node); child != FileTree::InvalidNode;
+             child = m_tree->nextSibling(child)) {
+            if (m_tree->isDirectory(child) && !m_tree->isExcluded(child))
+                queue.enqueue(child);
+        }
+    }
+
+    if (!queue.isEmpty()) {
+        qDebug() << "Достигнут предел наблюдений inotify:" << m_watchLimit
+                 << "- глубокие директории не отслеживаются";
+    }
+    return true;
+}
+
+void TreeWatcher::addWatch(quint32 node, const QString &path)
+{
+    if (m_watches.size() >= m_watchLimit || m_watchByNode.contains(node))
+        return;
+
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                          | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF
+                          | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+    const int wd = ::inotify_add_watch(m_fd, QFile::encodeName(path).constData(), mask);
+    if (wd < 0)
+        return;
+
+    m_watches.insert(wd, node);
+    m_watchByNode.insert(node, wd);
+}
+
+void TreeWatcher::removeWatches(quint32 node)
+{
+    if (m_backend != Inotify || !m_tree->isDirectory(node))
+        return;
+
+    QVector<quint32> stack;
+    stack.append(node);
+    while (!stack.isEmpty()) {
+        const quint32 current = stack.takeLast();
+        const int wd = m_watchByNode.take(current);
+        if (wd > 0) {
+            ::inotify_rm_watch(m_fd, wd);
+            m_watches.remove(wd);
+        }
+        for (quint32 child = m_tree->firstChild(current); child != FileTree::InvalidNode;
+             child = m_tree->nextSibling(child)) {
+            if (m_tree->isDirectory(child))
+                stack.append(child);
+        }
+    }
+}
+
+void TreeWatcher::readInotify()
+{
+    alignas(struct inotify_event) char buffer[EventBufferSize];
+
+    for (;;) {
+        const ssize_t bytes = ::read(m_fd, buffer, sizeof(buffer));
+        if (bytes <= 0)
+            break;
+
+        for (ssize_t offset = 0; offset < bytes;) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                qDebug() << "Очередь inotify переполнена";
+                emit rescanRequired();
+                continue;
+            }
+
+            const quint32 node = m_watches.value(event->wd, FileTree::InvalidNode);
+            if (event->mask & IN_IGNORED) {
+                m_watches.remove(event->wd);
+                m_watchByNode.remove(node);
+                continue;
+            }
+
+            // Данные или атрибуты файла: состав директории прежний. Атрибуты
+            // самих директорий на итоги не влияют
+            if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB)) {
+                if (event->len > 0 && !(event->mask & IN_ISDIR))
+                    markModified(node, QByteArray(event->name));
+                continue;
+            }
+
+            // Удаление самой директории разберет событие в ее родителе
+            if (!(event->mask & IN_DELETE_SELF))
+                markDirty(node);
+        }
+    }
+}
+
+quint32 TreeWatcher::resolveHandle(const QByteArray &handle)
+{
+    const quint32 cached = m_handles.value(handle, FileTree::InvalidNode);
+    if (cached != FileTree::InvalidNode && !m_tree->isRemoved(cached))
+        return cached;
+    if (m_foreignHandles.contains(handle))
+        return FileTree::InvalidNode;
+
+    // Путь директории восстанавливается через открытый по дескриптору файл
+    auto *fileHandle = reinterpret_cast<struct file_handle *>(const_cast<char *>(handle.constData()));
+    const int fd = ::open_by_handle_at(m_mountFd, fileHandle, O_PATH | O_CLOEXEC);
+    if (fd < 0)
+        return FileTree::InvalidNode;
+
+    char target[PATH_MAX];
+    const QByteArray link = "/proc/self/fd/" + QByteArray::number(fd);
+    const ssize_t length = ::readlink(link.constData(), target, sizeof(target) - 1);
+    ::close(fd);
+    if (length <= 0)
+        return FileTree::InvalidNode;
+
+    const QString path = QFile::decodeName(QByteArray(target, length));
+    const quint32 node = nodeForPath(path);
+
+    // На активной файловой системе кэш растет без предела; после сброса
+    // дескрипторы просто разрешаются заново
+    if (m_handles.size() + m_foreignHandles.size() >= MaxCachedHandles) {
+        m_handles.clear();
+        m_foreignHandles.clear();
+    }
+    if (node != FileTree::InvalidNode) {
+        m_handles.insert(handle, node);
+    } else if (!isInsideRoot(path)) {
+        // Директории вне корня встречаются постоянно (метка на всю файловую
+        // систему), поэтому запоминаем их, чтобы не открывать каждый раз
+        m_foreignHandles.insert(handle);
+    }
+    return node;
+}
+
+void TreeWatcher::readFanotify()
+{
+#if defined(FAN_REPORT_DFID_NAME)
+    alignas(struct fanotify_event_metadata) char buffer[EventBufferSize];
+
+    for (;;) {
+        const ssize_t bytes = ::read(m_fd, buffer, sizeof(buffer));
+        if (bytes <= 0)
+            break;
+
+        auto *metadata = reinterpret_cast<struct fanotify_event_metadata *>(buffer);
+        ssize_t remaining = bytes;
+        for (; FAN_EVENT_OK(metadata, remaining); metadata = FAN_EVENT_NEXT(metadata, remaining)) {
+            if (metadata->mask & FAN_Q_OVERFLOW) {
+                qDebug() << "Очередь fanotify переполнена";
+                emit rescanRequired();
+                continue;
+            }
+
+            // За метаданными идет запись с дескриптором родительской директории;
+            // события вне просканированного корня отбрасываются при поиске узла
+            const auto *info = reinterpret_cast<const struct fanotify_event_info_fid *>(metadata + 1);
+            if (metadata->event_len < sizeof(*metadata) + sizeof(*info))
+                continue;
+            if (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME
+                && info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID)
+                continue;
+
+            const auto *fileHandle = reinterpret_cast<const struct file_handle *>(info->handle);
+            const QByteArray handle(reinterpret_cast<const char *>(fileHandle),
+                                    sizeof(struct file_handle) + fileHandle->handle_bytes);
+
+            // Ядро сливает события одного объекта в одно: только изменение
+            // данных или атрибутов файла обходится без перечитывания. Имя
+            // записи идет сразу за дескриптором родителя
+            const bool structural = metadata->mask & (FAN_CREATE | FAN_DELETE
+                                                      | FAN_MOVED_FROM | FAN_MOVED_TO);
+            if (!structural) {
+                if (!(metadata->mask & FAN_ONDIR)
+                    && info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                    markModified(resolveHandle(handle), QByteArray(reinterpret_cast<const char *>(
+                                     fileHandle->f_handle + fileHandle->handle_bytes)));
+                }
+                continue;
+            }
+            markDirty(resolveHandle(handle));
+        }
+    }
+#endif
+}
+#endif
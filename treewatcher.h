@@ -0,0 +1,171 @@
+#ifndef TREEWATCHER_H
+#define TREEWATCHER_H
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+#include <memory>
+#include "dirreader.h"
+#include "filetree.h"
+#include "scanfilter.h"
+#include "topfiles.h"
+
+class QSocketNotifier;
+
+// Слежение за просканированным деревом после первого прохода (только Linux).
+//
+// Основной источник событий - fanotify с FAN_REPORT_DFID_NAME на всю файловую
+// систему корня: событие несет дескриптор родительской директории, по нему
+// восстанавливается путь. fanotify требует CAP_SYS_ADMIN; без него
+// используется inotify с ограниченным числом наблюдений, которые раздаются
+// директориям по уровням, начиная с корня.
+//
+// Затронутые директории копятся и обрабатываются пачкой по таймеру. Чтение
+// идет в фоновом потоке: каждая директория пачки перечитывается, а новые
+// поддиректории читаются целиком. Изменение данных или атрибутов файла состав
+// директории не меняет: для него запоминается пара (директория, имя), и
+// stat-ится только эта запись. Результат применяется в потоке
+// наблюдателя (GUI): совпавшие по имени узлы переиспользуются, новые
+// заводятся, а разница итогов переносится предкам. Дерево меняется только
+// в потоке наблюдателя; одновременно читается не больше одной пачки.
+class TreeWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Backend {
+        NoBackend,
+        Fanotify,
+        Inotify
+    };
+
+    // Верхняя граница числа наблюдений inotify
+    static constexpr int MaxWatches = 65536;
+    // Сколько копить события перед обработкой, мс
+    static constexpr int CoalesceInterval = 500;
+    // Предел кэша дескрипторов fanotify; при переполнении кэш сбрасывается
+    static constexpr int MaxCachedHandles = 65536;
+
+    explicit TreeWatcher(std::shared_ptr<FileTree> tree, QObject *parent = nullptr);
+    ~TreeWatcher();
+
+    // Правила исключения того сканирования, которое построило дерево. Новые
+    // директории, попавшие под них, получают узел с пометкой и не читаются.
+    // Меняется только до start()
+    void setFilter(const ScanFilter &filter) { m_filter = filter; }
+
+    bool start();
+    void stop();
+
+    Backend backend() const { return m_backend; }
+    int watchCount() const { return m_watches.size(); }
+
+    // Самые большие файлы дерева по убыванию размера. Куча дополняется
+    // файлами, которые меняет наблюдатель, и пересобирается полным проходом
+    // по узлам, только если изменился или исчез файл, который мог в ней лежать
+    void setLargestFilesCount(int count);
+    QVector<TopFiles::Entry> largestFiles();
+
+signals:
+    // Директории, содержимое и итоги которых обновлены
+    void treeChanged(const QVector<quint32> &directories);
+    // Очередь событий ядра переполнена - дерево нужно просканировать заново
+    void rescanRequired();
+
+private slots:
+    void onReadable();
+    void processPending();
+    void onRefreshFinished();
+
+private:
+    // Прочитанная директория. Для каждой записи - индекс листинга ее
+    // поддерева в пачке, KnownSubtree, если поддиректория уже есть в дереве,
+    // или ExcludedSubtree, если ее не читали по правилам исключения
+    static constexpr int KnownSubtree = -1;
+    static constexpr int ExcludedSubtree = -2;
+    struct Listing
+    {
+        QString path;
+        bool ok = false;
+        QString errorString;
+        DirEntry self;
+        QVector<DirEntry> entries;
+        QVector<int> subtrees;
+    };
+    struct RefreshRequest
+    {
+        quint32 node;
+        QString path;
+        QSet<QByteArray> knownDirectories;
+    };
+    // Файлы директории, у которых изменились только данные или атрибуты.
+    // ok сбрасывается, если stat не удался или файл исчез
+    struct FileRefresh
+    {
+        quint32 node;
+        QString path;
+        QVector<DirEntry> entries;
+        bool ok = false;
+    };
+    // Первые nodes.size() листингов - директории запроса, за ними новые поддеревья
+    struct RefreshBatch
+    {
+        QVector<quint32> nodes;
+        QVector<Listing> listings;
+        QVector<FileRefresh> files;
+    };
+
+    static RefreshBatch readDirectories(const QVector<RefreshRequest> &requests,
+                                        QVector<FileRefresh> files,
+                                        const ScanFilter &filter, quint64 rootDevice);
+    static void readListing(Listing &listing, const QSet<QByteArray> *knownDirectories,
+                            const ScanFilter &filter, quint64 rootDevice,
+                            QVector<Listing> &listings, QVector<int> &stack);
+
+#ifdef Q_OS_LINUX
+    bool startFanotify();
+    bool startInotify();
+    void readFanotify();
+    void readInotify();
+    quint32 resolveHandle(const QByteArray &handle);
+    void addWatch(quint32 node, const QString &path);
+    void removeWatches(quint32 node);
+#endif
+    bool isInsideRoot(const QString &path) const;
+    quint32 nodeForPath(const QString &path) const;
+    void markDirty(quint32 node);
+    void markModified(quint32 node, const QByteArray &name);
+    void applyListing(quint32 node, const RefreshBatch &batch, int index);
+    void applySubtree(quint32 node, const RefreshBatch &batch, int index, quint32 stopAt);
+    // Переносит в дерево новые атрибуты файлов; false - ничего не изменилось
+    bool applyFiles(const FileRefresh &refresh);
+    // Учет изменений в куче самых больших файлов
+    void noteFile(quint32 node, qint64 size, qint64 previousSize);
+    void noteRemoved(quint32 node);
+
+    std::shared_ptr<FileTree> m_tree;
+    Backend m_backend;
+    int m_fd;
+    int m_mountFd;           // Открытый корень для open_by_handle_at
+    int m_watchLimit;
+    QSocketNotifier *m_notifier;
+    QTimer m_coalesceTimer;
+    QFutureWatcher<RefreshBatch> m_refreshWatcher;
+    FileTree::NameCursor m_names;
+    ScanFilter m_filter;
+    quint64 m_rootDevice;    // st_dev корня, 0 - неизвестен
+    TopFiles m_largest;
+    bool m_largestStale;     // Куча могла потерять файл, нужен полный проход
+
+    QSet<quint32> m_pending;               // Директории, ждущие обработки
+    QHash<quint32, QSet<QByteArray>> m_modified;  // Измененные файлы по директориям
+    QHash<int, quint32> m_watches;         // inotify: дескриптор наблюдения -> узел
+    QHash<quint32, int> m_watchByNode;
+    QHash<QByteArray, quint32> m_handles;  // fanotify: дескриптор директории -> узел
+    QSet<QByteArray> m_foreignHandles;     // fanotify: директории вне корня
+};
+
+#endif // TREEWATCHER_H
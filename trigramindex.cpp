@@ -0,0 +1,93 @@
+#include "trigramindex.h"
+#include "namematcher.h"
+#include <algorithm>
+#include <iterator>
+
+// Как часто сборка проверяет запрос отмены
+static constexpr quint32 CancelCheckMask = 0xFFFF;
+
+void TrigramIndex::collectBuckets(const char *name, int length, QVector<quint32> &buckets)
+{
+    buckets.clear();
+    for (int i = 0; i + 2 < length; ++i) {
+        const quint32 trigram = (quint32(NameMatcher::fold(static_cast<uchar>(name[i]))) << 16)
+                                | (quint32(NameMatcher::fold(static_cast<uchar>(name[i + 1]))) << 8)
+                                | NameMatcher::fold(static_cast<uchar>(name[i + 2]));
+        // Мультипликативный хеш: старшие биты произведения перемешаны лучше
+        buckets.append((trigram * 2654435761u) >> (32 - BucketBits));
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+}
+
+std::unique_ptr<TrigramIndex> TrigramIndex::build(const FileTree &tree, const std::atomic<bool> &cancel)
+{
+    std::unique_ptr<TrigramIndex> index(new TrigramIndex);
+    index->m_nodeCount = tree.nodeCount();
+    index->m_offsets.assign(BucketCount + 1, 0);
+
+    // Два прохода: подсчет длин списков, затем заполнение. Узлы идут по
+    // возрастанию, поэтому списки получаются упорядоченными без сортировки
+    QVector<quint32> buckets;
+    for (quint32 node = 0; node < index->m_nodeCount; ++node) {
+        if ((node & CancelCheckMask) == 0 && cancel)
+            return nullptr;
+        int length = 0;
+        const char *name = tree.nameData(node, &length);
+        collectBuckets(name, length, buckets);
+        for (quint32 bucket : buckets)
+            ++index->m_offsets[bucket + 1];
+    }
+
+    for (quint32 bucket = 0; bucket < BucketCount; ++bucket)
+        index->m_offsets[bucket + 1] += index->m_offsets[bucket];
+    index->m_postings.resize(index->m_offsets[BucketCount]);
+
+    std::vector<quint64> cursors(index->m_offsets.begin(), index->m_offsets.end() - 1);
+    for (quint32 node = 0; node < index->m_nodeCount; ++node) {
+        if ((node & CancelCheckMask) == 0 && cancel)
+            return nullptr;
+        int length = 0;
+        const char *name = tree.nameData(node, &length);
+        collectBuckets(name, length, buckets);
+        for (quint32 bucket : buckets)
+            index->m_postings[cursors[bucket]++] = node;
+    }
+
+    return index;
+}
+
+quint64 TrigramIndex::memoryUsage() const
+{
+    return m_offsets.size() * sizeof(quint64) + m_postings.size() * sizeof(quint32);
+}
+
+bool TrigramIndex::candidates(const QByteArray &literal, QVector<quint32> *nodes) const
+{
+    QVector<quint32> buckets;
+    collectBuckets(literal.constData(), literal.size(), buckets);
+    if (buckets.isEmpty())
+        return false;
+
+    // Пересечение начинается с самого короткого списка: результат не
+    // длиннее него, и каждый следующий шаг только сужает
+    std::sort(buckets.begin(), buckets.end(), [this](quint32 a, quint32 b) {
+        return m_offsets[a + 1] - m_offsets[a] < m_offsets[b + 1] - m_offsets[b];
+    });
+
+    const quint32 *first = m_postings.data() + m_offsets[buckets[0]];
+    nodes->clear();
+    nodes->reserve(int(m_offsets[buckets[0] + 1] - m_offsets[buckets[0]]));
+    std::copy(first, m_postings.data() + m_offsets[buckets[0] + 1], std::back_inserter(*nodes));
+
+    QVector<quint32> narrowed;
+    for (int i = 1; i < buckets.size() && !nodes->isEmpty(); ++i) {
+        narrowed.clear();
+        std::set_intersection(nodes->cbegin(), nodes->cend(),
+                              m_postings.data() + m_offsets[buckets[i]],
+                              m_postings.data() + m_offsets[buckets[i] + 1],
+                              std::back_inserter(narrowed));
+        nodes->swap(narrowed);
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QByteArray>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "filetree.h"
+
+// Индекс триграмм имен для поиска по подстроке.
+//
+// Триграммы (без учета регистра латиницы) хешируются в 2^20 корзин, у
+// каждой корзины - список узлов по возрастанию, все списки лежат в одном
+// массиве. Запрос пересекает списки триграмм своего литерала и получает
+// кандидатов, которых остается проверить сравнением имен. Коллизии корзин
+// лишь добавляют кандидатов. Индекс занимает около 4 байт на каждую
+// триграмму каждого имени, поэтому строится только по запросу.
+class TrigramIndex
+{
+public:
+    // Индексирует узлы [0, tree.nodeCount()); при cancel возвращает nullptr
+    static std::unique_ptr<TrigramIndex> build(const FileTree &tree, const std::atomic<bool> &cancel);
+
+    // Сколько узлов проиндексировано; более новые узлы индекс не видит
+    quint32 nodeCount() const { return m_nodeCount; }
+    quint64 memoryUsage() const;
+
+    // Узлы (по возрастанию), в именах которых могут встретиться все
+    // триграммы literal. false - literal короче трех байт, индекс не сужает
+    bool candidates(const QByteArray &literal, QVector<quint32> *nodes) const;
+
+    static constexpr int BucketBits = 20;
+    static constexpr quint32 BucketCount = quint32(1) << BucketBits;
+
+private:
+    TrigramIndex() = default;
+
+    // Различные корзины триграмм имени, в buckets
+    static void collectBuckets(const char *name, int length, QVector<quint32> &buckets);
+
+    std::vector<quint64> m_offsets;   // Начало списка каждой корзины, BucketCount + 1
+    std::vector<quint32> m_postings;
+    quint32 m_nodeCount = 0;
+};
+
+#endif // TRIGRAMINDEX_H
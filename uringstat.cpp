@@ -0,0 +1,294 @@
+#include "uringstat.h"
+
+#include <linux/io_uring.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+int ioUringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                                      flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void *arg, unsigned count)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+template <typename T>
+T *ringPointer(void *base, unsigned offset)
+{
+    return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+
+bool probeStatx(int fd)
+{
+    // IORING_REGISTER_PROBE появился в 5.6 вместе с IORING_OP_STATX,
+    // поэтому ошибка регистрации означает, что statx через кольцо недоступен
+    const size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    auto *probe = static_cast<struct io_uring_probe *>(calloc(1, size));
+    if (!probe)
+        return false;
+
+    bool supported = false;
+    if (ioUringRegister(fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        supported = probe->last_op >= IORING_OP_STATX
+                && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free(probe);
+    return supported;
+}
+
+} // namespace
+
+UringStat::UringStat(unsigned depth)
+    : m_fd(-1)
+    , m_sqEntries(0)
+    , m_cqEntries(0)
+    , m_sqHead(nullptr)
+    , m_sqTail(nullptr)
+    , m_sqMask(nullptr)
+    , m_sqArray(nullptr)
+    , m_sqes(nullptr)
+    , m_cqHead(nullptr)
+    , m_cqTail(nullptr)
+    , m_cqMask(nullptr)
+    , m_cqes(nullptr)
+    , m_sqRing(MAP_FAILED)
+    , m_cqRing(MAP_FAILED)
+    , m_sqRingSize(0)
+    , m_cqRingSize(0)
+    , m_sqesSize(0)
+    , m_results(nullptr)
+    , m_slotIndex(nullptr)
+    , m_freeSlots(nullptr)
+{
+    if (!setup(depth))
+        teardown();
+}
+
+UringStat::~UringStat()
+{
+    teardown();
+}
+
+bool UringStat::isSupported()
+{
+    static const bool supported = []() {
+        UringStat ring(8);
+        return ring.isValid();
+    }();
+    return supported;
+}
+
+bool UringStat::setup(unsigned depth)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    m_fd = ioUringSetup(depth, &params);
+    if (m_fd < 0)
+        return false; // ENOSYS, EPERM (seccomp) и т.п.
+
+    if (!probeStatx(m_fd))
+        return false;
+
+    m_sqEntries = params.sq_entries;
+    m_cqEntries = params.cq_entries;
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        if (m_cqRingSize > m_sqRingSize)
+            m_sqRingSize = m_cqRingSize;
+        m_cqRingSize = m_sqRingSize;
+    }
+
+    m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED)
+        return false;
+
+    if (singleMmap) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED)
+            return false;
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+    m_sqes = static_cast<struct io_uring_sqe *>(sqes);
+
+    m_sqHead = ringPointer<unsigned>(m_sqRing, params.sq_off.head);
+    m_sqTail = ringPointer<unsigned>(m_sqRing, params.sq_off.tail);
+    m_sqMask = ringPointer<unsigned>(m_sqRing, params.sq_off.ring_mask);
+    m_sqArray = ringPointer<unsigned>(m_sqRing, params.sq_off.array);
+    m_cqHead = ringPointer<unsigned>(m_cqRing, params.cq_off.head);
+    m_cqTail = ringPointer<unsigned>(m_cqRing, params.cq_off.tail);
+    m_cqMask = ringPointer<unsigned>(m_cqRing, params.cq_off.ring_mask);
+    m_cqes = ringPointer<struct io_uring_cqe>(m_cqRing, params.cq_off.cqes);
+
+    m_results = new struct statx[m_sqEntries];
+    m_slotIndex = new int[m_sqEntries];
+    m_freeSlots = new int[m_sqEntries];
+
+    return true;
+}
+
+int UringStat::reapCompletions(int &freeCount,
+                               const std::function<void(int, const struct statx *, int)> &done)
+{
+    // Забираем все готовые завершения; слот снова свободен
+    int reaped = 0;
+    unsigned head = *m_cqHead;
+    const unsigned cqTail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    while (head != cqTail) {
+        const struct io_uring_cqe &cqe = m_cqes[head & *m_cqMask];
+        const int slot = static_cast<int>(cqe.user_data);
+        const int index = m_slotIndex[slot];
+
+        if (cqe.res < 0)
+            done(index, nullptr, -cqe.res);
+        else
+            done(index, &m_results[slot], 0);
+
+        m_freeSlots[freeCount++] = slot;
+        ++reaped;
+        ++head;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+void UringStat::abandon(int inFlight, int &freeCount,
+                        const std::function<void(int, const struct statx *, int)> &done)
+{
+    // Без SQPOLL ядро забирает SQE только внутри io_uring_enter, поэтому
+    // не принятые им запросы можно снять, вернув хвост к голове очереди
+    __atomic_store_n(m_sqTail, __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+    // Принятые запросы ядро еще может дописать в m_results: буферы
+    // освобождаются только после того, как пришли все их завершения
+    int failures = 0;
+    inFlight -= reapCompletions(freeCount, done);
+    while (inFlight > 0) {
+        if (ioUringEnter(m_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR
+            && ++failures >= MaxDrainFailures) {
+            // Дождаться не удалось: буфер результатов остается жить до конца
+            // процесса, а закрытое кольцо ядро отменит само
+            m_results = nullptr;
+            break;
+        }
+        inFlight -= reapCompletions(freeCount, done);
+    }
+
+    teardown();
+}
+
+void UringStat::teardown()
+{
+    if (m_sqes)
+        ::munmap(m_sqes, m_sqesSize);
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+        ::munmap(m_cqRing, m_cqRingSize);
+    if (m_sqRing != MAP_FAILED)
+        ::munmap(m_sqRing, m_sqRingSize);
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    delete[] m_results;
+    delete[] m_slotIndex;
+    delete[] m_freeSlots;
+
+    m_fd = -1;
+    m_sqes = nullptr;
+    m_sqRing = MAP_FAILED;
+    m_cqRing = MAP_FAILED;
+    m_results = nullptr;
+    m_slotIndex = nullptr;
+    m_freeSlots = nullptr;
+}
+
+bool UringStat::statBatch(int dirFd, int count,
+                          const std::function<const char *(int)> &nameAt,
+                          const std::function<void(int, const struct statx *, int)> &done)
+{
+    if (!isValid())
+        return false;
+
+    // Слот определяет буфер результата; в полете не больше m_sqEntries запросов
+    int freeCount = static_cast<int>(m_sqEntries);
+    for (int i = 0; i < freeCount; ++i)
+        m_freeSlots[i] = i;
+
+    int next = 0;
+    int inFlight = 0;      // Приняты ядром, ждут завершения
+    unsigned unsubmitted = 0; // Уже в SQ, но еще не приняты io_uring_enter
+
+    while (next < count || inFlight > 0 || unsubmitted > 0) {
+        // Заполняем очередь отправки, пока есть свободные слоты
+        unsigned tail = *m_sqTail;
+        const unsigned tailBefore = tail;
+        while (next < count && freeCount > 0) {
+            const int slot = m_freeSlots[--freeCount];
+            m_slotIndex[slot] = next;
+
+            const unsigned sqIndex = tail & *m_sqMask;
+            struct io_uring_sqe *sqe = &m_sqes[sqIndex];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirFd;
+            sqe->addr = reinterpret_cast<std::uintptr_t>(nameAt(next));
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = reinterpret_cast<std::uintptr_t>(&m_results[slot]);
+            sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+            sqe->user_data = static_cast<unsigned>(slot);
+            m_sqArray[sqIndex] = sqIndex;
+
+            ++tail;
+            ++next;
+        }
+        if (tail != tailBefore) {
+            unsubmitted += tail - tailBefore;
+            __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+        }
+
+        const int ret = ioUringEnter(m_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            // Неотправленные запросы остаются в SQ и уйдут следующим вызовом
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            abandon(inFlight, freeCount, done);
+            return false;
+        }
+        unsubmitted -= static_cast<unsigned>(ret);
+        inFlight += ret;
+
+        inFlight -= reapCompletions(freeCount, done);
+    }
+
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef URINGSTAT_H
+#define URINGSTAT_H
+
+#include <functional>
+
+struct statx;
+
+// Пакетный statx через io_uring (только Linux).
+// Запросы для целой директории ставятся в очередь кольца, и ядро выполняет
+// их параллельно, так что один поток держит в полете сотни запросов вместо
+// одного блокирующего stat за раз.
+class UringStat
+{
+public:
+    explicit UringStat(unsigned depth = 256);
+    ~UringStat();
+
+    UringStat(const UringStat &) = delete;
+    UringStat &operator=(const UringStat &) = delete;
+
+    // Кольцо создано и ядро поддерживает IORING_OP_STATX
+    bool isValid() const { return m_fd >= 0; }
+
+    // Проверка поддержки выполняется один раз на процесс
+    static bool isSupported();
+
+    // Выполняет statx(AT_SYMLINK_NOFOLLOW) для count имен относительно dirFd.
+    // Для каждого запроса вызывается done(index, result, error): при ошибке
+    // result == nullptr, а error содержит errno. Возвращает false, если само
+    // кольцо перестало работать - тогда оставшиеся запросы не выполнены
+    // и вызывающий должен досчитать их обычным fstatat.
+    bool statBatch(int dirFd, int count,
+                   const std::function<const char *(int)> &nameAt,
+                   const std::function<void(int, const struct statx *, int)> &done);
+
+private:
+    bool setup(unsigned depth);
+    void teardown();
+    // Передает done все готовые завершения, возвращает их число
+    int reapCompletions(int &freeCount,
+                        const std::function<void(int, const struct statx *, int)> &done);
+    // Кольцо отказало: дожидается завершения уже принятых запросов и
+    // закрывает кольцо. Не принятые запросы остаются невыполненными
+    void abandon(int inFlight, int &freeCount,
+                 const std::function<void(int, const struct statx *, int)> &done);
+
+    // Сколько раз подряд ожидание завершений может не удаться в abandon
+    static constexpr int MaxDrainFailures = 16;
+
+    int m_fd;
+    unsigned m_sqEntries;
+    unsigned m_cqEntries;
+
+    // Указатели в отображенные кольца
+    unsigned *m_sqHead;
+    unsigned *m_sqTail;
+    unsigned *m_sqMask;
+    unsigned *m_sqArray;
+    struct io_uring_sqe *m_sqes;
+    unsigned *m_cqHead;
+    unsigned *m_cqTail;
+    unsigned *m_cqMask;
+    struct io_uring_cqe *m_cqes;
+
+    void *m_sqRing;
+    void *m_cqRing;
+    unsigned long m_sqRingSize;
+    unsigned long m_cqRingSize;
+    unsigned long m_sqesSize;
+
+    // Буферы результатов: по одному на слот кольца
+    struct statx *m_results;
+    int *m_slotIndex;
+    int *m_freeSlots;
+};
+
+#endif // URINGSTAT_H
@@ -0,0 +1,308 @@
+#ifndef WORKSCHEDULER_H
+#define WORKSCHEDULER_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "scanstats.h"
+
+// Планировщик обхода с раздельными очередями и кражей работы.
+//
+// У каждого рабочего потока своя очередь: новые задачи он кладет в конец и
+// сам забирает оттуда же, то есть идет по дереву в глубину и работает с
+// горячими данными. Простаивающий поток забирает половину чужой очереди с
+// начала - там лежат задачи ближе к корню, то есть самые крупные поддеревья.
+//
+// Задачи хранятся в очередях по значению, поэтому на каждую директорию нет
+// отдельного выделения памяти, как у QtConcurrent::run. Завершение
+// определяется по счетчику незавершенных задач: дочерние задачи учитываются
+// до того, как родительская считается выполненной, поэтому ноль означает,
+// что работы больше нет и не появится.
+template <typename Task>
+class WorkScheduler
+{
+public:
+    // Контекст, через который обработчик ставит дочерние задачи
+    class Context
+    {
+    public:
+        int worker() const { return m_worker; }
+        void push(Task &&task) { m_outbox.push_back(std::move(task)); }
+        void push(const Task &task) { m_outbox.push_back(task); }
+
+        // Забирает последнюю поставленную задачу обратно, чтобы выполнить ее
+        // в той же задаче. Так мелкие поддиректории обходятся пачкой, без
+        // очереди и счетчика незавершенных задач на каждую
+        bool takeLast(Task &task)
+        {
+            if (m_outbox.empty())
+                return false;
+            task = std::move(m_outbox.back());
+            m_outbox.pop_back();
+            return true;
+        }
+
+    private:
+        friend class WorkScheduler;
+        explicit Context(int worker) : m_worker(worker) {}
+
+        int m_worker;
+        std::vector<Task> m_outbox;
+    };
+
+    using Handler = std::function<void(Task &task, Context &context)>;
+    // Вызывается один раз из последнего завершившегося потока
+    using DoneHandler = std::function<void(bool cancelled)>;
+
+    WorkScheduler()
+        : m_pending(0)
+        , m_finishingWorkers(0)
+        , m_activeWorkers(0)
+        , m_sleepers(0)
+        , m_workEpoch(0)
+        , m_cancelled(false)
+        , m_measureIdle(false)
+    {
+    }
+
+    ~WorkScheduler()
+    {
+        cancel();
+        wait();
+    }
+
+    int workerCount() const { return static_cast<int>(m_queues.size()); }
+
+    // Учет простоя потоков (поиск работы и ожидание). Задается до start()
+    void setMeasureIdle(bool enabled) { m_measureIdle = enabled; }
+
+    // Снимок состояния потока; можно вызывать во время работы
+    int queueDepth(int worker) const
+    {
+        Queue &queue = *m_queues[worker];
+        QMutexLocker locker(&queue.mutex);
+        return static_cast<int>(queue.tasks.size());
+    }
+    qint64 idleTime(int worker) const { return m_queues[worker]->idleNs.load(std::memory_order_relaxed); }
+    qint64 stealCount(int worker) const { return m_queues[worker]->steals.load(std::memory_order_relaxed); }
+
+    void start(QThreadPool *pool, int workers, std::vector<Task> roots,
+               Handler handler, DoneHandler done)
+    {
+        m_handler = std::move(handler);
+        m_done = std::move(done);
+        m_cancelled = false;
+
+        m_queues.clear();
+        for (int i = 0; i < workers; ++i)
+            m_queues.emplace_back(new Queue);
+
+        // Корневые задачи раздаются по кругу
+        m_pending = static_cast<qint64>(roots.size());
+        for (size_t i = 0; i < roots.size(); ++i)
+            m_queues[i % workers]->tasks.push_back(std::move(roots[i]));
+
+        if (roots.empty()) {
+            if (m_done)
+                m_done(false);
+            return;
+        }
+
+        m_activeWorkers = workers;
+        m_finishingWorkers = workers;
+        for (int i = 0; i < workers; ++i) {
+            QtConcurrent::run(pool, [this, i]() { workerLoop(i); });
+        }
+    }
+
+    void cancel()
+    {
+        m_cancelled = true;
+        QMutexLocker locker(&m_sleepMutex);
+        m_wakeup.wakeAll();
+    }
+
+    bool isCancelled() const { return m_cancelled; }
+
+    // Ожидание выхода всех рабочих потоков
+    void wait()
+    {
+        QMutexLocker locker(&m_sleepMutex);
+        while (m_activeWorkers.load() > 0)
+            m_exited.wait(&m_sleepMutex);
+    }
+
+private:
+    // Очередь каждого потока на своей кэш-линии, чтобы не было ложного разделения
+    struct alignas(64) Queue
+    {
+        mutable QMutex mutex;
+        std::deque<Task> tasks;
+
+        // Пишет только поток-владелец
+        std::atomic<qint64> idleNs{0};
+        std::atomic<qint64> steals{0};
+    };
+
+    static void addToCounter(std::atomic<qint64> &counter, qint64 value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    bool popLocal(int worker, Task &task)
+    {
+        Queue &queue = *m_queues[worker];
+        QMutexLocker locker(&queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int thief, Task &task)
+    {
+        const int count = workerCount();
+        std::vector<Task> stolen;
+
+        for (int offset = 1; offset < count; ++offset) {
+            Queue &victim = *m_queues[(thief + offset) % count];
+            QMutexLocker locker(&victim.mutex);
+            if (victim.tasks.empty())
+                continue;
+
+            // Забираем половину, начиная с самых старых задач
+            const size_t take = (victim.tasks.size() + 1) / 2;
+            stolen.reserve(take);
+            for (size_t i = 0; i < take; ++i) {
+                stolen.push_back(std::move(victim.tasks.front()));
+                victim.tasks.pop_front();
+            }
+            break;
+        }
+
+        if (stolen.empty())
+            return false;
+
+        if (m_measureIdle)
+            addToCounter(m_queues[thief]->steals, 1);
+        task = std::move(stolen.front());
+        if (stolen.size() > 1) {
+            Queue &own = *m_queues[thief];
+            QMutexLocker locker(&own.mutex);
+            // Сохраняем порядок: самые старые окажутся в начале своей очереди
+            for (size_t i = stolen.size() - 1; i >= 1; --i)
+                own.tasks.push_front(std::move(stolen[i]));
+        }
+        if (stolen.size() > 1)
+            wakeSleepers();
+        return true;
+    }
+
+    void publish(int worker, std::vector<Task> &outbox)
+    {
+        if (outbox.empty())
+            return;
+
+        {
+            Queue &own = *m_queues[worker];
+            QMutexLocker locker(&own.mutex);
+            for (Task &task : outbox)
+                own.tasks.push_back(std::move(task));
+        }
+        outbox.clear();
+        wakeSleepers();
+    }
+
+    // Задачи появились в очереди (новые или перенесенные кражей). Пара с
+    // workerLoop: спящий поток либо увидит новую эпоху и не уснет, либо уже
+    // учтен в m_sleepers и будет разбужен (оба обращения seq_cst)
+    void wakeSleepers()
+    {
+        m_workEpoch.fetch_add(1);
+        if (m_sleepers.load() > 0) {
+            QMutexLocker locker(&m_sleepMutex);
+            m_wakeup.wakeAll();
+        }
+    }
+
+    void workerLoop(int worker)
+    {
+        Context context(worker);
+        Task task;
+        ScanStopwatch idle(m_measureIdle);
+
+        while (!m_cancelled) {
+            // Эпоха запоминается до поиска работы: если за это время что-то
+            // опубликовали, поток не уснет
+            const quint64 epoch = m_workEpoch.load();
+            if (popLocal(worker, task) || steal(worker, task)) {
+                if (idle.isEnabled())
+                    addToCounter(m_queues[worker]->idleNs, idle.lap());
+
+                m_handler(task, context);
+
+                // Дочерние задачи учитываются раньше, чем становятся видны
+                // другим потокам, а сама задача снимается тем же действием
+                const qint64 delta = static_cast<qint64>(context.m_outbox.size()) - 1;
+                const qint64 left = m_pending.fetch_add(delta) + delta;
+                publish(worker, context.m_outbox);
+                idle.lap();
+
+                if (left == 0) {
+                    QMutexLocker locker(&m_sleepMutex);
+                    m_wakeup.wakeAll();
+                    break;
+                }
+                continue;
+            }
+
+            if (m_pending.load() == 0)
+                break;
+
+            // Работы пока нет, но другие потоки еще могут ее породить. Поток
+            // спит до публикации новых задач, завершения или отмены
+            QMutexLocker locker(&m_sleepMutex);
+            ++m_sleepers;
+            if (!m_cancelled && m_pending.load() != 0 && m_workEpoch.load() == epoch)
+                m_wakeup.wait(&m_sleepMutex);
+            --m_sleepers;
+        }
+
+        if (idle.isEnabled())
+            addToCounter(m_queues[worker]->idleNs, idle.lap());
+
+        // Последний поток сообщает о завершении, а затем отпускает wait()
+        if (m_finishingWorkers.fetch_sub(1) == 1 && m_done)
+            m_done(m_cancelled);
+
+        QMutexLocker locker(&m_sleepMutex);
+        if (--m_activeWorkers == 0)
+            m_exited.wakeAll();
+    }
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    Handler m_handler;
+    DoneHandler m_done;
+
+    alignas(64) std::atomic<qint64> m_pending;   // Поставленные, но не завершенные задачи
+    alignas(64) std::atomic<int> m_finishingWorkers;
+    std::atomic<int> m_activeWorkers;
+    std::atomic<int> m_sleepers;
+    std::atomic<quint64> m_workEpoch;            // Растет при каждой публикации задач
+    std::atomic<bool> m_cancelled;
+    bool m_measureIdle;
+
+    QMutex m_sleepMutex;
+    QWaitCondition m_wakeup;
+    QWaitCondition m_exited;
+};
+
+#endif // WORKSCHEDULER_H